@@ -293,12 +293,14 @@ class Motor402 : public MotorBase
 public:
 
     Motor402(const std::string &name, ObjectStorageSharedPtr storage, const canopen::Settings &settings)
-    : MotorBase(name), status_word_(0),control_word_(0),
+    : MotorBase(name), status_word_(0), pushed_status_word_(-1), control_word_(0),
       switching_state_(State402::InternalState(settings.get_optional<unsigned int>("switching_state", static_cast<unsigned int>(State402::Operation_Enable)))),
       monitor_mode_(settings.get_optional<bool>("monitor_mode", true)),
-      state_switch_timeout_(settings.get_optional<unsigned int>("state_switch_timeout", 5))
+      state_switch_timeout_(settings.get_optional<unsigned int>("state_switch_timeout", 5)),
+      node_id_(storage->node_id_)
     {
         storage->entry(status_word_entry_, 0x6041);
+        status_word_listener_ = status_word_entry_.subscribe(std::bind(&Motor402::handleStatusWord, this));
         storage->entry(control_word_entry_, 0x6040);
         storage->entry(op_mode_display_, 0x6061);
         storage->entry(op_mode_, 0x6060);
@@ -353,10 +355,12 @@ private:
     ModeSharedPtr allocMode(uint16_t mode);
 
     bool readState(LayerStatus &status, const LayerState &current_state);
+    void handleStatusWord();
     bool switchMode(LayerStatus &status, uint16_t mode);
     bool switchState(LayerStatus &status, const State402::InternalState &target);
 
     std::atomic<uint16_t> status_word_;
+    std::atomic<int32_t> pushed_status_word_; ///< -1 if no RPDO has delivered it since the last read
     uint16_t control_word_;
     boost::mutex cw_mutex_;
     std::atomic<bool> start_fault_reset_;
@@ -377,12 +381,14 @@ private:
     const State402::InternalState switching_state_;
     const bool monitor_mode_;
     const boost::chrono::seconds state_switch_timeout_;
+    const uint8_t node_id_; ///< for the startup profile
 
     canopen::ObjectStorage::Entry<uint16_t>  status_word_entry_;
     canopen::ObjectStorage::Entry<uint16_t >  control_word_entry_;
     canopen::ObjectStorage::Entry<int8_t>  op_mode_display_;
     canopen::ObjectStorage::Entry<int8_t>  op_mode_;
     canopen::ObjectStorage::Entry<uint32_t>  supported_drive_modes_;
+    canopen::ObjectStorage::ChangeListenerConstSharedPtr status_word_listener_;
 };
 
 }
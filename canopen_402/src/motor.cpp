@@ -1,9 +1,14 @@
 #include <canopen_402/motor.h>
+#include <canopen_master/startup_profiler.h>
 #include <boost/thread/reverse_lock.hpp>
 
 namespace canopen
 {
 
+static const StatusCode MODE_HANDLER_ERROR("Mode handler has error");
+static const StatusCode MODE_MISMATCH("mode does not match");
+static const StatusCode INTERNAL_LIMIT("Internal limit active");
+
 State402::InternalState State402::getState(){
     boost::mutex::scoped_lock lock(mutex_);
     return state_;
@@ -64,6 +69,7 @@ State402::InternalState State402::read(uint16_t sw) {
     }
     boost::mutex::scoped_lock lock(mutex_);
     if(new_state != state_){
+        CANOPEN_TRACE_INSTANT("402 state", new_state);
         state_ = new_state;
         cond_.notify_all();
     }
@@ -376,8 +382,15 @@ bool Motor402::switchState(LayerStatus &status, const State402::InternalState &t
     return state == target;
 }
 
+void Motor402::handleStatusWord(){
+    uint16_t sw = status_word_entry_.get();
+    pushed_status_word_ = sw;
+    state_handler_.read(sw); // wakes up switchState right away
+}
+
 bool Motor402::readState(LayerStatus &status, const LayerState &current_state){
-    uint16_t old_sw, sw = status_word_entry_.get(); // TODO: added error handling
+    int32_t pushed = pushed_status_word_.exchange(-1);
+    uint16_t old_sw, sw = pushed >= 0 ? pushed : status_word_entry_.get(); // polled if not mapped or unchanged, TODO: added error handling
     old_sw = status_word_.exchange(sw);
 
     state_handler_.read(sw);
@@ -386,7 +399,7 @@ bool Motor402::readState(LayerStatus &status, const LayerState &current_state){
     uint16_t new_mode = monitor_mode_ ? op_mode_display_.get() : op_mode_display_.get_cached();
     if(selected_mode_ && selected_mode_->mode_id_ == new_mode){
         if(!selected_mode_->read(sw)){
-            status.error("Mode handler has error");
+            status.error(MODE_HANDLER_ERROR);
         }
     }
     if(new_mode != mode_id_){
@@ -394,13 +407,13 @@ bool Motor402::readState(LayerStatus &status, const LayerState &current_state){
         mode_cond_.notify_all();
     }
     if(selected_mode_ && selected_mode_->mode_id_ != new_mode){
-        status.warn("mode does not match");
+        status.warn(MODE_MISMATCH);
     }
     if(sw & (1<<State402::SW_Internal_limit)){
         if(old_sw & (1<<State402::SW_Internal_limit) || current_state != Ready){
-            status.warn("Internal limit active");
+            status.warn(INTERNAL_LIMIT);
         }else{
-            status.error("Internal limit active");
+            status.error(INTERNAL_LIMIT);
         }
     }
 
@@ -473,18 +486,21 @@ void Motor402::handleInit(LayerStatus &status){
         (it->second)();
     }
 
-    if(!readState(status, Init)){
-        status.error("Could not read motor state");
-        return;
-    }
     {
-        boost::mutex::scoped_lock lock(cw_mutex_);
-        control_word_ = 0;
-        start_fault_reset_ = true;
-    }
-    if(!switchState(status, State402::Operation_Enable)){
-        status.error("Could not enable motor");
-        return;
+        StartupProfiler::Phase phase(node_id_, "402_enable");
+        if(!readState(status, Init)){
+            status.error("Could not read motor state");
+            return;
+        }
+        {
+            boost::mutex::scoped_lock lock(cw_mutex_);
+            control_word_ = 0;
+            start_fault_reset_ = true;
+        }
+        if(!switchState(status, State402::Operation_Enable)){
+            status.error("Could not enable motor");
+            return;
+        }
     }
 
     ModeSharedPtr m = allocMode(MotorBase::Homing);
@@ -499,6 +515,7 @@ void Motor402::handleInit(LayerStatus &status){
         return;
     }
 
+    StartupProfiler::Phase phase(node_id_, "402_homing");
     if(!switchMode(status, MotorBase::Homing)){
         status.error("Could not enter homing mode");
         return;
@@ -4,7 +4,12 @@
 #include <memory>
 #include <canopen_master/canopen.h>
 #include <canopen_master/can_layer.h>
+#include <canopen_master/parallel_layer.h>
+#include <canopen_master/program_download.h>
+#include <canopen_master/scheduler.h>
+#include <canopen_master/shared_image.h>
 #include <canopen_chain_node/GetObject.h>
+#include <canopen_chain_node/ProgramDownload.h>
 #include <canopen_chain_node/SetObject.h>
 #include <socketcan_interface/string.h>
 #include <ros/ros.h>
@@ -16,7 +21,8 @@
 namespace canopen{
 
 typedef std::function<void()> PublishFuncType;
-PublishFuncType createPublishFunc(ros::NodeHandle &nh,  const std::string &name, canopen::NodeSharedPtr node, const std::string &key, bool force);
+/// force reads the object in every cycle, on_change publishes only new values on a latched topic
+PublishFuncType createPublishFunc(ros::NodeHandle &nh,  const std::string &name, canopen::NodeSharedPtr node, const std::string &key, bool force, bool on_change = false);
 
 class MergedXmlRpcStruct : public XmlRpc::XmlRpcValue{
     MergedXmlRpcStruct(const XmlRpc::XmlRpcValue& a) :XmlRpc::XmlRpcValue(a){ assertStruct(); }
@@ -147,11 +153,29 @@ protected:
     std::shared_ptr<canopen::LayerGroupNoDiag<canopen::Node> > nodes_;
     std::shared_ptr<canopen::LayerGroupNoDiag<canopen::EMCYHandler> > emcy_handlers_;
     std::map<std::string, canopen::NodeSharedPtr > nodes_lookup_;
+    std::map<std::string, std::shared_ptr<canopen::EMCYHandler> > emcy_lookup_;
     canopen::SyncLayerSharedPtr sync_;
     std::vector<LoggerSharedPtr > loggers_;
     std::vector<PublishFuncType> publishers_;
 
+    SharedImageExportSharedPtr shm_export_;
+    std::string shm_descriptor_;
+
     can::StateListenerConstSharedPtr state_listener_;
+    can::FrameListenerConstSharedPtr trace_listener_;
+    std::string trace_path_;
+    boost::mutex trace_dump_mutex_;
+    boost::thread trace_dump_thread_;
+    void dump_trace_async();
+
+    boost::mutex program_download_mutex_;
+    boost::thread program_download_thread_;
+    std::vector<std::string> program_download_status_; ///< one line per node, progress or result of the last download
+    bool program_download_running_;
+    bool program_download_success_;
+    void run_program_download(const std::vector<canopen::NodeSharedPtr> &nodes, const std::vector<std::string> &names,
+                              const std::string &file, const canopen::ProgramDownload::Options &options);
+    bool program_download_active();
 
     std::unique_ptr<boost::thread> thread_;
 
@@ -168,9 +192,21 @@ protected:
     ros::ServiceServer srv_shutdown_;
     ros::ServiceServer srv_get_object_;
     ros::ServiceServer srv_set_object_;
+    ros::ServiceServer srv_get_layer_timing_;
+    ros::ServiceServer srv_reset_layer_timing_;
+    ros::ServiceServer srv_dump_trace_;
+    ros::ServiceServer srv_get_startup_profile_;
+    ros::ServiceServer srv_program_download_;
+    ros::ServiceServer srv_program_download_status_;
+    ros::ServiceServer srv_read_device_errors_;
 
     time_duration update_duration_;
 
+    std::unique_ptr<PeriodicScheduler> loop_scheduler_; ///< paces the loop if sync is disabled
+    Histogram loop_cycle_; ///< time spent in read and write
+    Histogram loop_period_jitter_;
+    std::atomic<uint64_t> loop_overruns_; ///< cycles that took longer than update_duration_
+
     struct HeartbeatSender{
       can::Frame frame;
       can::DriverInterfaceSharedPtr interface;
@@ -186,23 +222,37 @@ protected:
     bool reset_errors_before_recover_;
 
     void logState(const can::State &s);
+    void traceFrame(const can::Frame &msg);
     void run();
     virtual bool handle_init(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
     virtual bool handle_recover(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
     virtual void handleWrite(LayerStatus &status, const LayerState &current_state);
     virtual void handleShutdown(LayerStatus &status);
+    virtual void handleHalt(LayerStatus &status);
     virtual bool handle_shutdown(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
     virtual bool handle_halt(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
 
     bool handle_get_object(canopen_chain_node::GetObject::Request  &req, canopen_chain_node::GetObject::Response &res);
     bool handle_set_object(canopen_chain_node::SetObject::Request  &req, canopen_chain_node::SetObject::Response &res);
+    bool handle_get_layer_timing(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
+    bool handle_reset_layer_timing(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
+    bool handle_get_startup_profile(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
+    bool handle_dump_trace(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
+    bool handle_read_device_errors(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
+    bool handle_program_download(canopen_chain_node::ProgramDownload::Request  &req, canopen_chain_node::ProgramDownload::Response &res);
+    bool handle_program_download_status(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res);
 
     bool setup_bus();
     bool setup_sync();
     bool setup_heartbeat();
     bool setup_nodes();
+    bool setup_shm_export();
+    void write_shm_descriptor();
     virtual bool nodeAdded(XmlRpc::XmlRpcValue &params, const canopen::NodeSharedPtr &node, const LoggerSharedPtr &logger);
     void report_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &stat);
+    void report_layer_timing(diagnostic_updater::DiagnosticStatusWrapper &stat);
+    void report_startup(diagnostic_updater::DiagnosticStatusWrapper &stat);
+    std::string getNodeName(uint8_t node_id);
     virtual bool setup_chain();
 public:
     RosChain(const ros::NodeHandle &nh, const ros::NodeHandle &nh_priv);
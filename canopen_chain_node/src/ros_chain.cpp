@@ -1,7 +1,10 @@
 #include <ros/package.h>
+#include <fstream>
 
 #include <socketcan_interface/xmlrpc_settings.h>
 #include <canopen_chain_node/ros_chain.h>
+#include <canopen_master/sdo_monitor.h>
+#include <canopen_master/startup_profiler.h>
 
 #include <std_msgs/Int8.h>
 #include <std_msgs/Int16.h>
@@ -17,47 +20,75 @@
 
 namespace canopen {
 
+struct PublishState{
+    std::atomic<bool> mapped; ///< set by the first change notification
+    std::atomic<bool> changed;
+    PublishState() : mapped(false), changed(false) {}
+};
+
 template<typename Tpub, int dt>
-static PublishFuncType create(ros::NodeHandle &nh,  const std::string &name, ObjectStorageSharedPtr storage, const std::string &key, const bool force){
+static PublishFuncType create(ros::NodeHandle &nh,  const std::string &name, ObjectStorageSharedPtr storage, const std::string &key, const bool force, const bool on_change){
     using data_type = typename ObjectStorage::DataType<dt>::type;
     using entry_type = ObjectStorage::Entry<data_type>;
 
     entry_type entry = storage->entry<data_type>(key);
     if(!entry.valid()) return 0;
 
-    const ros::Publisher pub = nh.advertise<Tpub>(name, 1);
+    const ros::Publisher pub = nh.advertise<Tpub>(name, 1, on_change); // latched, so late subscribers get the last value
 
     typedef const data_type(entry_type::*getter_type)(void);
     const getter_type getter = force ? static_cast<getter_type>(&entry_type::get) : static_cast<getter_type>(&entry_type::get_cached);
 
-    return [force, pub, entry, getter] () mutable {
+    if(!on_change){
+        return [pub, entry, getter] () mutable {
+            Tpub msg;
+            msg.data = (const typename Tpub::_data_type &) (entry.*getter)();
+            pub.publish(msg);
+        };
+    }
+
+    // objects mapped to an RPDO are read once they got changed, the others and forced ones are read in every cycle,
+    // either way only new values are published
+    std::shared_ptr<PublishState> state = std::make_shared<PublishState>();
+    ObjectStorage::ChangeListenerConstSharedPtr listener = entry.subscribe([state](const ObjectDict::Key &){
+        state->changed = true;
+        state->mapped = true;
+    }, true);
+
+    return [pub, entry, getter, force, state, listener, published = false, last = data_type()] () mutable {
+        const bool pushed = state->mapped && !force;
+        if(!state->changed.exchange(false) && pushed) return;
+        const data_type value = pushed ? entry.get() : (entry.*getter)();
+        if(published && value == last) return;
+        published = true;
+        last = value;
         Tpub msg;
-        msg.data = (const typename Tpub::_data_type &) (entry.*getter)();
+        msg.data = (const typename Tpub::_data_type &) value;
         pub.publish(msg);
     };
 }
 
-PublishFuncType createPublishFunc(ros::NodeHandle &nh,  const std::string &name, canopen::NodeSharedPtr node, const std::string &key, bool force){
+PublishFuncType createPublishFunc(ros::NodeHandle &nh,  const std::string &name, canopen::NodeSharedPtr node, const std::string &key, bool force, bool on_change){
     ObjectStorageSharedPtr s = node->getStorage();
 
     switch(ObjectDict::DataTypes(s->dict_->get(key)->data_type)){
-        case ObjectDict::DEFTYPE_INTEGER8:       return create< std_msgs::Int8,    ObjectDict::DEFTYPE_INTEGER8       >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_INTEGER16:      return create< std_msgs::Int16,   ObjectDict::DEFTYPE_INTEGER16      >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_INTEGER32:      return create< std_msgs::Int32,   ObjectDict::DEFTYPE_INTEGER32      >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_INTEGER64:      return create< std_msgs::Int64,   ObjectDict::DEFTYPE_INTEGER64      >(nh, name, s, key, force);
+        case ObjectDict::DEFTYPE_INTEGER8:       return create< std_msgs::Int8,    ObjectDict::DEFTYPE_INTEGER8       >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_INTEGER16:      return create< std_msgs::Int16,   ObjectDict::DEFTYPE_INTEGER16      >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_INTEGER32:      return create< std_msgs::Int32,   ObjectDict::DEFTYPE_INTEGER32      >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_INTEGER64:      return create< std_msgs::Int64,   ObjectDict::DEFTYPE_INTEGER64      >(nh, name, s, key, force, on_change);
 
-        case ObjectDict::DEFTYPE_UNSIGNED8:      return create< std_msgs::UInt8,   ObjectDict::DEFTYPE_UNSIGNED8      >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_UNSIGNED16:     return create< std_msgs::UInt16,  ObjectDict::DEFTYPE_UNSIGNED16     >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_UNSIGNED32:     return create< std_msgs::UInt32,  ObjectDict::DEFTYPE_UNSIGNED32     >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_UNSIGNED64:     return create< std_msgs::UInt64,  ObjectDict::DEFTYPE_UNSIGNED64     >(nh, name, s, key, force);
+        case ObjectDict::DEFTYPE_UNSIGNED8:      return create< std_msgs::UInt8,   ObjectDict::DEFTYPE_UNSIGNED8      >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_UNSIGNED16:     return create< std_msgs::UInt16,  ObjectDict::DEFTYPE_UNSIGNED16     >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_UNSIGNED32:     return create< std_msgs::UInt32,  ObjectDict::DEFTYPE_UNSIGNED32     >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_UNSIGNED64:     return create< std_msgs::UInt64,  ObjectDict::DEFTYPE_UNSIGNED64     >(nh, name, s, key, force, on_change);
 
-        case ObjectDict::DEFTYPE_REAL32:         return create< std_msgs::Float32, ObjectDict::DEFTYPE_REAL32         >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_REAL64:         return create< std_msgs::Float64, ObjectDict::DEFTYPE_REAL64         >(nh, name, s, key, force);
+        case ObjectDict::DEFTYPE_REAL32:         return create< std_msgs::Float32, ObjectDict::DEFTYPE_REAL32         >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_REAL64:         return create< std_msgs::Float64, ObjectDict::DEFTYPE_REAL64         >(nh, name, s, key, force, on_change);
 
-        case ObjectDict::DEFTYPE_VISIBLE_STRING: return create< std_msgs::String,  ObjectDict::DEFTYPE_VISIBLE_STRING >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_OCTET_STRING:   return create< std_msgs::String,  ObjectDict::DEFTYPE_DOMAIN         >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_UNICODE_STRING: return create< std_msgs::String,  ObjectDict::DEFTYPE_UNICODE_STRING >(nh, name, s, key, force);
-        case ObjectDict::DEFTYPE_DOMAIN:         return create< std_msgs::String,  ObjectDict::DEFTYPE_DOMAIN         >(nh, name, s, key, force);
+        case ObjectDict::DEFTYPE_VISIBLE_STRING: return create< std_msgs::String,  ObjectDict::DEFTYPE_VISIBLE_STRING >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_OCTET_STRING:   return create< std_msgs::String,  ObjectDict::DEFTYPE_DOMAIN         >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_UNICODE_STRING: return create< std_msgs::String,  ObjectDict::DEFTYPE_UNICODE_STRING >(nh, name, s, key, force, on_change);
+        case ObjectDict::DEFTYPE_DOMAIN:         return create< std_msgs::String,  ObjectDict::DEFTYPE_DOMAIN         >(nh, name, s, key, force, on_change);
 
         default: return 0;
     }
@@ -70,10 +101,22 @@ void RosChain::logState(const can::State &s){
     ROS_INFO_STREAM("Current state: " << s.driver_state << " device error: " << s.error_code << " internal_error: " << s.internal_error << " (" << msg << ")");
 }
 
+void RosChain::traceFrame(const can::Frame &msg){
+    CANOPEN_TRACE_INSTANT("RX", msg.id);
+}
+
 void RosChain::run(){
     running_ = true;
-    time_point abs_time = boost::chrono::high_resolution_clock::now();
+    time_point last_start;
+    if(!sync_) loop_scheduler_->start(get_abs_time());
     while(running_){
+        time_point start = get_abs_time();
+        if(last_start != time_point()){
+            time_duration diff = (start - last_start) - update_duration_;
+            loop_period_jitter_.record(diff < time_duration::zero() ? -diff : diff);
+        }
+        last_start = start;
+
         LayerStatus s;
         try{
             read(s);
@@ -84,9 +127,12 @@ void RosChain::run(){
         catch(const canopen::Exception& e){
             ROS_ERROR_STREAM_THROTTLE(1, boost::diagnostic_information(e));
         }
+        time_duration cycle = get_abs_time() - start;
+        loop_cycle_.record(cycle);
+        if(cycle > update_duration_) ++loop_overruns_;
+
         if(!sync_){
-            abs_time += update_duration_;
-            boost::this_thread::sleep_until(abs_time);
+            loop_scheduler_->wait();
         }
     }
 }
@@ -150,6 +196,10 @@ bool RosChain::handle_init(std_srvs::Trigger::Request  &req, std_srvs::Trigger::
             res.message = status.reason();
         }else{
             heartbeat_timer_.restart();
+            std::stringstream sstr;
+            StartupProfiler::instance().write(sstr, std::bind(&RosChain::getNodeName, this, std::placeholders::_1));
+            if(!res.message.empty()) res.message += "\n";
+            res.message += sstr.str();
             return true;
         }
     }
@@ -172,6 +222,10 @@ bool RosChain::handle_recover(std_srvs::Trigger::Request  &req, std_srvs::Trigge
     TriggerResponseLogger rl(res, "Recovering");
     boost::mutex::scoped_lock lock(mutex_);
     res.success = false;
+    if(program_download_active()){
+        res.message = "program download is running";
+        return true;
+    }
 
     if(getLayerState() > Init){
         LayerReport status;
@@ -204,6 +258,14 @@ void RosChain::handleWrite(LayerStatus &status, const LayerState &current_state)
     LayerStack::handleWrite(status, current_state);
     if(current_state > Shutdown){
         for(const PublishFuncType& func: publishers_) func();
+        if(shm_export_){
+            try{
+                if(shm_export_->update()) write_shm_descriptor();
+            }
+            catch(const canopen::Exception &e){ // the image could not be remapped after a layout change
+                status.warn(std::string("process image export failed: ") + e.what());
+            }
+        }
     }
 }
 
@@ -219,9 +281,32 @@ void RosChain::handleShutdown(LayerStatus &status){
     }
 }
 
+void RosChain::handleHalt(LayerStatus &status){
+    LayerStack::handleHalt(status);
+    if(TraceRecorder::enabled()) dump_trace_async();
+}
+
+void RosChain::dump_trace_async(){
+    boost::mutex::scoped_lock lock(trace_dump_mutex_);
+    if(trace_dump_thread_.joinable() && !trace_dump_thread_.try_join_for(boost::chrono::milliseconds(0))){
+        ROS_WARN("Previous trace dump is still running, skipping this one");
+        return;
+    }
+    const std::string path = trace_path_;
+    trace_dump_thread_ = boost::thread([path](){ // file I/O must not delay the halt
+        if(TraceRecorder::dump(path)) ROS_INFO_STREAM("Wrote trace to " << path);
+        else ROS_ERROR_STREAM("Could not write trace to " << path);
+    });
+}
+
 bool RosChain::handle_shutdown(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
     TriggerResponseLogger rl(res, "Shutting down");
     boost::mutex::scoped_lock lock(mutex_);
+    if(program_download_active()){
+        res.success = false;
+        res.message = "program download is running";
+        return true;
+    }
     res.success = true;
     if(getLayerState() > Init){
         LayerStatus s;
@@ -304,6 +389,7 @@ bool RosChain::setup_bus(){
     }
 
     state_listener_ = interface_->createStateListenerM(this, &RosChain::logState);
+    if(TraceRecorder::enabled()) trace_listener_ = interface_->createMsgListenerM(this, &RosChain::traceFrame);
 
     if(bus_nh.getParam("master_type",master_alloc)){
         ROS_ERROR("please migrate to master allocators");
@@ -355,6 +441,16 @@ bool RosChain::setup_sync(){
         update_duration_ = boost::chrono::milliseconds(update_ms);
     }
 
+    try{
+        loop_scheduler_.reset(new PeriodicScheduler(update_duration_,
+                                                    boost::chrono::microseconds(nh_priv_.param("busy_wait_us", 0)),
+                                                    PeriodicScheduler::parsePolicy(nh_priv_.param("overrun_policy", std::string("skip")))));
+    }
+    catch(const std::invalid_argument &e){
+        ROS_ERROR_STREAM(e.what());
+        return false;
+    }
+
     if(sync_ms){
         if(!sync_nh.getParam("overflow", sync_overflow)){
             ROS_WARN("Sync overflow was not specified, so overflow is disabled per default");
@@ -367,8 +463,19 @@ bool RosChain::setup_sync(){
             ROS_WARN("silence_us is not supported anymore");
         }
 
+        if(nh_priv_.hasParam("overrun_policy")){ // the loop is paced by the sync layer
+            ROS_ERROR("overrun_policy has no effect if sync is enabled, use sync/overrun_policy instead");
+            return false;
+        }
+
         // TODO: parse header
-        sync_ = master_->getSync(SyncProperties(can::MsgHeader(0x80), sync_ms, sync_overflow));
+        try{
+            sync_ = master_->getSync(SyncProperties(can::MsgHeader(0x80), sync_ms, sync_overflow), *XmlRpcSettings::create(nh_priv_, "sync"));
+        }
+        catch(const canopen::Exception &e){
+            ROS_ERROR_STREAM("Could not create sync layer: " << e.what());
+            return false;
+        }
 
         if(!sync_ && sync_ms){
             ROS_ERROR_STREAM("Initializing sync master failed");
@@ -379,6 +486,44 @@ bool RosChain::setup_sync(){
     return true;
 }
 
+bool RosChain::setup_shm_export(){
+    ros::NodeHandle shm_nh(nh_priv_,"shm_export");
+    std::string name;
+    if(!shm_nh.getParam("name", name)) return true;
+
+    if(!sync_ || !sync_->getProcessImage()){
+        ROS_ERROR("shm_export needs a sync layer with process_image enabled");
+        return false;
+    }
+    std::string base = name;
+    base.erase(0, base.find_first_not_of('/')); // shm names usually start with '/'
+    shm_nh.param("descriptor", shm_descriptor_, "/tmp/" + base + ".yaml");
+    try{
+        shm_export_ = std::make_shared<SharedImageExport>(sync_->getProcessImage(), name);
+    }
+    catch(const canopen::Exception& e){
+        ROS_ERROR_STREAM("Could not export process image: " << e.what());
+        return false;
+    }
+    write_shm_descriptor();
+    return true;
+}
+
+void RosChain::write_shm_descriptor(){
+    std::map<uint8_t, std::string> names;
+    for(std::map<std::string, canopen::NodeSharedPtr>::const_iterator it = nodes_lookup_.begin(); it != nodes_lookup_.end(); ++it){
+        names[it->second->node_id_] = it->first;
+    }
+    std::string tmp = shm_descriptor_ + ".tmp";
+    {
+        std::ofstream file(tmp.c_str());
+        shm_export_->writeDescriptor(file, names);
+    }
+    if(rename(tmp.c_str(), shm_descriptor_.c_str()) != 0){ // readers never see a partial file
+        ROS_ERROR_STREAM_THROTTLE(10, "Could not write '" << shm_descriptor_ << "'");
+    }
+}
+
 bool RosChain::setup_heartbeat(){
         ros::NodeHandle hb_nh(nh_priv_,"heartbeat");
         std::string msg;
@@ -439,7 +584,12 @@ bool addLoggerEntries(XmlRpc::XmlRpcValue merged, const std::string param, uint8
 }
 
 bool RosChain::setup_nodes(){
-    nodes_.reset(new canopen::LayerGroupNoDiag<canopen::Node>("301 layer"));
+    int parallel_threads = nh_priv_.param("parallel_threads", -1);
+    if(parallel_threads >= 0){
+        nodes_.reset(new canopen::ParallelLayerGroup<canopen::Node>("301 layer", parallel_threads));
+    }else{
+        nodes_.reset(new canopen::LayerGroupNoDiag<canopen::Node>("301 layer"));
+    }
     add(nodes_);
 
     emcy_handlers_.reset(new canopen::LayerGroupNoDiag<canopen::EMCYHandler>("EMCY layer"));
@@ -524,12 +674,36 @@ bool RosChain::setup_node(const XmlRpc::XmlRpcValue& params, const std::string &
     catch(...){
     }
 
-    ObjectDictSharedPtr  dict = ObjectDict::fromFile(eds, overlay);
+    ObjectDictSharedPtr  dict;
+    {
+        StartupProfiler::Phase phase(node_id, "eds_parse");
+        dict = ObjectDict::fromFile(eds, overlay);
+    }
     if(!dict){
         ROS_ERROR_STREAM("EDS '" << eds << "' could not be parsed");
         return false;
     }
-    canopen::NodeSharedPtr node = std::make_shared<canopen::Node>(interface_, dict, node_id, sync_);
+    canopen::NodeSharedPtr node;
+    {
+        StartupProfiler::Phase phase(node_id, "object_storage");
+        node = std::make_shared<canopen::Node>(interface_, dict, node_id, sync_);
+    }
+
+    // additional SDO channels as [client COB-ID, server COB-ID], they are not written to the device:
+    // it has to serve them already with one of its server SDO parameters 0x1201..0x127F
+    if(merged.hasMember("sdo_channels")){
+        try{
+            XmlRpc::XmlRpcValue channels = merged["sdo_channels"];
+            for(int i = 0; i < channels.size(); ++i){
+                if(channels[i].size() != 2) throw std::invalid_argument("need two COB-IDs");
+                node->getSDOClient().addChannel(static_cast<int>(channels[i][0]), static_cast<int>(channels[i][1]));
+            }
+        }
+        catch(...){
+            ROS_ERROR_STREAM("Could not parse sdo_channels of node '" << name << "'");
+            return false;
+        }
+    }
 
     LoggerSharedPtr logger = std::make_shared<Logger>(node);
 
@@ -548,9 +722,12 @@ bool RosChain::setup_node(const XmlRpc::XmlRpcValue& params, const std::string &
         try{
             XmlRpc::XmlRpcValue objs = merged["publish"];
             for(int i = 0; i < objs.size(); ++i){
-                std::pair<std::string, bool> obj_name = parseObjectName(objs[i]);
+                std::string obj = objs[i];
+                const size_t change = obj.find('~'); // publish on changes only, e.g. "6041~"
+                if(change != std::string::npos) obj.erase(change, 1);
+                std::pair<std::string, bool> obj_name = parseObjectName(obj);
 
-                PublishFuncType pub = createPublishFunc(nh_, node_name +"_"+obj_name.first, node, obj_name.first, obj_name.second);
+                PublishFuncType pub = createPublishFunc(nh_, node_name +"_"+obj_name.first, node, obj_name.first, obj_name.second, change != std::string::npos);
                 if(!pub){
                     ROS_ERROR_STREAM("Could not create publisher for '" << obj_name.first << "'");
                     return false;
@@ -568,6 +745,7 @@ bool RosChain::setup_node(const XmlRpc::XmlRpcValue& params, const std::string &
 
     std::shared_ptr<canopen::EMCYHandler> emcy = std::make_shared<canopen::EMCYHandler>(interface_, node->getStorage());
     emcy_handlers_->add(emcy);
+    emcy_lookup_.insert(std::make_pair(node_name, emcy));
     logger->add(emcy);
 
     return true;
@@ -586,6 +764,13 @@ void RosChain::report_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &s
         stat.summary(stat.ERROR,"Thread is not running");
     }else{
         diag(r);
+        r.add("loop_overruns", loop_overruns_.load());
+        loop_cycle_.report(r, "loop_cycle");
+        loop_period_jitter_.report(r, "loop_period_jitter");
+        if(!sync_) loop_scheduler_->report(r, "loop_timer");
+        heartbeat_timer_.getLateness().report(r, "heartbeat_timer_lateness");
+        SDOAccessMonitor::instance().report(r);
+        TimerService::instance()->getLateness().report(r, "timer_service_lateness");
         if(r.bounded<LayerStatus::Unbounded>()){ // valid
             stat.summary(r.get(), r.reason());
             for(std::vector<std::pair<std::string, std::string> >::const_iterator it = r.values().begin(); it != r.values().end(); ++it){
@@ -595,11 +780,221 @@ void RosChain::report_diagnostics(diagnostic_updater::DiagnosticStatusWrapper &s
     }
 }
 
+void RosChain::report_layer_timing(diagnostic_updater::DiagnosticStatusWrapper &stat){
+    stat.summary(stat.OK, "[n/mean/p99/max us]");
+    LayerTiming::visit([&stat](const LayerTiming &t){ t.report(stat); });
+}
+
+bool RosChain::handle_get_layer_timing(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    if(!LayerTiming::enabled()){
+        res.success = false;
+        res.message = "compiled without CANOPEN_LAYER_TIMING";
+        return true;
+    }
+    std::stringstream sstr;
+    sstr << "layer: read | write | diag [n/mean/p99/max us]";
+    LayerTiming::visit([&sstr](const LayerTiming &t){
+        sstr << "\n" << t.label() << ": " << LayerTiming::summary(t.read) << " | " << LayerTiming::summary(t.write) << " | " << LayerTiming::summary(t.diag);
+    });
+    res.success = true;
+    res.message = sstr.str();
+    return true;
+}
+
+bool RosChain::handle_reset_layer_timing(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    LayerTiming::resetAll();
+    res.success = LayerTiming::enabled();
+    return true;
+}
+
+std::string RosChain::getNodeName(uint8_t node_id){
+    for(std::map<std::string, canopen::NodeSharedPtr>::const_iterator it = nodes_lookup_.begin(); it != nodes_lookup_.end(); ++it){
+        if(it->second->node_id_ == node_id) return it->first;
+    }
+    return "node_" + std::to_string(node_id);
+}
+
+void RosChain::report_startup(diagnostic_updater::DiagnosticStatusWrapper &stat){
+    LayerReport r;
+    StartupProfiler::instance().report(r, std::bind(&RosChain::getNodeName, this, std::placeholders::_1));
+    stat.summary(stat.OK, "slowest startup phases");
+    for(std::vector<std::pair<std::string, std::string> >::const_iterator it = r.values().begin(); it != r.values().end(); ++it){
+        stat.add(it->first, it->second);
+    }
+}
+
+bool RosChain::handle_get_startup_profile(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    std::stringstream sstr;
+    StartupProfiler::instance().write(sstr, std::bind(&RosChain::getNodeName, this, std::placeholders::_1));
+    res.success = true;
+    res.message = sstr.str();
+    return true;
+}
+
+bool RosChain::handle_dump_trace(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    if(!TraceRecorder::enabled()){
+        res.success = false;
+        res.message = "tracing is disabled";
+    }else if(TraceRecorder::dump(trace_path_)){
+        res.success = true;
+        res.message = trace_path_;
+    }else{
+        res.success = false;
+        res.message = "could not write " + trace_path_;
+    }
+    return true;
+}
+
+bool RosChain::handle_read_device_errors(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    if(getLayerState() <= Init){
+        res.success = false;
+        res.message = "not initialized";
+        return true;
+    }
+    std::stringstream sstr;
+    res.success = true;
+    for(std::map<std::string, std::shared_ptr<canopen::EMCYHandler> >::const_iterator it = emcy_lookup_.begin(); it != emcy_lookup_.end(); ++it){
+        LayerReport r;
+        try{
+            it->second->readDeviceErrors(r);
+        }
+        catch(const std::exception &e){
+            r.error(boost::diagnostic_information(e));
+        }
+        if(it != emcy_lookup_.begin()) sstr << "\n";
+        sstr << it->first << ": " << (r.reason().empty() ? "no errors" : r.reason());
+        for(std::vector<std::pair<std::string, std::string> >::const_iterator v = r.values().begin(); v != r.values().end(); ++v){
+            sstr << ", " << v->first << "=" << v->second;
+        }
+        if(!r.bounded<LayerStatus::Warn>()) res.success = false;
+    }
+    res.message = sstr.str();
+    return true;
+}
+
+bool RosChain::handle_program_download(canopen_chain_node::ProgramDownload::Request  &req, canopen_chain_node::ProgramDownload::Response &res){
+    ResponseLogger<canopen_chain_node::ProgramDownload::Response> rl(res, "Program download");
+    boost::mutex::scoped_lock lock(mutex_);
+    if(getLayerState() <= Init){
+        res.message = "not initialized";
+        return true;
+    }
+    if(getLayerState() != Error){ // halt() leaves the chain in Error
+        res.message = "chain is running, call halt first";
+        return true;
+    }
+    std::vector<canopen::NodeSharedPtr> nodes;
+    for(const std::string &name: req.nodes){
+        std::map<std::string, canopen::NodeSharedPtr >::iterator it = nodes_lookup_.find(name);
+        if(it == nodes_lookup_.end()){
+            res.message = "node not found: " + name;
+            return true;
+        }
+        nodes.push_back(it->second);
+    }
+    if(nodes.empty()){
+        res.message = "no nodes given";
+        return true;
+    }
+
+    if(req.program == 255){
+        res.message = "program number must be 1..254";
+        return true;
+    }
+    ProgramDownload::Options options;
+    if(req.program) options.program = req.program;
+    options.identification = req.identification;
+    options.start = !req.no_start;
+
+    boost::mutex::scoped_lock download_lock(program_download_mutex_);
+    if(program_download_running_){
+        res.message = "a program download is already running";
+        return true;
+    }
+    if(program_download_thread_.joinable()) program_download_thread_.join();
+    program_download_running_ = true;
+    program_download_success_ = false;
+    program_download_status_.assign(req.nodes.size(), std::string());
+    for(size_t i = 0; i < req.nodes.size(); ++i) program_download_status_[i] = req.nodes[i] + ": waiting";
+    program_download_thread_ = boost::thread(&RosChain::run_program_download, this, nodes, req.nodes, req.file, options);
+
+    res.success = true;
+    res.message = "started, see program_download_status";
+    return true;
+}
+
+void RosChain::run_program_download(const std::vector<canopen::NodeSharedPtr> &nodes, const std::vector<std::string> &names,
+                                    const std::string &file, const ProgramDownload::Options &options){
+    // every node in its own thread, each reads the file on its own
+    std::vector<char> success(nodes.size(), false); // not vector<bool>, it is written concurrently
+    boost::thread_group threads;
+    for(size_t i = 0; i < nodes.size(); ++i){
+        threads.create_thread([&, i](){
+            const std::string &name = names[i];
+            size_t next_report = 0;
+            ProgramDownload::ProgressFunc progress = [&, i](size_t done, size_t total, double rate){
+                std::stringstream sstr;
+                sstr << name << ": " << done << "/" << total << " bytes, " << rate / 1000 << " kB/s";
+                {
+                    boost::mutex::scoped_lock lock(program_download_mutex_);
+                    program_download_status_[i] = sstr.str();
+                }
+                if(done * 10 >= next_report * total){ // every 10%
+                    ROS_INFO_STREAM("Program download " << sstr.str());
+                    next_report = done * 10 / total + 1;
+                }
+            };
+            std::string message;
+            try{
+                ProgramDownload::Result r = ProgramDownload(nodes[i]->getSDOClient(), options).runFile(file, progress);
+                std::stringstream sstr;
+                sstr << name << ": " << r.bytes << " bytes in " << r.seconds << " s (" << r.bytesPerSecond() / 1000 << " kB/s)"
+                     << ", identification 0x" << std::hex << r.identification;
+                message = sstr.str();
+                success[i] = true;
+            }
+            catch(const std::exception &e){
+                message = name + ": " + e.what();
+                ROS_ERROR_STREAM("Program download " << message);
+            }
+            boost::mutex::scoped_lock lock(program_download_mutex_);
+            program_download_status_[i] = message;
+        });
+    }
+    threads.join_all();
+
+    boost::mutex::scoped_lock lock(program_download_mutex_);
+    program_download_success_ = std::find(success.begin(), success.end(), false) == success.end();
+    program_download_running_ = false;
+    if(program_download_success_) ROS_INFO("Program download successful");
+    else ROS_ERROR("Program download failed");
+}
+
+bool RosChain::program_download_active(){
+    boost::mutex::scoped_lock lock(program_download_mutex_);
+    return program_download_running_;
+}
+
+bool RosChain::handle_program_download_status(std_srvs::Trigger::Request  &req, std_srvs::Trigger::Response &res){
+    boost::mutex::scoped_lock lock(program_download_mutex_);
+    if(program_download_status_.empty()){
+        res.success = false;
+        res.message = "no program download was started";
+        return true;
+    }
+    res.success = !program_download_running_ && program_download_success_;
+    res.message = program_download_running_ ? "running" : (program_download_success_ ? "done" : "failed");
+    for(const std::string &m: program_download_status_) res.message += "\n" + m;
+    return true;
+}
+
 RosChain::RosChain(const ros::NodeHandle &nh, const ros::NodeHandle &nh_priv)
 : LayerStack("ROS stack"),driver_loader_("socketcan_interface", "can::DriverInterface"),
   master_allocator_("canopen_master", "canopen::Master::Allocator"),
+  program_download_running_(false), program_download_success_(false),
   nh_(nh), nh_priv_(nh_priv),
   diag_updater_(nh_,nh_priv_),
+  loop_overruns_(0),
   running_(false),
   reset_errors_before_recover_(false){}
 
@@ -615,6 +1010,17 @@ bool RosChain::setup_chain(){
     nh_priv_.param("hardware_id", hw_id, std::string("none"));
     nh_priv_.param("reset_errors_before_recover", reset_errors_before_recover_, false);
 
+    try{
+        SDOAccessMonitor::instance().setPolicy(SDOAccessMonitor::parsePolicy(nh_priv_.param("cyclic_sdo_policy", std::string("warn"))));
+    }
+    catch(const std::invalid_argument &e){
+        ROS_ERROR_STREAM(e.what());
+        return false;
+    }
+
+    TraceRecorder::setEnabled(nh_priv_.param("trace/enabled", false));
+    nh_priv_.param("trace/path", trace_path_, std::string("/tmp/canopen_trace.json"));
+
     diag_updater_.setHardwareID(hw_id);
     diag_updater_.add("chain", this, &RosChain::report_diagnostics);
 
@@ -630,15 +1036,28 @@ bool RosChain::setup_chain(){
     srv_get_object_ = nh_driver.advertiseService("get_object",&RosChain::handle_get_object, this);
     srv_set_object_ = nh_driver.advertiseService("set_object",&RosChain::handle_set_object, this);
 
-    return setup_bus() && setup_sync() && setup_heartbeat() && setup_nodes();
+    srv_get_layer_timing_ = nh_driver.advertiseService("get_layer_timing",&RosChain::handle_get_layer_timing, this);
+    srv_reset_layer_timing_ = nh_driver.advertiseService("reset_layer_timing",&RosChain::handle_reset_layer_timing, this);
+    srv_dump_trace_ = nh_driver.advertiseService("dump_trace",&RosChain::handle_dump_trace, this);
+    srv_get_startup_profile_ = nh_driver.advertiseService("get_startup_profile",&RosChain::handle_get_startup_profile, this);
+    srv_program_download_ = nh_driver.advertiseService("program_download",&RosChain::handle_program_download, this);
+    srv_program_download_status_ = nh_driver.advertiseService("program_download_status",&RosChain::handle_program_download_status, this);
+    srv_read_device_errors_ = nh_driver.advertiseService("read_device_errors",&RosChain::handle_read_device_errors, this);
+    diag_updater_.add("startup", this, &RosChain::report_startup);
+    if(LayerTiming::enabled()) diag_updater_.add("layer timing", this, &RosChain::report_layer_timing);
+
+    return setup_bus() && setup_sync() && setup_heartbeat() && setup_nodes() && setup_shm_export();
 }
 
 RosChain::~RosChain(){
+    if(program_download_thread_.joinable()) program_download_thread_.join(); // the nodes must stay up
     try{
         LayerStatus s;
         halt(s);
         shutdown(s);
     }catch(...){ ROS_ERROR("CATCH"); }
+    boost::mutex::scoped_lock lock(trace_dump_mutex_);
+    if(trace_dump_thread_.joinable()) trace_dump_thread_.join();
 }
 
 }
@@ -7,8 +7,11 @@
 #include "exceptions.h"
 #include "layer.h"
 #include "objdict.h"
+#include "emcy_history.h"
+#include "process_image.h"
 #include "timer.h"
 #include <stdexcept>
+#include <map>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/chrono/system_clocks.hpp>
 #include <boost/lexical_cast.hpp>
@@ -30,23 +33,92 @@ template<typename T> struct FrameOverlay: public can::Frame{
 };
 
 class SDOClient{
+public:
+    /// consumes the next chunk of an upload, returns false to abort the transfer
+    typedef std::function<bool(const uint8_t *data, size_t size)> DomainSink;
+    /// fills up to size bytes of a download, returns the number of bytes written
+    typedef std::function<size_t(uint8_t *data, size_t size)> DomainSource;
+    /// bytes transferred and total size, 0 if unknown
+    typedef std::function<void(size_t done, size_t total)> ProgressFunc;
+
+    /// block transfer settings of a single streaming transfer, they replace the ones of setBlockTransfer.
+    /// A server that rejects block mode only makes this transfer fall back to segmented mode.
+    struct BlockOptions{
+        size_t threshold; ///< minimum download size, 0 disables block transfers
+        uint8_t size;     ///< segments per sub-block, 1..127
+        explicit BlockOptions(size_t threshold, uint8_t size = 127);
+    };
 
-    can::Header client_id;
-
-    boost::timed_mutex mutex;
-
-    can::BufferedReader reader_;
-    bool processFrame(const can::Frame & msg);
-
-    String buffer;
-    size_t offset;
-    size_t total;
-    bool done;
-    can::Frame last_msg;
-    const canopen::ObjectDict::Entry * current_entry;
-
-    void transmitAndWait(const canopen::ObjectDict::Entry &entry, const String &data, String *result);
-    void abort(uint32_t reason);
+private:
+    /// one client/server COB-ID pair, runs one transfer at a time
+    class Channel{
+        SDOClient &client_;
+        can::Header client_id;
+
+        can::BufferedReader reader_;
+        bool processFrame(const can::Frame & msg);
+
+        String buffer;
+        size_t offset;
+        size_t total;
+        bool done;
+        can::Frame last_msg;
+        const canopen::ObjectDict::Entry * current_entry;
+
+        enum BlockState { NoBlock, BlockDownloadInit, BlockDownloadSub, BlockDownloadEnd, BlockUploadInit, BlockUpload, BlockUploadEnd };
+        BlockState block_state_;
+        uint8_t block_seq_; ///< last sequence number sent or accepted in the current sub-block
+        uint8_t block_ack_size_;
+        size_t block_start_;
+        bool block_crc_;
+        uint32_t server_abort_;
+
+        bool processBlockFrame(const can::Frame & msg);
+        bool sendDownloadBlock();
+        bool useBlockTransfer(const canopen::ObjectDict::Entry &entry, size_t size, bool upload);
+
+        // streaming: buffer only holds a window of the data, starting at buffer_base_
+        DomainSink sink_;
+        DomainSource source_;
+        ProgressFunc progress_;
+        const BlockOptions *block_options_; ///< 0 uses the settings of the client
+        bool segmented_only_; ///< set while retrying a rejected block transfer
+        size_t stream_size_;
+        size_t buffer_base_;
+        uint16_t crc_; ///< CRC of the data before buffer_base_
+
+        bool fillBuffer(size_t n);
+        bool flushBuffer(bool all);
+        void trimBuffer();
+        bool sendDownloadSegment(bool toggle);
+
+        void abort(uint32_t reason);
+    public:
+        Channel(SDOClient &client);
+        void init(const can::Header &client_header, const can::Header &server_header);
+        /// sets the callbacks for the next transfers, empty functions restore buffered transfers
+        void setStream(const DomainSink &sink, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions *block);
+        void transmitAndWait(const canopen::ObjectDict::Entry &entry, const String &data, String *result);
+    };
+    typedef std::shared_ptr<Channel> ChannelSharedPtr;
+
+    // the channels are scheduled on each request, expedited transfers are preferred
+    boost::mutex channels_mutex_;
+    boost::condition_variable channels_cond_;
+    std::vector<ChannelSharedPtr> channels_;
+    std::vector<char> busy_;
+    size_t expedited_waiting_;
+    std::vector<std::pair<uint32_t, uint32_t> > extra_ids_;
+
+    struct ChannelLock;
+    struct StreamScope;
+    static bool isExpedited(const canopen::ObjectDict::Entry &entry, const String &data, bool upload);
+    void upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress, const BlockOptions *block);
+    void download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions *block);
+
+    std::atomic<size_t> block_threshold_;
+    std::atomic<uint8_t> block_size_;
+    std::atomic<bool> block_supported_;
 
     const can::CommInterfaceSharedPtr interface_;
 protected:
@@ -55,94 +127,232 @@ protected:
 public:
     const ObjectStorageSharedPtr storage_;
 
+    /// (re)creates the channels: 0x1200 of the node, the additional server SDOs 0x1201..0x127F,
+    /// client SDOs 0x1280..0x12FF that address this node and the ones added with addChannel.
+    /// Waits for running transfers to finish.
     void init();
 
+    /// adds a channel with the given COB-IDs like 0x1200 sub 1 and 2, takes effect with the next init().
+    /// The device is not configured, one of its server SDO parameters 0x1201..0x127F must already use these COB-IDs,
+    /// e.g. by its defaults or by the concise DCF. Otherwise transfers on this channel run into timeouts.
+    void addChannel(uint32_t client_cob_id, uint32_t server_cob_id);
+    size_t getChannelCount();
+
+    /// enables block transfers for downloads of at least threshold bytes and for all uploads of string and domain objects,
+    /// 0 disables them (default). Falls back to segmented transfers if the server does not support block mode.
+    void setBlockTransfer(size_t threshold, uint8_t block_size = 127);
+    size_t getBlockThreshold() const { return block_threshold_; }
+    uint8_t getBlockSize() const { return block_size_; }
+
+    /// CRC-16-CCITT as used by SDO block transfers
+    static uint16_t crc(const uint8_t *data, size_t size, uint16_t crc = 0);
+
+    /// reads an object chunk by chunk without holding it in memory, uses block transfer if enabled.
+    /// Throws like ObjectStorage::Entry::get, the sink might have received partial data.
+    void upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress = ProgressFunc());
+    /// writes size bytes from source to an object chunk by chunk, uses block transfer if enabled
+    void download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress = ProgressFunc());
+    /// streaming transfers with their own block transfer settings, the settings of the client stay untouched
+    void upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress, const BlockOptions &block);
+    void download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions &block);
+
     SDOClient(const can::CommInterfaceSharedPtr interface, const ObjectDictSharedPtr dict, uint8_t node_id)
-    : interface_(interface),
+    : expedited_waiting_(0), block_threshold_(0), block_size_(127), block_supported_(true),
+      interface_(interface),
       storage_(std::make_shared<ObjectStorage>(dict, node_id,
                                                std::bind(&SDOClient::read, this, std::placeholders::_1, std::placeholders::_2),
                                                std::bind(&SDOClient::write, this, std::placeholders::_1, std::placeholders::_2))
-              ),
-      reader_(false, 1)
+              )
     {
     }
 };
 
+/// counts the synchronous RPDOs that arrived after the last SYNC, so the read phase can start as soon as all of them are in
+/// and tracks when the last of them arrived. Only RPDOs with transmission type 1 take part, others are not expected in every cycle.
+class RPDOBarrier{
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    size_t expected_;
+    size_t arrived_;
+    uint32_t generation_;
+    time_point sync_time_;
+    time_point last_arrival_;
+    time_duration previous_latency_;
+    bool previous_valid_;
+    uint64_t late_;
+public:
+    RPDOBarrier() : expected_(0), arrived_(0), generation_(1), previous_valid_(false), late_(0) {}
+    void add(size_t n);
+    void remove(size_t n);
+    void reset(); ///< call on SYNC, before any RPDO of this cycle can arrive
+    /// generation is tracked per RPDO, arrival is the reception time of the frame; frames received before the SYNC of
+    /// the current cycle and repeated frames within a cycle are counted as late instead of being credited to it
+    void arrive(uint32_t &generation, const time_point &arrival);
+    bool waitUntil(const time_point &abs_time); ///< true if all expected RPDOs have arrived
+    size_t getExpected();
+    uint64_t getLate(); ///< frames that arrived after the SYNC of the following cycle
+    /// arrival of the last RPDO relative to the SYNC of the previous cycle, false if that cycle was not complete
+    bool getPreviousLatency(time_duration &latency);
+};
+typedef std::shared_ptr<RPDOBarrier> RPDOBarrierSharedPtr;
+
 class PDOMapper{
     boost::mutex mutex_;
 
     class Buffer{
     public:
         bool read(uint8_t* b, const size_t len);
-        void write(const uint8_t* b, const size_t len);
+        bool write(const uint8_t* b, const size_t len); ///< true if the value has changed
         void read(const canopen::ObjectDict::Entry &entry, String &data);
         void write(const canopen::ObjectDict::Entry &, const String &data);
         void clean() { dirty = false; }
+        void attach(const ProcessImageSharedPtr &image, size_t offset) { image_ = image; image_offset_ = offset; }
+        void attach(const ObjectStorage::ChangeNotifier &notifier) { notifier_ = notifier; }
+        const ObjectStorage::ChangeNotifier& notifier() const { return notifier_; }
+        /// notifies the subscribers once the value is visible, with a process image that is after its next swap
+        void notifyChanged();
         const size_t size;
-        Buffer(const size_t sz) : size(sz), dirty(false), empty(true), buffer(sz) {}
+        Buffer(const size_t sz) : size(sz), dirty(false), empty(true), buffer(sz), image_offset_(0) {}
 
     private:
         boost::mutex mutex;
         bool dirty;
         bool empty;
         std::vector<char> buffer;
+        ProcessImageSharedPtr image_;
+        size_t image_offset_;
+        ObjectStorage::ChangeNotifier notifier_;
     };
     typedef std::shared_ptr<Buffer> BufferSharedPtr;
 
+public:
+    typedef std::vector<uint32_t> Mapping; ///< mapping entries like 0x60400010
+    /// mappings by mapping index of the device, 0x1600.. for its RPDOs and 0x1A00.. for its TPDOs; an empty mapping disables the PDO
+    typedef std::map<uint16_t, Mapping> MappingSet;
+
+    /// reception statistics of an RPDO, counted since its (re)mapping
+    struct RPDOStatistics{
+        uint16_t map_index;         ///< mapping index of the device TPDO, 0x1A00..
+        can::Header header;
+        uint8_t transmission_type;
+        uint64_t received;
+        time_point last_arrival;    ///< only valid if received > 0
+        time_duration period;       ///< smoothed inter-arrival time, not tracked for MPDOs
+        time_duration jitter;       ///< smoothed deviation of the inter-arrival time from the period, as in RFC 3550
+        uint64_t missed_syncs;      ///< periods of the transmission type without the cyclic RPDO since the first arrival, not tracked for MPDOs
+        uint64_t dlc_mismatches;    ///< frames that did not match the length of the mapping, shorter ones are dropped
+        RPDOStatistics() : map_index(0), transmission_type(0), received(0), period(0), jitter(0), missed_syncs(0), dlc_mismatches(0) {}
+        time_duration age(const time_point &now) const { return received ? now - last_arrival : time_duration::max(); }
+    };
+
+private:
     class PDO {
     protected:
-        void parse_and_set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const bool &read, const bool &write);
+        PDO() : transmission_type(0), mpdo(0), node_id(0), map_index_(0) {}
+        void parse_and_set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const bool &read, const bool &write, const ProcessImageSharedPtr &image = ProcessImageSharedPtr());
+        /// writes only the entries that differ from current, all if current is unknown
+        void set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping &mapping, const Mapping *current, const bool &read, const bool &write, const ProcessImageSharedPtr &image = ProcessImageSharedPtr());
+        BufferSharedPtr map_object(const ObjectStorageSharedPtr &storage, uint32_t mapping, const bool &read, const bool &write, const ProcessImageSharedPtr &image);
         can::Frame frame;
         uint8_t transmission_type;
         std::vector<BufferSharedPtr>buffers;
+        std::vector<uint32_t> objects; ///< mapping value of each buffer
+
+        // multiplexed PDO: one object per frame, addressed by index and sub-index
+        uint8_t mpdo; ///< 0xFE for source address mode, 0xFF for destination address mode, 0 otherwise
+        uint8_t node_id;
+        uint16_t map_index_;
+    public:
+        const Mapping& getObjects() const { return objects; }
+        uint16_t getMapIndex() const { return map_index_; }
+        /// restores the SDO access of the mapped objects
+        void unmap(const ObjectStorageSharedPtr &storage);
     };
 
     struct TPDO: public PDO{
         typedef std::shared_ptr<TPDO> TPDOSharedPtr;
         void sync();
-        static TPDOSharedPtr create(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index){
+        static TPDOSharedPtr create(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index,
+                                    const Mapping *mapping = 0, const Mapping *current = 0){
             TPDOSharedPtr tpdo(new TPDO(interface));
-            if(!tpdo->init(storage, com_index, map_index))
+            if(!tpdo->init(storage, com_index, map_index, mapping, current))
                 tpdo.reset();
             return tpdo;
         }
     private:
         TPDO(const can::CommInterfaceSharedPtr interface) : interface_(interface){}
-        bool init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index);
+        bool init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping *mapping, const Mapping *current);
         const can::CommInterfaceSharedPtr interface_;
         boost::mutex mutex;
     };
 
     struct RPDO : public PDO{
         void sync(LayerStatus &status);
+        void flush(); ///< notifies the coalescing subscribers of changed objects
+        /// expected once per SYNC, so it takes part in the barrier.
+        /// SAM-MPDOs are not, the producer sends one frame per changed object.
+        bool isSynchronous() const { return transmission_type == 1 && !mpdo; }
         typedef std::shared_ptr<RPDO> RPDOSharedPtr;
-        static RPDOSharedPtr create(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index){
-            RPDOSharedPtr rpdo(new RPDO(interface));
-            if(!rpdo->init(storage, com_index, map_index))
+        static RPDOSharedPtr create(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const RPDOBarrierSharedPtr &barrier, const ProcessImageSharedPtr &image,
+                                    const Mapping *mapping = 0, const Mapping *current = 0){
+            RPDOSharedPtr rpdo(new RPDO(interface, barrier, image));
+            if(!rpdo->init(storage, com_index, map_index, mapping, current))
                 rpdo.reset();
             return rpdo;
         }
     private:
-        bool init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index);
-        RPDO(const can::CommInterfaceSharedPtr interface) : interface_(interface), timeout(-1) {}
+        bool init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping *mapping, const Mapping *current);
+        RPDO(const can::CommInterfaceSharedPtr interface, const RPDOBarrierSharedPtr &barrier, const ProcessImageSharedPtr &image)
+        : interface_(interface), barrier_(barrier), barrier_generation_(0), image_(image), timeout(-1), syncs_(0) {}
         boost::mutex mutex;
         const can::CommInterfaceSharedPtr interface_;
+        const RPDOBarrierSharedPtr barrier_;
+        uint32_t barrier_generation_;
+        const ProcessImageSharedPtr image_;
 
         can::FrameListenerConstSharedPtr listener_;
         void handleFrame(const can::Frame & msg);
         int timeout;
+        unsigned int syncs_; ///< SYNCs since the last arrival
+        RPDOStatistics stats_;
+    public:
+        RPDOStatistics getStatistics();
     };
 
     std::unordered_set<RPDO::RPDOSharedPtr> rpdos_;
     std::unordered_set<TPDO::TPDOSharedPtr> tpdos_;
+    std::unordered_set<uint16_t> disabled_; ///< map indexes disabled by remap
 
     const can::CommInterfaceSharedPtr interface_;
 
+    const RPDOBarrierSharedPtr barrier_;
+    size_t barrier_rpdos_;
+    bool barrier_joined_;
+
+    const ProcessImageSharedPtr image_;
+
+    void setBarrierRPDOs(size_t n);
+    void updateBarrierRPDOs(); ///< counts the synchronous RPDOs, needs the lock
+
+    boost::mutex remap_mutex_; ///< serializes remap, which does not hold mutex_ during the SDO transfers
+    struct Remapping;
+    void build(const ObjectStorageSharedPtr &storage, Remapping &r, const Mapping &mapping, const Mapping *current);
+
 public:
-    PDOMapper(const can::CommInterfaceSharedPtr interface);
+    PDOMapper(const can::CommInterfaceSharedPtr interface, const RPDOBarrierSharedPtr &barrier = RPDOBarrierSharedPtr(), const ProcessImageSharedPtr &image = ProcessImageSharedPtr());
+    /// checks the RPDO timeouts and runs the coalescing change listeners, which must not call back into the mapper
     void read(LayerStatus &status);
     bool write();
     bool init(const ObjectStorageSharedPtr storage, LayerStatus &status);
+    void joinBarrier(bool join); ///< (un)registers the synchronous RPDOs at the barrier, if there is any
+    /// switches the PDOs of the set to the given mappings while the other PDOs keep running. Unchanged PDOs are skipped,
+    /// changed ones are disabled, only the differing entries are written and the objects are rebound to the new buffers.
+    /// The SDO transfers run without the PDO lock, the new PDOs are added once all of them are configured.
+    /// On failure the previous mappings are restored, PDOs that cannot be restored stay disabled and are reported.
+    bool remap(const ObjectStorageSharedPtr storage, const MappingSet &mappings, LayerStatus &status);
+    std::vector<RPDOStatistics> getRPDOStatistics(); ///< sorted by mapping index
+    /// age of the least recent RPDO data, time_duration::max() if an RPDO was not received yet, zero without RPDOs
+    time_duration getRPDOAge();
 };
 
 class EMCYHandler : public Layer {
@@ -153,6 +363,11 @@ class EMCYHandler : public Layer {
     void handleEMCY(const can::Frame & msg);
     const ObjectStorageSharedPtr storage_;
 
+    EMCYHistory history_;
+    std::atomic<int> cached_register_; ///< last known error register, -1 if unknown
+    std::atomic<uint64_t> reset_index_; ///< history index at the last error reset
+    bool readErrorRegister(uint8_t &error_register);
+
     virtual void handleDiag(LayerReport &report);
 
     virtual void handleInit(LayerStatus &status);
@@ -165,6 +380,10 @@ class EMCYHandler : public Layer {
 public:
     EMCYHandler(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr storage);
     void resetErrors(LayerStatus &status);
+
+    const EMCYHistory& getHistory() const { return history_; }
+    /// reads the error register and the pre-defined error field (0x1003) from the device via SDO
+    void readDeviceErrors(LayerReport &report);
 };
 
 struct SyncProperties{
@@ -182,6 +401,8 @@ public:
     SyncCounter(const SyncProperties &p) : properties(p) {}
     virtual void addNode(void * const ptr)  = 0;
     virtual  void removeNode(void * const ptr) = 0;
+    virtual RPDOBarrierSharedPtr getRPDOBarrier() { return RPDOBarrierSharedPtr(); }
+    virtual ProcessImageSharedPtr getProcessImage() { return ProcessImageSharedPtr(); }
     virtual ~SyncCounter() {}
 };
 typedef std::shared_ptr<SyncCounter> SyncCounterSharedPtr;
@@ -198,6 +419,8 @@ public:
     void enterState(const State &s);
 
     const ObjectStorageSharedPtr getStorage() { return sdo_.storage_; }
+    /// for streaming transfers and block transfer settings
+    SDOClient& getSDOClient() { return sdo_; }
 
     bool start();
     bool stop();
@@ -205,6 +428,12 @@ public:
     bool reset_com();
     bool prepare();
 
+    /// switches PDO mappings at runtime, e.g. per mode of operation, see PDOMapper::remap
+    bool remapPDOs(const PDOMapper::MappingSet &mappings, LayerStatus &status);
+    std::vector<PDOMapper::RPDOStatistics> getRPDOStatistics() { return pdo_.getRPDOStatistics(); }
+    /// data freshness for controllers, see PDOMapper::getRPDOAge
+    time_duration getRPDOAge() { return pdo_.getRPDOAge(); }
+
     using StateFunc = std::function<void(const State&)>;
     using StateDelegate [[deprecated("use StateFunc instead")]] = can::DelegateHelper<StateFunc>;
 
@@ -302,6 +531,8 @@ public:
     void prepare() { this->call(&T::prepare); }
 };
 
+using can::Settings;
+
 class SyncLayer: public Layer, public SyncCounter{
 public:
     SyncLayer(const SyncProperties &p) : Layer("Sync layer"), SyncCounter(p) {}
@@ -314,6 +545,7 @@ class Master{
 public:
     Master() = default;
     virtual SyncLayerSharedPtr getSync(const SyncProperties &properties) = 0;
+    virtual SyncLayerSharedPtr getSync(const SyncProperties &properties, const Settings &settings) { return getSync(properties); }
     virtual ~Master() {}
 
     typedef std::shared_ptr<Master> MasterSharedPtr;
@@ -325,7 +557,5 @@ public:
 };
 typedef Master::MasterSharedPtr MasterSharedPtr;
 
-using can::Settings;
-
 } // canopen
 #endif // !H_CANOPEN
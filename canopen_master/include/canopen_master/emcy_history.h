@@ -0,0 +1,70 @@
+#ifndef H_CANOPEN_EMCY_HISTORY
+#define H_CANOPEN_EMCY_HISTORY
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <boost/chrono/system_clocks.hpp>
+
+namespace canopen{
+
+/// ring of the last received EMCY messages, one writer (the receive thread), lock-free readers
+class EMCYHistory{
+public:
+    struct Entry{
+        uint16_t error_code;
+        uint8_t error_register;
+        uint8_t manufacturer_specific[5];
+        boost::chrono::high_resolution_clock::time_point time;
+        uint64_t index; ///< running number of the message
+    };
+
+    EMCYHistory(size_t capacity = 16) : slots_(capacity), head_(0) {}
+
+    void push(uint16_t error_code, uint8_t error_register, const uint8_t *manufacturer_specific){
+        uint64_t index = head_.load(std::memory_order_relaxed);
+        Slot &slot = slots_[index % slots_.size()];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.entry.error_code = error_code;
+        slot.entry.error_register = error_register;
+        memcpy(slot.entry.manufacturer_specific, manufacturer_specific, sizeof(slot.entry.manufacturer_specific));
+        slot.entry.time = boost::chrono::high_resolution_clock::now();
+        slot.entry.index = index;
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        head_.store(index + 1, std::memory_order_release);
+    }
+
+    /// number of messages received so far
+    uint64_t count() const { return head_.load(std::memory_order_acquire); }
+
+    /// copies all retained entries with an index >= from, oldest first; entries overwritten during the copy are skipped
+    std::vector<Entry> get(uint64_t from = 0) const {
+        std::vector<Entry> res;
+        uint64_t head = count();
+        uint64_t first = head > slots_.size() ? head - slots_.size() : 0;
+        for(uint64_t i = std::max(first, from); i < head; ++i){
+            const Slot &slot = slots_[i % slots_.size()];
+            if(slot.sequence.load(std::memory_order_acquire) != 2 * i + 2) continue;
+            Entry e = slot.entry;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence.load(std::memory_order_relaxed) == 2 * i + 2) res.push_back(e);
+        }
+        return res;
+    }
+
+private:
+    struct Slot{
+        std::atomic<uint64_t> sequence;
+        Entry entry;
+        Slot() : sequence(0) {}
+    };
+    std::vector<Slot> slots_;
+    std::atomic<uint64_t> head_;
+};
+
+} // namespace canopen
+
+#endif
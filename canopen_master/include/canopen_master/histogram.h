@@ -0,0 +1,114 @@
+#ifndef H_CANOPEN_HISTOGRAM
+#define H_CANOPEN_HISTOGRAM
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <boost/chrono/duration.hpp>
+
+namespace canopen{
+
+/// lock-free log-linear histogram for durations in nanoseconds, records can be done from any thread
+class Histogram{
+public:
+    static const size_t SUB_BITS = 2; ///< four sub-buckets per power of two
+    static const size_t SUB_COUNT = 1 << SUB_BITS;
+    static const size_t NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    Histogram() { reset(); }
+
+    void record(int64_t ns){
+        if(ns < 0) ns = 0;
+        buckets_[index(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+
+        int64_t cur = min_.load(std::memory_order_relaxed);
+        while(ns < cur && !min_.compare_exchange_weak(cur, ns, std::memory_order_relaxed)) {}
+        cur = max_.load(std::memory_order_relaxed);
+        while(ns > cur && !max_.compare_exchange_weak(cur, ns, std::memory_order_relaxed)) {}
+    }
+    template<typename Rep, typename Period> void record(const boost::chrono::duration<Rep, Period> &d){
+        record(boost::chrono::duration_cast<boost::chrono::nanoseconds>(d).count());
+    }
+
+    void reset(){
+        for(size_t i = 0; i < NUM_BUCKETS; ++i) buckets_[i].store(0, std::memory_order_relaxed);
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    int64_t min() const { return count() ? min_.load(std::memory_order_relaxed) : 0; }
+    int64_t max() const { return max_.load(std::memory_order_relaxed); }
+    int64_t mean() const { uint64_t c = count(); return c ? sum_.load(std::memory_order_relaxed) / c : 0; }
+
+    /// upper bound of the bucket that holds the given quantile (0..1)
+    int64_t percentile(double q) const {
+        uint64_t c = count();
+        if(!c) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * c);
+        if(rank >= c) rank = c - 1;
+        uint64_t seen = 0;
+        for(size_t i = 0; i < NUM_BUCKETS; ++i){
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if(seen > rank) return std::min(upper(i), max());
+        }
+        return max();
+    }
+
+    /// adds summary in microseconds and the non-empty buckets as "upper_bound:count" list
+    template<typename Report> void report(Report &report, const std::string &prefix) const {
+        report.add(prefix + "_count", count());
+        if(!count()) return;
+        report.add(prefix + "_min_us", min() / 1000.0);
+        report.add(prefix + "_mean_us", mean() / 1000.0);
+        report.add(prefix + "_p99_us", percentile(0.99) / 1000.0);
+        report.add(prefix + "_max_us", max() / 1000.0);
+        report.add(prefix + "_histogram_us", buckets());
+    }
+
+    std::string buckets() const {
+        std::stringstream sstr;
+        for(size_t i = 0; i < NUM_BUCKETS; ++i){
+            uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+            if(n){
+                if(sstr.tellp() > 0) sstr << " ";
+                sstr << "<" << upper(i) / 1000.0 << ":" << n;
+            }
+        }
+        return sstr.str();
+    }
+
+private:
+    static size_t index(uint64_t v){
+        if(v < SUB_COUNT) return v;
+        size_t e = 63 - __builtin_clzll(v);
+        return (e - SUB_BITS + 1) * SUB_COUNT + ((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+    static int64_t upper(size_t i){
+        if(i < SUB_COUNT) return i + 1;
+        size_t e = i / SUB_COUNT + SUB_BITS - 1;
+        uint64_t base = uint64_t(1) << e;
+        uint64_t step = base >> SUB_BITS;
+        uint64_t u = base + (i % SUB_COUNT + 1) * step;
+        return u > uint64_t(std::numeric_limits<int64_t>::max()) ? std::numeric_limits<int64_t>::max() : u;
+    }
+
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<int64_t> sum_;
+    std::atomic<int64_t> min_;
+    std::atomic<int64_t> max_;
+};
+
+} // namespace canopen
+
+#endif
@@ -1,21 +1,60 @@
 #ifndef H_CANOPEN_LAYER
 #define H_CANOPEN_LAYER
 
+#include <array>
 #include <vector>
 #include <memory>
 #include <boost/thread/shared_mutex.hpp>
 #include <atomic>
 #include <boost/exception/diagnostic_information.hpp>
+#include "layer_timing.h"
+#include "trace.h"
 
 namespace canopen{
 
+/// pre-registered status message for the cyclic path, "%1%" and "%2%" get replaced by the arguments on rendering
+class StatusCode{
+    const char * const format_;
+    const uint16_t id_;
+    static uint16_t next_id(){ static std::atomic<uint16_t> id(0); return ++id; }
+public:
+    explicit StatusCode(const char *format) : format_(format), id_(next_id()) {}
+    const char * format() const { return format_; }
+    uint16_t id() const { return id_; }
+
+    std::string render(const int64_t *args, size_t num_args) const {
+        std::string res(format_);
+        for(size_t i = 0; i < num_args; ++i){
+            const std::string key = "%" + std::to_string(i+1) + "%";
+            for(size_t pos = res.find(key); pos != std::string::npos; pos = res.find(key, pos)){
+                const std::string val = std::to_string(args[i]);
+                res.replace(pos, key.size(), val);
+                pos += val.size();
+            }
+        }
+        return res;
+    }
+};
+
 class LayerStatus{
+public:
+    static const size_t MAX_CODES = 8;
+    struct CodeEntry{
+        const StatusCode *code;
+        uint8_t num_args;
+        int64_t args[2];
+        std::string render() const { return code->render(args, num_args); }
+    };
+private:
     mutable boost::mutex write_mutex_;
     enum State{
         OK = 0, WARN = 1, ERROR= 2, STALE = 3, UNBOUNDED = 3
     };
     std::atomic<State> state;
     std::string reason_;
+    std::array<CodeEntry, MAX_CODES> codes_;
+    size_t num_codes_;
+    size_t dropped_codes_;
 
     virtual void set(const State &s, const std::string &r){
         boost::mutex::scoped_lock lock(write_mutex_);
@@ -25,6 +64,24 @@ class LayerStatus{
             else reason_ += "; " + r;
         }
     }
+    /// does not allocate, identical entries are stored once
+    void set(const State &s, const StatusCode &c, uint8_t num_args, int64_t a0, int64_t a1){
+        boost::mutex::scoped_lock lock(write_mutex_);
+        if(s > state) state = s;
+        for(size_t i = 0; i < num_codes_; ++i){
+            const CodeEntry &e = codes_[i];
+            if(e.code == &c && e.num_args == num_args && (num_args < 1 || e.args[0] == a0) && (num_args < 2 || e.args[1] == a1)) return;
+        }
+        if(num_codes_ == MAX_CODES){
+            ++dropped_codes_;
+            return;
+        }
+        CodeEntry &e = codes_[num_codes_++];
+        e.code = &c;
+        e.num_args = num_args;
+        e.args[0] = a0;
+        e.args[1] = a1;
+    }
 public:
     struct Ok { static const State state = OK; private: Ok();};
     struct Warn { static const State state = WARN; private: Warn(); };
@@ -35,15 +92,61 @@ public:
     template<typename T> bool bounded() const{ return state <= T::state; }
     template<typename T> bool equals() const{ return state == T::state; }
 
-    LayerStatus() : state(OK) {}
+    LayerStatus() : state(OK), num_codes_(0), dropped_codes_(0) {}
 
     int get() const { return state; }
 
-    const std::string reason() const { boost::mutex::scoped_lock lock(write_mutex_); return reason_; }
+    /// renders string reasons and codes
+    const std::string reason() const {
+        boost::mutex::scoped_lock lock(write_mutex_);
+        std::string res = reason_;
+        for(size_t i = 0; i < num_codes_; ++i){
+            if(!res.empty()) res += "; ";
+            res += codes_[i].render();
+        }
+        if(dropped_codes_) res += "; " + std::to_string(dropped_codes_) + " more";
+        return res;
+    }
+    /// adds state, reasons and codes of another status
+    void merge(const LayerStatus &other){
+        if(&other == this) return;
+        boost::mutex::scoped_lock other_lock(other.write_mutex_);
+        {
+            boost::mutex::scoped_lock lock(write_mutex_);
+            if(other.state > state) state = other.state.load();
+            if(!other.reason_.empty()){
+                if(reason_.empty()) reason_ = other.reason_;
+                else reason_ += "; " + other.reason_;
+            }
+            dropped_codes_ += other.dropped_codes_;
+        }
+        for(size_t i = 0; i < other.num_codes_; ++i){
+            const CodeEntry &e = other.codes_[i];
+            set(OK, *e.code, e.num_args, e.args[0], e.args[1]);
+        }
+    }
+    void reset(){
+        boost::mutex::scoped_lock lock(write_mutex_);
+        state = OK;
+        reason_.clear();
+        num_codes_ = 0;
+        dropped_codes_ = 0;
+    }
+    std::vector<CodeEntry> codes() const {
+        boost::mutex::scoped_lock lock(write_mutex_);
+        return std::vector<CodeEntry>(codes_.begin(), codes_.begin() + num_codes_);
+    }
 
     const void warn(const std::string & r) { set(WARN, r); }
     const void error(const std::string & r) { set(ERROR, r); }
     const void stale(const std::string & r) { set(STALE, r); }
+
+    void warn(const StatusCode &c) { set(WARN, c, 0, 0, 0); }
+    void warn(const StatusCode &c, int64_t a0) { set(WARN, c, 1, a0, 0); }
+    void warn(const StatusCode &c, int64_t a0, int64_t a1) { set(WARN, c, 2, a0, a1); }
+    void error(const StatusCode &c) { set(ERROR, c, 0, 0, 0); }
+    void error(const StatusCode &c, int64_t a0) { set(ERROR, c, 1, a0, 0); }
+    void error(const StatusCode &c, int64_t a0, int64_t a1) { set(ERROR, c, 2, a0, a1); }
 };
 class LayerReport : public LayerStatus {
     std::vector<std::pair<std::string, std::string> > values_;
@@ -73,14 +176,25 @@ public:
     };
 
     const std::string name;
+    const unsigned int instance_id; ///< unique per instance, names are not
+
+    /// name and instance id, e.g. "Node 301 #12"
+    std::string label() const { return name + " #" + std::to_string(instance_id); }
 
     void read(LayerStatus &status) {
+        CANOPEN_LAYER_TIMING_SCOPE(read);
+        CyclicScope scope(this, "read");
+        TraceRecorder::Scope trace(TraceRecorder::enabled() ? TraceRecorder::intern(trace_read_, label() + " read") : 0);
         if(state > Off) CATCH_LAYER_HANDLER_EXCEPTIONS(handleRead(status, state), status);
     }
     void write(LayerStatus &status) {
+        CANOPEN_LAYER_TIMING_SCOPE(write);
+        CyclicScope scope(this, "write");
+        TraceRecorder::Scope trace(TraceRecorder::enabled() ? TraceRecorder::intern(trace_write_, label() + " write") : 0);
         if(state > Off) CATCH_LAYER_HANDLER_EXCEPTIONS(handleWrite(status, state), status);
     }
     void diag(LayerReport &report) {
+        CANOPEN_LAYER_TIMING_SCOPE(diag);
         if(state > Shutdown) CATCH_LAYER_HANDLER_EXCEPTIONS(handleDiag(report), report);
     }
     void init(LayerStatus &status) {
@@ -124,7 +238,17 @@ public:
 
     LayerState getLayerState() { return state; }
 
-    Layer(const std::string &n) : name(n), state(Off) {}
+    /// innermost layer whose read or write runs on this thread, 0 outside of the cyclic path
+    static const Layer* cyclicLayer() { return cyclic().layer; }
+    /// "read" or "write", 0 outside of the cyclic path
+    static const char* cyclicPhase() { return cyclic().phase; }
+
+    Layer(const std::string &n) : name(n), instance_id(LayerTiming::nextId()),
+#ifdef CANOPEN_LAYER_TIMING
+    timing_(n, instance_id),
+#endif
+    trace_read_(-1), trace_write_(-1),
+    state(Off) {}
 
     virtual ~Layer() {}
 
@@ -141,6 +265,22 @@ protected:
     virtual void handleRecover(LayerStatus &status)  = 0;
 
 private:
+    struct Cyclic{
+        const Layer *layer;
+        const char *phase;
+    };
+    static Cyclic& cyclic() { static thread_local Cyclic c = {0, 0}; return c; }
+    class CyclicScope{
+        const Cyclic prev_;
+    public:
+        CyclicScope(const Layer *l, const char *phase) : prev_(cyclic()) { cyclic().layer = l; cyclic().phase = phase; }
+        ~CyclicScope() { cyclic() = prev_; }
+    };
+
+#ifdef CANOPEN_LAYER_TIMING
+    LayerTiming timing_;
+#endif
+    std::atomic<int> trace_read_, trace_write_; ///< interned on first use, -1 before
     std::atomic<LayerState> state;
 
 };
@@ -167,6 +307,11 @@ protected:
         return call<LayerStatus::Unbounded>(func, status, layers.rbegin(), layers.rend());
     }
     void destroy() { boost::unique_lock<boost::shared_mutex> lock(mutex); layers.clear(); }
+    /// runs func on the vector of layers, while it is locked against modification
+    template<typename FuncType> void with_layers(FuncType func){
+        boost::shared_lock<boost::shared_mutex> lock(mutex);
+        func(const_cast<const vector_type&>(layers));
+    }
 
 public:
     virtual void add(const VectorMemberSharedPtr &l) { boost::unique_lock<boost::shared_mutex> lock(mutex); layers.push_back(l); }
@@ -0,0 +1,88 @@
+#ifndef H_CANOPEN_LAYER_TIMING
+#define H_CANOPEN_LAYER_TIMING
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/thread/mutex.hpp>
+#include "histogram.h"
+
+namespace canopen{
+
+/// cycle timing of one layer, only used if CANOPEN_LAYER_TIMING is defined for all packages
+class LayerTiming{
+public:
+    const std::string name;
+    const unsigned int id; ///< unique per instance, layer names are not
+    Histogram read, write, diag;
+
+    class Scope{
+        Histogram &histogram_;
+        const boost::chrono::high_resolution_clock::time_point start_;
+    public:
+        Scope(Histogram &h) : histogram_(h), start_(boost::chrono::high_resolution_clock::now()) {}
+        ~Scope() { histogram_.record(boost::chrono::high_resolution_clock::now() - start_); }
+    };
+
+    LayerTiming(const std::string &n, unsigned int i = nextId()) : name(n), id(i) { registry(this, true); }
+    ~LayerTiming() { registry(this, false); }
+
+    /// "count/mean/p99/max" in microseconds
+    static std::string summary(const Histogram &h){
+        std::stringstream sstr;
+        sstr << h.count() << "/" << h.mean() / 1000.0 << "/" << h.percentile(0.99) / 1000.0 << "/" << h.max() / 1000.0;
+        return sstr.str();
+    }
+    /// name and id, e.g. "Node 301 #12"
+    std::string label() const { return name + " #" + std::to_string(id); }
+
+    template<typename Report> void report(Report &report) const {
+        const std::string l = label();
+        report.add(l + " read [n/mean/p99/max us]", summary(read));
+        report.add(l + " write [n/mean/p99/max us]", summary(write));
+    }
+    void reset() { read.reset(); write.reset(); diag.reset(); }
+
+    /// calls func for all existing timings, in order of creation
+    template<typename FuncType> static void visit(FuncType func){
+        boost::mutex::scoped_lock lock(registry_mutex());
+        for(const LayerTiming *t: registry_list()) func(*t);
+    }
+    static void resetAll(){
+        boost::mutex::scoped_lock lock(registry_mutex());
+        for(LayerTiming *t: registry_list()) t->reset();
+    }
+    /// unique ids for layers and their timings
+    static unsigned int nextId() { static std::atomic<unsigned int> id(0); return id++; }
+
+    static bool enabled(){
+#ifdef CANOPEN_LAYER_TIMING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    static boost::mutex& registry_mutex() { static boost::mutex m; return m; }
+    static std::vector<LayerTiming*>& registry_list() { static std::vector<LayerTiming*> l; return l; }
+    static void registry(LayerTiming *t, bool add){
+        boost::mutex::scoped_lock lock(registry_mutex());
+        std::vector<LayerTiming*> &l = registry_list();
+        if(add) l.push_back(t);
+        else l.erase(std::remove(l.begin(), l.end(), t), l.end());
+    }
+};
+
+} // namespace canopen
+
+#ifdef CANOPEN_LAYER_TIMING
+#define CANOPEN_LAYER_TIMING_SCOPE(op) canopen::LayerTiming::Scope layer_timing_scope_(timing_.op)
+#else
+#define CANOPEN_LAYER_TIMING_SCOPE(op)
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef H_CANOPEN_NODE_LIST
+#define H_CANOPEN_NODE_LIST
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace canopen{
+
+/// parses node ids like "1,2,8-16,127" and appends them to nodes, fails on ids outside of 1..127
+inline bool parseNodeList(const std::string &str, std::vector<unsigned int> &nodes){
+    std::stringstream sstr(str);
+    std::string item;
+    while(std::getline(sstr, item, ',')){
+        unsigned int first = 0, last = 0;
+        size_t dash = item.find('-');
+        try{
+            first = std::stoul(item.substr(0, dash));
+            last = dash == std::string::npos ? first : std::stoul(item.substr(dash + 1));
+        }
+        catch(...){
+            return false;
+        }
+        if(first < 1 || last > 127 || first > last) return false;
+        for(unsigned int n = first; n <= last; ++n) nodes.push_back(n);
+    }
+    return !nodes.empty();
+}
+
+} // namespace canopen
+
+#endif
@@ -7,8 +7,10 @@
 #include <unordered_set>
 
 #include <socketcan_interface/delegates.h>
+#include <socketcan_interface/dispatcher.h>
 
 #include <boost/thread/mutex.hpp>
+#include <atomic>
 #include <functional>
 #include <typeinfo>
 #include <vector>
@@ -72,6 +74,9 @@ public:
         }
         buffer = t;
     }
+    HoldAny(const String &t): type_guard(TypeGuard::create<String>()), empty(false){
+        buffer = t;
+    }
     HoldAny(const TypeGuard &t): type_guard(t), empty(true){ }
 
     bool is_empty() const { return empty; }
@@ -177,10 +182,10 @@ public:
         Entry() {}
 
         Entry(const Code c, const uint16_t i,  const uint16_t t, const std::string & d, const bool r = true, const bool w = true, bool m = false, const HoldAny def = HoldAny(), const HoldAny init = HoldAny()):
-        obj_code(c), index(i), sub_index(0),data_type(t),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
+        obj_code(c), index(i), sub_index(0),data_type(t),constant(false),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
 
         Entry(const uint16_t i, const uint8_t s, const uint16_t t, const std::string & d, const bool r = true, const bool w = true, bool m = false, const HoldAny def = HoldAny(), const HoldAny init = HoldAny()):
-        obj_code(VAR), index(i), sub_index(s),data_type(t),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
+        obj_code(VAR), index(i), sub_index(s),data_type(t),constant(false),readable(r), writable(w), mappable(m), desc(d), def_val(def), init_val(init) {}
 
         operator Key() const { return Key(index, sub_index); }
         const HoldAny & value() const { return !init_val.is_empty() ? init_val : def_val; }
@@ -285,6 +290,11 @@ public:
 
     typedef std::shared_ptr<ObjectStorage> ObjectStorageSharedPtr;
 
+    /// gets called with the key of an object whose value was changed by a mapped RPDO
+    using ChangeFunc = std::function<void(const ObjectDict::Key&)>;
+    typedef can::Listener<const ChangeFunc, const ObjectDict::Key&> ChangeListener;
+    typedef ChangeListener::ListenerConstSharedPtr ChangeListenerConstSharedPtr;
+
 protected:
     class Data {
         Data(const Data&) = delete; // prevent copies
@@ -297,6 +307,10 @@ protected:
         ReadFunc read_delegate;
         WriteFunc write_delegate;
 
+        can::SimpleDispatcher<ChangeListener> listeners;
+        can::SimpleDispatcher<ChangeListener> coalesced_listeners;
+        std::atomic<bool> changed;
+
         template <typename T> T & access(){
             if(!valid){
                 THROW_WITH_KEY(std::length_error("buffer not valid"), key);
@@ -317,14 +331,14 @@ protected:
         size_t size() { boost::mutex::scoped_lock lock(mutex); return buffer.size(); }
 
         template<typename T> Data(const ObjectDict::Key &k, const ObjectDict::EntryConstSharedPtr &e, const T &val, const ReadFunc &r, const WriteFunc &w)
-        : valid(false), read_delegate(r), write_delegate(w), type_guard(TypeGuard::create<T>()), entry(e), key(k){
+        : valid(false), read_delegate(r), write_delegate(w), changed(false), type_guard(TypeGuard::create<T>()), entry(e), key(k){
             assert(r);
             assert(w);
             assert(e);
             allocate<T>() = val;
         }
         Data(const ObjectDict::Key &k, const ObjectDict::EntryConstSharedPtr &e, const TypeGuard &t, const ReadFunc &r, const WriteFunc &w)
-        : valid(false), read_delegate(r), write_delegate(w), type_guard(t), entry(e), key(k){
+        : valid(false), read_delegate(r), write_delegate(w), changed(false), type_guard(t), entry(e), key(k){
             assert(r);
             assert(w);
             assert(e);
@@ -379,6 +393,16 @@ protected:
         void reset();
         void force_write();
 
+        ChangeListenerConstSharedPtr subscribe(const ChangeFunc &func, bool coalesce){
+            return coalesce ? coalesced_listeners.createListener(func) : listeners.createListener(func);
+        }
+        void notify_changed(){
+            changed = true;
+            listeners.dispatch(key);
+        }
+        void flush_changed(){
+            if(changed.exchange(false)) coalesced_listeners.dispatch(key);
+        }
     };
     typedef std::shared_ptr<Data> DataSharedPtr;
 public:
@@ -451,6 +475,24 @@ public:
         const ObjectDict::Entry & desc() const{
             return *(data->entry);
         }
+        /// func gets called if a mapped RPDO has changed the value, as soon as get() returns it or, if coalesced, once per cycle in PDOMapper::read().
+        /// That is right on reception, or after the next swap if the chain uses a process image.
+        /// Values that are not mapped to an RPDO have to be polled.
+        ChangeListenerConstSharedPtr subscribe(const ChangeFunc &func, bool coalesce = false){
+            if(!data) BOOST_THROW_EXCEPTION( PointerInvalid("ObjectStorage::Entry::subscribe(func)") );
+            return data->subscribe(func, coalesce);
+        }
+    };
+
+    /// lets the producer of a mapped value notify the subscribers of the entry
+    class ChangeNotifier{
+        DataSharedPtr data;
+    public:
+        ChangeNotifier() {}
+        ChangeNotifier(const DataSharedPtr &d) : data(d) {}
+        void notify() const { if(data) data->notify_changed(); }
+        void flush() const { if(data) data->flush_changed(); }
+        bool operator==(const ChangeNotifier &other) const { return data == other.data; }
     };
 
     void reset();
@@ -499,6 +541,9 @@ public:
     }
 
     size_t map(uint16_t index, uint8_t sub_index, const ReadFunc & read_delegate, const WriteFunc & write_delegate);
+    /// restores the delegates of the storage, e.g. after the object was removed from a PDO
+    void unmap(uint16_t index, uint8_t sub_index);
+    ChangeNotifier getChangeNotifier(uint16_t index, uint8_t sub_index);
 
     template<typename T> Entry<T> entry(uint16_t index){
         return entry<T>(ObjectDict::Key(index));
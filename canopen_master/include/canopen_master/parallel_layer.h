@@ -0,0 +1,80 @@
+#ifndef H_CANOPEN_PARALLEL_LAYER
+#define H_CANOPEN_PARALLEL_LAYER
+
+#include <deque>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include "layer.h"
+
+namespace canopen{
+
+/// persistent threads that process the indices of one job together with the calling thread
+class WorkerPool{
+public:
+    /// threads == 0 selects one thread less than the number of cores
+    explicit WorkerPool(size_t threads = 0);
+    ~WorkerPool();
+
+    /// calls func(i) for all i < count and returns after all calls have finished, not reentrant
+    template<typename FuncType> void run(size_t count, FuncType &func){
+        run(count, &WorkerPool::invoke<FuncType>, &func);
+    }
+    size_t size() const { return threads_.size(); }
+
+private:
+    typedef void (*JobFunc)(void *, size_t);
+    template<typename FuncType> static void invoke(void *func, size_t i) { (*static_cast<FuncType*>(func))(i); }
+
+    void run(size_t count, JobFunc func, void *data);
+    void process();
+    void loop();
+
+    boost::mutex mutex_;
+    boost::condition_variable start_cond_;
+    boost::condition_variable done_cond_;
+    uint64_t generation_;
+    bool running_;
+
+    JobFunc func_;
+    void *data_;
+    size_t count_;
+    std::atomic<size_t> next_;
+    size_t busy_; ///< workers that have not finished the current generation
+
+    std::vector<std::unique_ptr<boost::thread> > threads_;
+};
+
+/// LayerGroup that reads and writes its members concurrently, statuses are merged in the order of the members
+template<typename T> class ParallelLayerGroup : public LayerGroupNoDiag<T>{
+    WorkerPool pool_;
+    std::deque<LayerStatus> statuses_;
+
+    template<typename FuncType> void call_parallel(FuncType func, LayerStatus &status){
+        this->template with_layers([&](const typename VectorHelper<T>::vector_type &layers){
+            while(statuses_.size() < layers.size()) statuses_.emplace_back();
+            auto job = [&](size_t i){
+                statuses_[i].reset();
+                ((*layers[i]).*func)(statuses_[i]);
+            };
+            pool_.run(layers.size(), job);
+            for(size_t i = 0; i < layers.size(); ++i) status.merge(statuses_[i]);
+        });
+        if(!status.template bounded<LayerStatus::Warn>()){
+            this->template call(&Layer::halt, status);
+            this->halt(status);
+        }
+    }
+protected:
+    virtual void handleRead(LayerStatus &status, const Layer::LayerState &current_state) {
+        call_parallel(&Layer::read, status);
+    }
+    virtual void handleWrite(LayerStatus &status, const Layer::LayerState &current_state) {
+        call_parallel(&Layer::write, status);
+    }
+public:
+    ParallelLayerGroup(const std::string &n, size_t threads = 0) : LayerGroupNoDiag<T>(n), pool_(threads) {}
+};
+
+} // namespace canopen
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef H_CANOPEN_PROCESS_IMAGE
+#define H_CANOPEN_PROCESS_IMAGE
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include "objdict.h"
+
+namespace canopen{
+
+/// chain-wide image of all RPDO-mapped objects, RPDOs write into the back buffer as they arrive,
+/// the sync layer swaps it to the front at the start of the read phase, so all consumers see the data of the same cycle
+class ProcessImage{
+public:
+    struct Region{
+        size_t offset;
+        size_t size;
+        uint8_t node_id;
+        uint16_t index;
+        uint8_t sub_index;
+        uint16_t data_type;
+    };
+    struct Tag{
+        uint64_t cycle; ///< number of swaps so far
+        uint8_t sync_counter; ///< SYNC counter of the cycle, 0 if the counter is not used
+        boost::chrono::high_resolution_clock::time_point time;
+        Tag() : cycle(0), sync_counter(0) {}
+    };
+
+    ProcessImage() : layout_(0), sequence_(0) {}
+
+    /// reserves space for one mapped object, returns its offset
+    size_t allocate(const ObjectDict::Entry &entry, uint8_t node_id, size_t size);
+
+    /// called from the receive path, data is not visible before the next swap
+    void write(size_t offset, const uint8_t *data, size_t size);
+
+    /// publishes the back buffer and runs the notifications of the objects that changed since the last swap
+    void swap(uint8_t sync_counter);
+
+    /// notifies after the next swap, when the written value has become visible to readers of the front buffer
+    void notifyAfterSwap(const ObjectStorage::ChangeNotifier &notifier);
+
+    /// consistent read from the front buffer, returns false if the object was not received yet
+    bool read(size_t offset, uint8_t *data, size_t size, Tag *tag = 0) const;
+
+    /// consistent copy of the complete front buffer
+    void snapshot(std::vector<uint8_t> &data, std::vector<uint8_t> &valid, Tag &tag) const;
+
+    /// consistent copy into preallocated memory, returns the number of bytes copied
+    size_t snapshot(uint8_t *data, uint8_t *valid, size_t size, Tag &tag) const;
+
+    Tag getTag() const;
+    /// incremented whenever a region is added
+    uint64_t getLayout() const { return layout_; }
+    std::vector<Region> getRegions() const;
+    size_t size() const;
+
+private:
+    mutable boost::mutex mutex_; ///< guards the back buffer and the layout
+    mutable boost::shared_mutex front_mutex_; ///< guards the size of the front buffer only, contents are protected by the seqlock
+    std::vector<Region> regions_;
+    std::vector<uint8_t> back_, back_valid_;
+    std::vector<ObjectStorage::ChangeNotifier> pending_; ///< guarded by mutex_
+    std::atomic<uint64_t> layout_;
+
+    std::atomic<uint64_t> sequence_; ///< seqlock for the front buffer, odd while swapping
+    std::vector<uint8_t> front_, front_valid_;
+    Tag tag_;
+
+    template<typename Func> void readFront(Func func) const {
+        boost::shared_lock<boost::shared_mutex> lock(front_mutex_);
+        uint64_t seq;
+        do{
+            while((seq = sequence_.load(std::memory_order_acquire)) & 1) {}
+            func();
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }while(seq != sequence_.load(std::memory_order_relaxed));
+    }
+};
+typedef std::shared_ptr<ProcessImage> ProcessImageSharedPtr;
+
+} // namespace canopen
+
+#endif
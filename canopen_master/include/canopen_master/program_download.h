@@ -0,0 +1,53 @@
+#ifndef H_CANOPEN_PROGRAM_DOWNLOAD
+#define H_CANOPEN_PROGRAM_DOWNLOAD
+
+#include "canopen.h"
+
+namespace canopen{
+
+class ProgramDownloadException : public Exception{
+public:
+    ProgramDownloadException(const std::string &w) : Exception(w) {}
+};
+
+/// program download according to CiA 302-3: program data 0x1F50, program control 0x1F51, software identification 0x1F56,
+/// all with the program number as sub-index. The objects must be part of the object dictionary of the node.
+class ProgramDownload{
+public:
+    enum Control{
+        Stop = 0, Start = 1, Reset = 2, Clear = 3
+    };
+    struct Options{
+        uint8_t program;         ///< program number 1..254, sub-index of the objects
+        bool clear;              ///< clear the program before the download
+        bool start;              ///< start the program after the verification
+        uint32_t identification; ///< expected value of 0x1F56, 0 skips the verification
+        uint8_t block_size;      ///< block transfer is tried first, falls back to segmented transfer
+        Options() : program(1), clear(true), start(true), identification(0), block_size(127) {}
+    };
+    struct Result{
+        size_t bytes;
+        double seconds;          ///< time of the data transfer only
+        uint32_t identification; ///< value of 0x1F56 after the download
+        double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+        Result() : bytes(0), seconds(0), identification(0) {}
+    };
+    /// bytes transferred, total size and throughput so far
+    typedef std::function<void(size_t done, size_t total, double bytes_per_s)> ProgressFunc;
+
+    ProgramDownload(SDOClient &client, const Options &options = Options());
+
+    /// runs stop, clear, download, verification and start, throws ProgramDownloadException with the failed step
+    Result run(const SDOClient::DomainSource &source, size_t size, const ProgressFunc &progress = ProgressFunc());
+    /// reads the image from a file
+    Result runFile(const std::string &path, const ProgressFunc &progress = ProgressFunc());
+
+private:
+    SDOClient &client_;
+    const Options options_;
+    void control(Control c, const char *step);
+};
+
+} // namespace canopen
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef H_CANOPEN_SCANNER
+#define H_CANOPEN_SCANNER
+
+#include <map>
+#include "canopen.h"
+
+namespace canopen{
+
+/// discovers the nodes on a bus: all SDO upload requests for 0x1000 are sent in one burst,
+/// the identity object 0x1018 is queried from every node that answered, all nodes in parallel.
+class BusScanner{
+public:
+    struct Device{
+        uint8_t node_id;
+        bool sdo;          ///< answered the SDO request for 0x1000
+        bool heartbeat;    ///< sent a heartbeat or boot-up
+        bool boot_up;      ///< sent a boot-up message
+        Node::State state; ///< last state from heartbeat
+        uint32_t device_type;
+        uint8_t identity;  ///< number of valid entries in 0x1018 sub 1..4
+        uint32_t vendor_id, product_code, revision, serial;
+        time_duration response_time; ///< time to the first frame of this node
+        Device(uint8_t id = 0) : node_id(id), sdo(false), heartbeat(false), boot_up(false), state(Node::Unknown), device_type(0), identity(0),
+            vendor_id(0), product_code(0), revision(0), serial(0), response_time(time_duration::zero()) {}
+    };
+    typedef std::map<uint8_t, Device> Devices;
+
+    /// window: time to wait for the response to the last request, should be well below the usual SDO timeout
+    BusScanner(const can::CommInterfaceSharedPtr &interface, const time_duration &window = boost::chrono::milliseconds(50));
+
+    /// scans the given range of node ids, listen additionally collects heartbeats and boot-ups
+    /// and waits at least listen_time for them, returns all nodes that were seen
+    Devices scan(uint8_t first = 1, uint8_t last = 127, bool listen = false, const time_duration &listen_time = time_duration::zero());
+
+private:
+    const can::CommInterfaceSharedPtr interface_;
+    const time_duration window_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    Devices devices_;
+    struct Pending{
+        uint8_t sub_index; ///< sub-index of 0x1018 in flight, 0 for 0x1000
+        time_point sent;
+    };
+    std::map<uint8_t, Pending> pending_; ///< one request per node at a time
+    std::vector<std::pair<can::Frame, int> > retry_; ///< requests that could not be sent and the number of attempts
+    uint8_t first_, last_;
+    bool listen_;
+    time_point start_;
+
+    void handleFrame(const can::Frame &msg);
+    /// returns the follow-up request, if there is one
+    bool handleSDO(uint8_t node_id, const can::Frame &msg, can::Frame &next);
+    /// registers the request as pending, has to be called with mutex_ held
+    can::Frame request(uint8_t node_id, uint16_t index, uint8_t sub_index);
+    /// sends without holding mutex_, failed requests are queued for scan() to retry
+    void send(const can::Frame &msg, int attempts = 0);
+};
+
+} // namespace canopen
+
+#endif
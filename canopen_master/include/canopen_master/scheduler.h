@@ -0,0 +1,97 @@
+#ifndef H_CANOPEN_SCHEDULER
+#define H_CANOPEN_SCHEDULER
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <boost/chrono/system_clocks.hpp>
+#include "histogram.h"
+#include "layer.h"
+
+namespace canopen{
+
+/// sleep until abs_time on CLOCK_MONOTONIC, the last busy_wait part is spent spinning to cut wake-up latency
+void sleep_until_precise(const boost::chrono::high_resolution_clock::time_point &abs_time,
+                         const boost::chrono::high_resolution_clock::duration &busy_wait = boost::chrono::high_resolution_clock::duration::zero());
+
+class PeriodicScheduler{
+public:
+    typedef boost::chrono::high_resolution_clock clock;
+
+    /// what to do if a deadline was missed
+    enum OverrunPolicy{
+        Skip,     ///< stay on the grid, drop the missed periods
+        CatchUp,  ///< stay on the grid, run the missed periods back to back
+        ShiftPhase ///< restart the grid one period after the late wake-up
+    };
+    /// parses "skip", "catch_up" or "shift_phase", throws std::invalid_argument otherwise
+    static OverrunPolicy parsePolicy(const std::string &str);
+
+    PeriodicScheduler(const clock::duration &period, const clock::duration &busy_wait = clock::duration::zero(), OverrunPolicy policy = Skip)
+    : period_(period), busy_wait_(busy_wait), policy_(policy), missed_(0), overruns_(0) {}
+
+    /// first deadline will be one period after start
+    void start(const clock::time_point &start);
+
+    /// waits for the next deadline and advances it by exactly one period, returns the deadline that was waited for
+    clock::time_point wait();
+
+    const clock::duration& getPeriod() const { return period_; }
+    const clock::time_point& getDeadline() const { return deadline_; }
+
+    OverrunPolicy getPolicy() const { return policy_; }
+    /// periods that were dropped (Skip) or shifted away (ShiftPhase)
+    uint64_t getMissed() const { return missed_; }
+    /// wake-ups after the following deadline had already passed
+    uint64_t getOverruns() const { return overruns_; }
+    const Histogram& getJitter() const { return jitter_; }
+    const Histogram& getLatency() const { return latency_; }
+
+    void report(LayerReport &report, const std::string &prefix) const;
+    void resetStatistics();
+
+private:
+    const clock::duration period_;
+    const clock::duration busy_wait_;
+    const OverrunPolicy policy_;
+    clock::time_point deadline_;
+    clock::time_point last_wakeup_;
+    std::atomic<uint64_t> missed_;
+    std::atomic<uint64_t> overruns_;
+    Histogram jitter_;  ///< deviation of the measured period from the nominal one
+    Histogram latency_; ///< wake-up time after the deadline
+};
+
+/// adapts an offset to the worst recently observed latency, with a safety margin and hysteresis.
+/// The offset stays a margin below max, which is usually the period.
+class AdaptiveOffset{
+public:
+    typedef boost::chrono::high_resolution_clock clock;
+
+    AdaptiveOffset(const clock::duration &initial, const clock::duration &max, const clock::duration &margin, const clock::duration &hysteresis, size_t window = 100)
+    : max_(max), margin_(margin), hysteresis_(hysteresis), window_(window), next_(0), filled_(false), offset_(initial.count()), late_(0) {}
+
+    /// feeds the latency of one cycle, the offset grows immediately but shrinks only after a full window
+    void update(const clock::duration &latency);
+    clock::duration get() const { return clock::duration(offset_.load()); }
+
+    uint64_t getLate() const { return late_; }
+    const Histogram& getLatency() const { return latency_; }
+
+    void report(LayerReport &report, const std::string &prefix) const;
+
+private:
+    const clock::duration max_;
+    const clock::duration margin_;
+    const clock::duration hysteresis_;
+    std::vector<clock::duration> window_;
+    size_t next_;
+    bool filled_;
+    std::atomic<clock::rep> offset_;
+    std::atomic<uint64_t> late_; ///< latencies that exceeded the offset that was active
+    Histogram latency_;
+};
+
+} // namespace canopen
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef H_CANOPEN_SDO_MONITOR
+#define H_CANOPEN_SDO_MONITOR
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <tuple>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/thread/mutex.hpp>
+#include "layer.h"
+#include "objdict.h"
+
+namespace canopen{
+
+class HotPathSDOException : public Exception{
+public:
+    HotPathSDOException(const std::string &w) : Exception(w) {}
+};
+
+/// attributes SDO transfers to the layer that caused them and flags transfers from within read or write
+class SDOAccessMonitor{
+public:
+    enum Policy{
+        Allow,  ///< count only
+        Warn,   ///< count and log the first access of every object from the cyclic path
+        Refuse  ///< throw HotPathSDOException for transfers from the cyclic path
+    };
+    /// parses "allow", "warn" or "refuse", throws std::invalid_argument otherwise
+    static Policy parsePolicy(const std::string &str);
+
+    struct Record{
+        uint8_t node_id;
+        uint16_t index;
+        uint8_t sub_index;
+        bool write;
+        std::string layer; ///< empty if not called from read or write
+        std::string phase;
+        uint64_t count;
+        uint64_t refused;
+        int64_t sum_ns;
+        int64_t max_ns;
+        bool cyclic() const { return !layer.empty(); }
+    };
+
+    /// measures one transfer, checks the policy on construction
+    class Transfer{
+        SDOAccessMonitor &monitor_;
+        const uint8_t node_id_;
+        const ObjectDict::Entry &entry_;
+        const bool write_;
+        const Layer *const layer_;
+        const char *const phase_;
+        const boost::chrono::high_resolution_clock::time_point start_;
+    public:
+        Transfer(uint8_t node_id, const ObjectDict::Entry &entry, bool write, SDOAccessMonitor &monitor = SDOAccessMonitor::instance());
+        ~Transfer();
+    };
+
+    static SDOAccessMonitor& instance();
+
+    void setPolicy(Policy policy) { policy_ = policy; }
+    Policy getPolicy() const { return policy_; }
+
+    std::vector<Record> getRecords() const;
+    /// number of transfers from the cyclic path
+    uint64_t getCyclicCount() const { return cyclic_count_; }
+    /// number of transfers started by the calling thread so far
+    static uint64_t getThreadCount() { return thread_count(); }
+    void reset();
+
+    /// adds a summary of all objects accessed from the cyclic path, these should be PDO-mapped,
+    /// warns if there were any since the previous report
+    void report(LayerReport &report) const;
+
+    SDOAccessMonitor() : policy_(Warn), cyclic_count_(0), reported_count_(0) {}
+
+private:
+    /// layer and phase are compared by address, the names are only copied into new records
+    typedef std::tuple<uint8_t, uint16_t, uint8_t, bool, const Layer*, const char*> Key;
+    Record& record(const Key &key);
+    static uint64_t& thread_count() { static thread_local uint64_t count = 0; return count; }
+    void add(uint8_t node_id, const ObjectDict::Entry &entry, bool write, const Layer *layer, const char *phase, const boost::chrono::high_resolution_clock::duration &latency);
+
+    mutable boost::mutex mutex_;
+    std::map<Key, Record> records_;
+    std::atomic<Policy> policy_;
+    std::atomic<uint64_t> cyclic_count_;
+    mutable std::atomic<uint64_t> reported_count_; ///< cyclic_count_ at the previous report
+};
+
+} // namespace canopen
+
+#endif
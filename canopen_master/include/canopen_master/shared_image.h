@@ -0,0 +1,60 @@
+#ifndef H_CANOPEN_SHARED_IMAGE
+#define H_CANOPEN_SHARED_IMAGE
+
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <string>
+#include "process_image.h"
+
+namespace canopen{
+
+/// layout at the start of the shared memory segment, followed by `size` data bytes and `size` valid flags
+struct SharedImageHeader{
+    static const uint32_t MAGIC = 0x49504f43; ///< "COPI"
+    static const uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> sequence; ///< seqlock, odd while the writer updates the segment
+    uint64_t layout; ///< changes whenever objects were added, the descriptor has to be re-read then
+    uint64_t size;
+    uint64_t cycle;
+    int64_t stamp_ns; ///< CLOCK_MONOTONIC time of the swap
+    uint8_t sync_counter;
+    uint8_t reserved[15];
+};
+static_assert(sizeof(SharedImageHeader) == 64, "SharedImageHeader has to be 64 bytes");
+
+/// exports a ProcessImage to POSIX shared memory, update() is meant to be called once per cycle
+class SharedImageExport{
+public:
+    /// name is passed to shm_open, e.g. "/canopen_chain"
+    SharedImageExport(const ProcessImageSharedPtr &image, const std::string &name);
+    ~SharedImageExport();
+
+    /// copies the current front buffer, returns true if the layout has changed since the last call
+    bool update();
+
+    /// YAML description of header, offsets and types of all exported objects
+    void writeDescriptor(std::ostream &os, const std::map<uint8_t, std::string> &node_names = std::map<uint8_t, std::string>()) const;
+
+    const std::string& getName() const { return name_; }
+
+private:
+    void remap(size_t size);
+    void unmap();
+
+    const ProcessImageSharedPtr image_;
+    const std::string name_;
+    int fd_;
+    void *mem_;
+    size_t mapped_;
+    size_t size_;
+    uint64_t layout_;
+};
+typedef std::shared_ptr<SharedImageExport> SharedImageExportSharedPtr;
+
+} // namespace canopen
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef H_CANOPEN_SIM_DEVICE
+#define H_CANOPEN_SIM_DEVICE
+
+#include <map>
+#include "canopen.h"
+
+namespace canopen{
+
+/// simulated CANopen slave, serves an object dictionary as SDO server (expedited, segmented and block) on 0x1200..0x127F,
+/// NMT slave, heartbeat producer and PDO producer/consumer, including SAM-MPDO producer and DAM-MPDO consumer.
+/// All frames are handled in the receive thread of the interface, many devices can share one interface.
+class SimDevice{
+public:
+    /// heartbeats and deferred PDO updates run on service
+    SimDevice(const can::CommInterfaceSharedPtr &interface, const ObjectDictConstSharedPtr &dict, uint8_t node_id,
+              const TimerServiceSharedPtr &service = TimerService::instance());
+    ~SimDevice();
+
+    /// loads the EDS or DCF with ObjectDict::fromFile, throws ParseException if it cannot be parsed
+    static std::shared_ptr<SimDevice> fromFile(const can::CommInterfaceSharedPtr &interface, const std::string &path, uint8_t node_id,
+                                               const ObjectDict::Overlay &overlay = ObjectDict::Overlay());
+
+    /// powers the device on: registers the listeners and sends the boot-up message
+    void start();
+    /// powers the device off
+    void stop();
+
+    Node::State getState();
+    /// object values of the device, can be used to simulate the application; all objects are writable here
+    const ObjectStorageSharedPtr& getStorage() const { return storage_; }
+
+    /// transmits all TPDOs with transmission type 254 or 255, if operational
+    void sendEventPDOs();
+
+    uint64_t getSDORequests() const { return sdo_requests_; }
+    uint64_t getReceivedPDOs() const { return rpdo_count_; }
+    uint64_t getSentPDOs() const { return tpdo_count_; }
+
+    const uint8_t node_id_;
+
+    /// CRC-16-CCITT as used by SDO block transfers
+    static uint16_t crc(const uint8_t *data, size_t size, uint16_t crc = 0);
+
+private:
+    typedef std::function<void(String&)> RawReadFunc;
+    typedef std::function<bool(const String&)> RawWriteFunc;
+
+    struct Mapping{
+        RawReadFunc read;   ///< empty for dummy entries
+        RawWriteFunc write; ///< empty for dummy entries
+        uint8_t offset;
+        uint8_t length;
+        uint16_t index;     ///< sent with SAM-MPDOs
+        uint8_t sub_index;
+    };
+    struct PDO{
+        can::Header header;
+        uint8_t transmission_type;
+        uint8_t sync_count;
+        uint8_t size;
+        uint8_t mpdo;       ///< 0xFE: SAM-MPDO producer of the object scanner list, 0xFF: DAM-MPDO consumer, 0 otherwise
+        std::vector<Mapping> mappings;
+    };
+    struct SDOTransfer{
+        enum Mode { Idle, SegmentedDownload, SegmentedUpload, BlockDownload, BlockDownloadEnd, BlockUploadInit, BlockUpload, BlockUploadEnd };
+        Mode mode;
+        ObjectDict::EntryConstSharedPtr entry;
+        String buffer;
+        size_t offset;
+        size_t total; ///< indicated size, 0 if unknown
+        bool toggle;
+        bool crc;
+        uint8_t block_size;
+        uint8_t sequence;
+        size_t block_start;
+        SDOTransfer() : mode(Idle), offset(0), total(0), toggle(false), crc(false), block_size(0), sequence(0), block_start(0) {}
+    };
+    struct SDOServer{
+        can::Header rx, tx;
+        SDOTransfer transfer;
+        can::FrameListenerConstSharedPtr listener;
+    };
+
+    const can::CommInterfaceSharedPtr interface_;
+    const ObjectDictConstSharedPtr dict_;
+    ObjectStorageSharedPtr storage_;
+
+    boost::mutex mutex_;
+    std::atomic<Node::State> state_;
+    std::vector<SDOServer> sdo_servers_;
+    std::vector<PDO> rpdos_, tpdos_;
+    std::atomic<bool> pdos_changed_;
+
+    /// listeners must not be changed from within a frame handler, this is done on the timer thread instead
+    struct Guard{
+        boost::mutex mutex;
+        SimDevice *device;
+        Guard(SimDevice *d) : device(d) {}
+    };
+    const std::shared_ptr<Guard> guard_;
+    const TimerServiceSharedPtr service_;
+    boost::mutex listeners_mutex_;
+    std::map<unsigned int, can::FrameListenerConstSharedPtr> rpdo_listeners_;
+    can::FrameListenerConstSharedPtr nmt_listener_, sync_listener_;
+
+    Timer heartbeat_timer_;
+    std::atomic<uint16_t> heartbeat_ms_;
+
+    std::atomic<uint64_t> sdo_requests_, rpdo_count_, tpdo_count_;
+
+    void handleNMT(const can::Frame &msg);
+    void handleSDO(size_t server, const can::Frame &msg);
+    void handleSync(const can::Frame &msg);
+    void handleRPDO(const can::Frame &msg);
+    void handleWrite(const ObjectDict::Entry &entry, const String &data);
+
+    void bootUp();
+    void switchState(Node::State state);
+    bool sendHeartbeat();
+    void restartHeartbeat();
+
+    void readSDOConfig();
+    void buildPDOs();
+    void updateListeners();
+    void scheduleUpdate(bool build);
+    bool buildPDO(uint16_t comm_index, uint16_t map_index, PDO &pdo);
+    void sendPDO(PDO &pdo);
+
+    ObjectDict::EntryConstSharedPtr findEntry(uint16_t index, uint8_t sub_index, uint32_t &reason);
+    bool readValue(const ObjectDict::Entry &entry, String &data, uint32_t &reason);
+    bool writeValue(const ObjectDict::Entry &entry, const String &data, uint32_t &reason);
+
+    void sendSDO(const SDOServer &server, uint8_t command, uint16_t index, uint8_t sub_index, const uint8_t *payload = 0, size_t len = 0);
+    void abortSDO(SDOServer &server, uint16_t index, uint8_t sub_index, uint32_t reason);
+    void sendUploadBlock(SDOServer &server);
+};
+typedef std::shared_ptr<SimDevice> SimDeviceSharedPtr;
+
+} // namespace canopen
+
+#endif
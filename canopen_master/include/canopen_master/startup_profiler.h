@@ -0,0 +1,57 @@
+#ifndef H_CANOPEN_STARTUP_PROFILER
+#define H_CANOPEN_STARTUP_PROFILER
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/thread/mutex.hpp>
+#include "layer.h"
+
+namespace canopen{
+
+/// wall time and SDO transfers of the startup phases of every node, only the latest run of a phase is kept
+class StartupProfiler{
+public:
+    struct Entry{
+        uint8_t node_id;
+        std::string phase;
+        int64_t ns;
+        uint64_t sdo_transfers;
+    };
+
+    /// measures the enclosing scope, SDO transfers are counted on the calling thread
+    class Phase{
+        StartupProfiler &profiler_;
+        const uint8_t node_id_;
+        const char *const phase_;
+        const boost::chrono::high_resolution_clock::time_point start_;
+        const uint64_t sdo_start_;
+    public:
+        Phase(uint8_t node_id, const char *phase, StartupProfiler &profiler = StartupProfiler::instance());
+        ~Phase();
+    };
+
+    typedef std::function<std::string(uint8_t)> NameFunc;
+
+    static StartupProfiler& instance();
+
+    void add(uint8_t node_id, const std::string &phase, const boost::chrono::high_resolution_clock::duration &d, uint64_t sdo_transfers);
+    /// entries in the order of their first occurrence
+    std::vector<Entry> getEntries() const;
+    void reset();
+
+    /// writes a YAML mapping from node names to their phases and totals
+    void write(std::ostream &os, const NameFunc &name) const;
+    /// adds the total and the slowest phases
+    void report(LayerReport &report, const NameFunc &name, size_t slowest = 5) const;
+
+private:
+    mutable boost::mutex mutex_;
+    std::vector<Entry> entries_;
+};
+
+} // namespace canopen
+
+#endif
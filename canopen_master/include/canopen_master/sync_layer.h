@@ -0,0 +1,192 @@
+#ifndef H_CANOPEN_SYNC_LAYER
+#define H_CANOPEN_SYNC_LAYER
+
+#include <set>
+#include "canopen.h"
+#include "scheduler.h"
+
+namespace canopen{
+
+/// common part of the SYNC layers of the master plugins: node tracking, RPDO barrier, read offset and process image
+class ManagingSyncLayer: public SyncLayer {
+protected:
+    can::CommInterfaceSharedPtr interface_;
+    boost::chrono::milliseconds step_, half_step_;
+
+    std::set<void *> nodes_;
+    boost::mutex nodes_mutex_;
+    std::atomic<size_t> nodes_size_;
+
+    Histogram period_jitter_;
+    const time_duration busy_wait_;
+
+    const bool wait_for_barrier_;
+    std::unique_ptr<AdaptiveOffset> read_offset_;
+    const RPDOBarrierSharedPtr barrier_;
+    std::atomic<uint64_t> barrier_timeouts_;
+
+    const ProcessImageSharedPtr image_;
+
+    /// waits for the read phase, which starts at abs_time or as soon as all synchronous RPDOs have arrived
+    virtual void waitForRead(const time_point &abs_time){
+        if(!wait_for_barrier_){
+            sleep_until_precise(abs_time, busy_wait_);
+        }else if(!barrier_->waitUntil(abs_time)){
+            ++barrier_timeouts_;
+        }
+    }
+    /// offset of the read phase relative to SYNC, has to be called after the barrier was reset for the current SYNC
+    time_duration getReadOffset(){
+        if(!read_offset_) return half_step_;
+
+        time_duration latency;
+        if(barrier_->getPreviousLatency(latency)) read_offset_->update(latency);
+        return read_offset_->get();
+    }
+
+    virtual void handleShutdown(LayerStatus &status) {
+    }
+
+    virtual void handleHalt(LayerStatus &status)  { /* nothing to do */ }
+    virtual void handleDiag(LayerReport &report)  {
+        report.add("sync_nodes", nodes_size_.load());
+        period_jitter_.report(report, "sync_period_jitter");
+        if(wait_for_barrier_){
+            report.add("rpdo_barrier_expected", barrier_->getExpected());
+            report.add("rpdo_barrier_timeouts", barrier_timeouts_.load());
+            report.add("rpdo_barrier_late", barrier_->getLate());
+        }
+        if(read_offset_){
+            read_offset_->report(report, "read_offset");
+        }
+        if(image_){
+            report.add("process_image_size", image_->size());
+            report.add("process_image_cycle", image_->getTag().cycle);
+        }
+    }
+    virtual void handleRecover(LayerStatus &status)  { /* TODO */ }
+
+public:
+    ManagingSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface, const Settings &settings)
+    : SyncLayer(p), interface_(interface), step_(p.period_ms_), half_step_(p.period_ms_/2), nodes_size_(0),
+      busy_wait_(boost::chrono::microseconds(settings.get_optional<unsigned int>("busy_wait_us", 0))),
+      wait_for_barrier_(settings.get_optional<bool>("rpdo_barrier", false)),
+      read_offset_(settings.get_optional<bool>("adaptive_read_offset", false) ? new AdaptiveOffset(half_step_, step_,
+                   boost::chrono::microseconds(settings.get_optional<unsigned int>("read_offset_margin_us", 250)),
+                   boost::chrono::microseconds(settings.get_optional<unsigned int>("read_offset_hysteresis_us", 100))) : 0),
+      barrier_(wait_for_barrier_ || read_offset_ ? std::make_shared<RPDOBarrier>() : RPDOBarrierSharedPtr()),
+      barrier_timeouts_(0),
+      image_(settings.get_optional<bool>("process_image", false) ? std::make_shared<ProcessImage>() : ProcessImageSharedPtr())
+    {
+    }
+
+    virtual RPDOBarrierSharedPtr getRPDOBarrier() { return barrier_; }
+    virtual ProcessImageSharedPtr getProcessImage() { return image_; }
+
+    virtual void addNode(void * const ptr) {
+        boost::mutex::scoped_lock lock(nodes_mutex_);
+        nodes_.insert(ptr);
+        nodes_size_ = nodes_.size();
+    }
+    virtual void removeNode(void * const ptr)  {
+        boost::mutex::scoped_lock lock(nodes_mutex_);
+        nodes_.erase(ptr);
+        nodes_size_ = nodes_.size();
+    }
+};
+
+
+/// produces SYNC on the grid of a PeriodicScheduler
+class SimpleSyncLayer: public ManagingSyncLayer {
+    static PeriodicScheduler::OverrunPolicy parsePolicy(const Settings &settings){
+        try{
+            return PeriodicScheduler::parsePolicy(settings.get_optional<std::string>("overrun_policy", "skip"));
+        }
+        catch(const std::invalid_argument &e){
+            BOOST_THROW_EXCEPTION(Exception(e.what()));
+        }
+    }
+
+    time_point read_time_;
+    uint8_t read_counter_;
+    can::Frame frame_;
+    uint8_t overflow_;
+    PeriodicScheduler scheduler_;
+    time_point last_sync_;
+    Histogram send_duration_;
+
+    void resetCounter(){
+        frame_.data[0] = 1; // SYNC counter starts at 1
+    }
+    void tryUpdateCounter(){
+        if (frame_.dlc > 0) { // sync counter is used
+            if (frame_.data[0] >= overflow_) {
+                resetCounter();
+            }else{
+                ++frame_.data[0];
+            }
+        }
+    }
+protected:
+    /// waits for the next SYNC deadline and returns it
+    virtual time_point waitForDeadline() { return scheduler_.wait(); }
+
+    virtual void handleRead(LayerStatus &status, const LayerState &current_state) {
+        if(current_state > Init){
+            waitForRead(read_time_);
+            if(image_) image_->swap(read_counter_);
+        }
+    }
+    virtual void handleWrite(LayerStatus &status, const LayerState &current_state) {
+        if(current_state > Init){
+            time_point deadline = waitForDeadline();
+            tryUpdateCounter();
+            if(barrier_) barrier_->reset();
+            time_duration read_offset = getReadOffset();
+            if(nodes_size_){ //)
+                time_point start = get_abs_time();
+                CANOPEN_TRACE_INSTANT("SYNC TX", frame_.dlc > 0 ? frame_.data[0] : 0);
+                interface_->send(frame_);
+                send_duration_.record(get_abs_time() - start);
+                if(last_sync_ != time_point()){
+                    time_duration diff = (start - last_sync_) - step_;
+                    period_jitter_.record(diff < time_duration::zero() ? -diff : diff);
+                }
+                last_sync_ = start;
+            }else{
+                last_sync_ = time_point();
+            }
+            read_time_ = deadline + read_offset;
+            read_counter_ = frame_.dlc > 0 ? frame_.data[0] : 0;
+        }
+    }
+
+    virtual void handleInit(LayerStatus &status){
+        time_point now = get_abs_time();
+        scheduler_.start(now);
+        read_time_ = now + half_step_;
+        read_counter_ = 0;
+        last_sync_ = time_point();
+    }
+    virtual void handleDiag(LayerReport &report){
+        ManagingSyncLayer::handleDiag(report);
+        scheduler_.report(report, "sync_timer");
+        send_duration_.report(report, "sync_send");
+    }
+public:
+    SimpleSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface, const Settings &settings)
+    : ManagingSyncLayer(p, interface, settings), frame_(p.header_, 0), overflow_(p.overflow_),
+      scheduler_(boost::chrono::milliseconds(p.period_ms_), busy_wait_, parsePolicy(settings)) {
+        if(overflow_ == 1 || overflow_ > 240){
+            BOOST_THROW_EXCEPTION(Exception("SYNC counter overflow is invalid"));
+        }else if(overflow_ > 1){
+            frame_.dlc = 1;
+            resetCounter();
+        }
+    }
+    const PeriodicScheduler& getScheduler() const { return scheduler_; }
+};
+
+} // namespace canopen
+
+#endif
@@ -6,66 +6,118 @@
 
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 #include <boost/asio/high_resolution_timer.hpp>
 
 #include <socketcan_interface/delegates.h>
 
+#include "histogram.h"
+
 namespace canopen{
 
+/// single thread that runs the handlers of all timers, delegates should return quickly
+class TimerService{
+public:
+    typedef boost::asio::basic_waitable_timer<boost::chrono::high_resolution_clock> WaitableTimer;
+
+    /// process-wide instance, created on first use and kept alive by its timers
+    static std::shared_ptr<TimerService> instance();
+    /// separate service with its own thread, it may be released from one of its handlers
+    static std::shared_ptr<TimerService> create();
+
+    boost::asio::io_service& getIOService() { return io_; }
+
+    /// lateness of all timers handled by this service
+    const Histogram& getLateness() const { return lateness_; }
+    void recordLateness(const boost::chrono::high_resolution_clock::duration &d) { lateness_.record(d); }
+
+private:
+    TimerService();
+    ~TimerService();
+    static void release(TimerService *service);
+
+    boost::asio::io_service io_;
+    boost::asio::io_service::work work_;
+    Histogram lateness_;
+    boost::thread thread_;
+};
+typedef std::shared_ptr<TimerService> TimerServiceSharedPtr;
+
+/// lightweight handle to a periodic timer in the shared TimerService
 class Timer{
 public:
     using TimerFunc = std::function<bool(void)>;
     using TimerDelegate [[deprecated("use TimerFunc instead")]] = can::DelegateHelper<TimerFunc>;
 
-    Timer():work(io), timer(io),thread(std::bind(
-        static_cast<size_t(boost::asio::io_service::*)(void)>(&boost::asio::io_service::run), &io))
-    {
-    }
+    Timer(const TimerServiceSharedPtr &service = TimerService::instance())
+    : service_(service), state_(std::make_shared<State>(service_->getIOService())) {}
 
     void stop(){
-        boost::mutex::scoped_lock lock(mutex);
-        timer.cancel();
+        boost::recursive_mutex::scoped_lock lock(state_->mutex);
+        ++state_->generation;
+        state_->timer.cancel();
     }
     template<typename T> void start(const TimerFunc &del, const  T &dur, bool start_now = true){
-        boost::mutex::scoped_lock lock(mutex);
-        delegate = del;
-        period = boost::chrono::duration_cast<boost::chrono::high_resolution_clock::duration>(dur);
+        boost::recursive_mutex::scoped_lock lock(state_->mutex);
+        state_->delegate = std::make_shared<TimerFunc>(del);
+        state_->period = boost::chrono::duration_cast<boost::chrono::high_resolution_clock::duration>(dur);
+        ++state_->generation;
         if(start_now){
-            timer.expires_from_now(period);
-            timer.async_wait(std::bind(&Timer::handler, this, std::placeholders::_1));
+            arm(state_, state_->period);
         }
     }
     void restart(){
-        boost::mutex::scoped_lock lock(mutex);
-        timer.expires_from_now(period);
-        timer.async_wait(std::bind(&Timer::handler, this, std::placeholders::_1));
+        boost::recursive_mutex::scoped_lock lock(state_->mutex);
+        ++state_->generation;
+        arm(state_, state_->period);
     }
     const  boost::chrono::high_resolution_clock::duration & getPeriod(){
-        boost::mutex::scoped_lock lock(mutex);
-        return period;
+        boost::recursive_mutex::scoped_lock lock(state_->mutex);
+        return state_->period;
     }
+    /// time between expiry and invocation of the delegate
+    const Histogram& getLateness() const { return state_->lateness; }
+
+    /// waits for a running delegate, unless it is called by the delegate itself
     ~Timer(){
-        io.stop();
-        thread.join();
+        boost::recursive_mutex::scoped_lock lock(state_->mutex);
+        state_->delegate.reset();
+        ++state_->generation;
+        state_->timer.cancel();
     }
 
 private:
-    boost::asio::io_service io;
-    boost::asio::io_service::work work;
-    boost::asio::basic_waitable_timer<boost::chrono::high_resolution_clock> timer;
-    boost::chrono::high_resolution_clock::duration period;
-    boost::mutex mutex;
-    boost::thread thread;
-
-    TimerFunc delegate;
-    void handler(const boost::system::error_code& ec){
+    struct State{
+        TimerService::WaitableTimer timer;
+        boost::chrono::high_resolution_clock::duration period;
+        boost::recursive_mutex mutex; ///< held while the delegate runs, so the delegate may stop or destroy its timer
+        std::shared_ptr<const TimerFunc> delegate; ///< stays alive while it runs, even if the timer is destroyed meanwhile
+        uint64_t generation; ///< changed by every call that (re)arms or stops the timer
+        Histogram lateness;
+        State(boost::asio::io_service &io) : timer(io), period(0), generation(0) {}
+    };
+    typedef std::shared_ptr<State> StateSharedPtr;
+
+    const TimerServiceSharedPtr service_;
+    const StateSharedPtr state_; ///< outlives the handle while a handler is pending
+
+    void arm(const StateSharedPtr &state, const boost::chrono::high_resolution_clock::duration &d){
+        state->timer.expires_from_now(d);
+        state->timer.async_wait(std::bind(&Timer::handler, service_, state, std::placeholders::_1));
+    }
+    /// holds the service, so it is not torn down by a delegate that releases the last timer
+    static void handler(const TimerServiceSharedPtr &service, const StateSharedPtr &state, const boost::system::error_code& ec){
         if(!ec){
-            boost::mutex::scoped_lock lock(mutex);
-            if(delegate && delegate()){
-                timer.expires_at(timer.expires_at() + period);
-                timer.async_wait(std::bind(&Timer::handler, this, std::placeholders::_1));
+            boost::recursive_mutex::scoped_lock lock(state->mutex);
+            boost::chrono::high_resolution_clock::duration late = boost::chrono::high_resolution_clock::now() - state->timer.expires_at();
+            state->lateness.record(late);
+            service->recordLateness(late);
+            const std::shared_ptr<const TimerFunc> delegate = state->delegate;
+            const uint64_t generation = state->generation;
+            if(delegate && (*delegate)() && generation == state->generation){
+                state->timer.expires_at(state->timer.expires_at() + state->period);
+                state->timer.async_wait(std::bind(&Timer::handler, service, state, std::placeholders::_1));
             }
-
         }
     }
 };
@@ -0,0 +1,107 @@
+#ifndef H_CANOPEN_TRACE
+#define H_CANOPEN_TRACE
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <boost/chrono/system_clocks.hpp>
+
+namespace canopen{
+
+/// flight recorder with one lock-free ring per thread, can be dumped in the Chrome trace event format
+class TraceRecorder{
+public:
+    enum Phase : uint8_t { Begin = 'B', End = 'E', Instant = 'i' };
+    static const size_t RING_SIZE = 4096; ///< events per thread, must be a power of two
+    static const size_t MAX_EXITED_RINGS = 16; ///< rings of ended threads that are kept until they get dumped or cleared
+
+    struct Event{
+        int64_t ns;
+        uint32_t arg;
+        uint16_t name;
+        uint8_t phase;
+        uint8_t has_arg;
+    };
+
+    /// one event, seq is position + 1 once the slot is complete and 0 while it is written
+    struct Slot{
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> ns;
+        std::atomic<uint64_t> data; ///< arg, name, phase and has_arg
+        Slot() : seq(0), ns(0), data(0) {}
+    };
+
+    struct Ring{
+        std::array<Slot, RING_SIZE> slots;
+        std::atomic<uint64_t> head; ///< only written by the owning thread
+        std::atomic<uint64_t> cleared; ///< events before this position were dropped by clear()
+        std::atomic<bool> exited; ///< the owning thread has ended, no more events will be added
+        uint32_t tid;
+        Ring(uint32_t t) : head(0), cleared(0), exited(false), tid(t) {}
+        /// copies the event at pos, fails if it was not written yet or was overwritten meanwhile
+        bool read(uint64_t pos, Event &e) const;
+    };
+
+    static bool enabled() { return enabled_flag().load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { enabled_flag().store(enabled); }
+
+    /// returns a stable id for the name, takes a lock, so call it once and keep the id
+    static uint16_t intern(const std::string &name);
+    /// interns name on first use, id has to be initialised to -1
+    static uint16_t intern(std::atomic<int> &id, const std::string &name){
+        int i = id.load(std::memory_order_acquire);
+        if(i < 0){
+            i = intern(name);
+            id.store(i, std::memory_order_release);
+        }
+        return i;
+    }
+
+    static void record(uint16_t name, Phase phase){
+        if(enabled()) push(name, phase, 0, false);
+    }
+    static void record(uint16_t name, Phase phase, uint32_t arg){
+        if(enabled()) push(name, phase, arg, true);
+    }
+
+    /// writes all retained events as Chrome/Perfetto JSON, can run concurrently with recording threads.
+    /// The rings of threads that have ended are released afterwards.
+    static void dump(std::ostream &os);
+    static bool dump(const std::string &path);
+    /// drops all events recorded so far and the rings of threads that have ended, does not touch the rings of the recording threads
+    static void clear();
+
+    class Scope{
+        const uint16_t name_;
+    public:
+        Scope(uint16_t name) : name_(name) { record(name_, Begin); }
+        ~Scope() { record(name_, End); }
+    };
+
+private:
+    static std::atomic<bool>& enabled_flag() { static std::atomic<bool> flag(false); return flag; }
+    static Ring& ring();
+    static void push(uint16_t name, Phase phase, uint32_t arg, bool has_arg){
+        Ring &r = ring();
+        uint64_t head = r.head.load(std::memory_order_relaxed);
+        Slot &slot = r.slots[head & (RING_SIZE - 1)];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.ns.store(boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::high_resolution_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+        slot.data.store(uint64_t(arg) << 32 | uint64_t(name) << 16 | uint64_t(phase) << 8 | uint64_t(has_arg), std::memory_order_relaxed);
+        slot.seq.store(head + 1, std::memory_order_release);
+        r.head.store(head + 1, std::memory_order_release);
+    }
+};
+
+} // namespace canopen
+
+/// records an instant event with a static name and a numeric argument
+#define CANOPEN_TRACE_INSTANT(name, arg) { \
+    static const uint16_t canopen_trace_id_ = canopen::TraceRecorder::intern(name); \
+    canopen::TraceRecorder::record(canopen_trace_id_, canopen::TraceRecorder::Instant, arg); }
+
+#endif
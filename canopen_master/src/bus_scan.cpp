@@ -0,0 +1,109 @@
+#include <canopen_master/node_list.h>
+#include <canopen_master/scanner.h>
+#include <canopen_master/sim_device.h>
+#include <socketcan_interface/dummy.h>
+#include <socketcan_interface/socketcan.h>
+
+#include <iomanip>
+#include <iostream>
+
+using namespace canopen;
+
+namespace {
+
+/// device type and identity for the simulated nodes
+ObjectDictSharedPtr makeSimDict(uint8_t node_id){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x1000, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x20192))));
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x1017, ObjectDict::DEFTYPE_UNSIGNED16, "", true, true, false, HoldAny(uint16_t(100))));
+    const uint32_t identity[] = { 0x0000009A, 0x00030924, 0x00010000, 0x1000u + node_id };
+    for(uint8_t sub = 1; sub <= 4; ++sub){
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1018, sub, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(identity[sub - 1])));
+    }
+    return dict;
+}
+
+std::string hex(uint32_t val){
+    std::stringstream sstr;
+    sstr << "0x" << std::hex << std::setw(8) << std::setfill('0') << val;
+    return sstr.str();
+}
+
+}
+
+int main(int argc, char** argv){
+    std::string device, range = "1-127", sim_nodes = "1,2,3";
+    int window_ms = 50, listen_ms = -1;
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(i + 1 < argc && (arg == "-r" || arg == "--range")) range = argv[++i];
+        else if(i + 1 < argc && (arg == "-w" || arg == "--window")) window_ms = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-l" || arg == "--listen")) listen_ms = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-n" || arg == "--sim-nodes")) sim_nodes = argv[++i];
+        else if(device.empty() && arg[0] != '-') device = arg;
+        else{
+            device.clear();
+            break;
+        }
+    }
+    std::vector<unsigned int> ids, sim_ids;
+    if(device.empty() || window_ms <= 0 || !parseNodeList(range, ids) || !parseNodeList(sim_nodes, sim_ids)){
+        std::cout << "Usage: " << argv[0] << " DEVICE [-r FIRST-LAST] [-w WINDOW_MS] [-l LISTEN_MS] [-n SIM_NODES]" << std::endl;
+        std::cout << "  DEVICE: SocketCAN device or 'sim' for simulated nodes SIM_NODES (default: " << sim_nodes << ")" << std::endl;
+        std::cout << "  FIRST-LAST: range of node ids to scan (default: " << range << ")" << std::endl;
+        std::cout << "  WINDOW_MS: time to wait for each response (default: " << window_ms << ")" << std::endl;
+        std::cout << "  LISTEN_MS: collect heartbeats and boot-ups for at least this long, e.g. while powering on" << std::endl;
+        std::cout << "Prints one CSV line per node that was found." << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<can::DummyBus> bus;
+    can::ThreadedDummyInterfaceSharedPtr sim_interface;
+    std::vector<SimDeviceSharedPtr> devices;
+    can::DriverInterfaceSharedPtr interface;
+
+    const bool sim = device == "sim";
+    if(sim){
+        bus = std::make_shared<can::DummyBus>("bus_scan");
+        sim_interface = std::make_shared<can::ThreadedDummyInterface>();
+        sim_interface->init(bus->name, false, can::NoSettings::create());
+        for(unsigned int id: sim_ids){
+            devices.push_back(std::make_shared<SimDevice>(sim_interface, makeSimDict(id), id));
+            devices.back()->start();
+        }
+        interface = std::make_shared<can::ThreadedDummyInterface>();
+    }else{
+        interface = std::make_shared<can::ThreadedSocketCANInterface>();
+    }
+    if(!interface->init(sim ? bus->name : device, false, can::NoSettings::create())){
+        std::cout << "could not open " << device << std::endl;
+        return 1;
+    }
+
+    BusScanner scanner(interface, boost::chrono::milliseconds(window_ms));
+    time_point start = get_abs_time();
+    BusScanner::Devices found = scanner.scan(ids.front(), ids.back(), listen_ms >= 0, boost::chrono::milliseconds(std::max(listen_ms, 0)));
+    double scan_ms = boost::chrono::duration_cast<boost::chrono::duration<double, boost::milli> >(get_abs_time() - start).count();
+
+    std::cout << "node,sdo,heartbeat,boot_up,state,device_type,vendor_id,product_code,revision,serial,response_us" << std::endl;
+    for(BusScanner::Devices::const_iterator it = found.begin(); it != found.end(); ++it){
+        const BusScanner::Device &d = it->second;
+        std::cout << int(d.node_id) << "," << d.sdo << "," << d.heartbeat << "," << d.boot_up << ",";
+        if(d.heartbeat) std::cout << int(d.state);
+        std::cout << "," << (d.sdo ? hex(d.device_type) : "");
+        const uint32_t identity[] = { d.vendor_id, d.product_code, d.revision, d.serial };
+        for(uint8_t i = 0; i < 4; ++i){
+            std::cout << "," << (i < d.identity ? hex(identity[i]) : "");
+        }
+        std::cout << "," << boost::chrono::duration_cast<boost::chrono::microseconds>(d.response_time).count() << std::endl;
+    }
+    std::cerr << found.size() << " node(s) found in " << scan_ms << " ms" << std::endl;
+
+    devices.clear();
+    interface->shutdown();
+    if(sim_interface) sim_interface->shutdown();
+    return 0;
+}
@@ -0,0 +1,341 @@
+#include <canopen_master/can_layer.h>
+#include <canopen_master/canopen.h>
+#include <canopen_master/node_list.h>
+#include <canopen_master/parallel_layer.h>
+#include <canopen_master/scheduler.h>
+#include <canopen_master/sdo_monitor.h>
+#include <canopen_master/sim_device.h>
+#include <canopen_master/sync_layer.h>
+#include <socketcan_interface/dummy.h>
+
+#include <pthread.h>
+#include <time.h>
+#include <future>
+#include <iostream>
+
+using namespace canopen;
+
+namespace {
+
+int64_t to_ns(const time_duration &d){
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(d).count();
+}
+int64_t now_ns(){
+    return to_ns(get_abs_time().time_since_epoch());
+}
+int64_t cpu_ns(clockid_t clock){
+    timespec ts;
+    if(clock_gettime(clock, &ts) != 0) return 0;
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+/// CPU time of the threads of the simulation, clocks that fell back to the whole process are skipped
+int64_t sim_cpu_ns(const std::vector<clockid_t> &clocks){
+    int64_t sum = 0;
+    for(clockid_t c: clocks){
+        if(c != CLOCK_PROCESS_CPUTIME_ID) sum += cpu_ns(c);
+    }
+    return sum;
+}
+/// CPU clock of the thread of the service, CLOCK_PROCESS_CPUTIME_ID if it is not available
+clockid_t service_clock(const TimerServiceSharedPtr &service){
+    std::promise<clockid_t> clock;
+    service->getIOService().post([&clock](){
+        clockid_t c;
+        clock.set_value(pthread_getcpuclockid(pthread_self(), &c) == 0 ? c : CLOCK_PROCESS_CPUTIME_ID);
+    });
+    return clock.get_future().get();
+}
+
+/// the SimpleSyncLayer of the master plugin, tracks the time spent waiting and the time of the last SYNC
+class BenchSyncLayer: public SimpleSyncLayer{
+    time_duration idle_;
+    std::atomic<int64_t> sync_ns_;
+protected:
+    virtual void waitForRead(const time_point &abs_time){
+        time_point start = get_abs_time();
+        SimpleSyncLayer::waitForRead(abs_time);
+        idle_ += get_abs_time() - start;
+    }
+    virtual time_point waitForDeadline(){
+        time_point start = get_abs_time();
+        time_point deadline = SimpleSyncLayer::waitForDeadline();
+        idle_ += get_abs_time() - start;
+        sync_ns_ = now_ns(); // the SYNC gets sent right after this
+        return deadline;
+    }
+public:
+    BenchSyncLayer(const SyncProperties &p, const can::CommInterfaceSharedPtr &interface, const can::Settings &settings)
+    : SimpleSyncLayer(p, interface, settings), idle_(time_duration::zero()), sync_ns_(0) {}
+
+    int64_t getSyncTime() const { return sync_ns_; }
+    /// returns the time spent waiting since the last call
+    time_duration takeIdle(){
+        time_duration idle = idle_;
+        idle_ = time_duration::zero();
+        return idle;
+    }
+};
+
+void addVar(const ObjectDictSharedPtr &dict, uint16_t index, uint16_t type, const HoldAny &def, bool writable, const HoldAny &init = HoldAny()){
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, index, type, "", true, writable, true, def, init));
+}
+void addSub(const ObjectDictSharedPtr &dict, uint16_t index, uint8_t sub_index, uint16_t type, const HoldAny &def, const HoldAny &init = HoldAny()){
+    dict->insert(true, std::make_shared<const ObjectDict::Entry>(index, sub_index, type, "", true, true, false, def, init));
+}
+
+/// minimal drive: controlword in one RPDO, statusword in one TPDO, both synchronous.
+/// The master side configures heartbeat and PDO mappings at start-up, like a real device description would.
+ObjectDictSharedPtr makeDict(uint8_t node_id, bool master){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 1;
+    info.nr_of_tx_pdo = 1;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+
+    addVar(dict, 0x1001, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(0)), false);
+    addVar(dict, 0x1014, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x80 + node_id)), false);
+    addVar(dict, 0x1017, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)), true, master ? HoldAny(uint16_t(100)) : HoldAny());
+    addVar(dict, 0x6040, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)), true);
+    addVar(dict, 0x6041, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0x0237)), false);
+
+    const HoldAny rpdo_map(uint32_t(0x60400010)), tpdo_map(uint32_t(0x60410010));
+    addSub(dict, 0x1400, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(2)));
+    addSub(dict, 0x1400, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x200 + node_id)));
+    addSub(dict, 0x1400, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    addSub(dict, 0x1600, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    addSub(dict, 0x1600, 1, ObjectDict::DEFTYPE_UNSIGNED32, rpdo_map, master ? rpdo_map : HoldAny());
+
+    addSub(dict, 0x1800, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(2)));
+    addSub(dict, 0x1800, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x180 + node_id)));
+    addSub(dict, 0x1800, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    addSub(dict, 0x1A00, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    addSub(dict, 0x1A00, 1, ObjectDict::DEFTYPE_UNSIGNED32, tpdo_map, master ? tpdo_map : HoldAny());
+    return dict;
+}
+
+struct Options{
+    std::vector<unsigned int> nodes;
+    std::vector<unsigned int> threads; ///< threads that process the nodes, 1 runs them sequentially
+    unsigned int period_ms;
+    unsigned int cycles;
+    unsigned int warmup;
+    can::SettingsMap sync_settings; ///< like the sync settings of RosChain, e.g. rpdo_barrier or process_image
+    Options() : period_ms(10), cycles(500), warmup(20) {}
+};
+
+/// all values in microseconds unless stated otherwise
+struct Result{
+    unsigned int nodes;
+    unsigned int threads;
+    bool init_ok;
+    double init_ms;
+    uint64_t init_sdo;
+    Histogram cycle, sync_jitter, tpdo_latency, rpdo_latency;
+    uint64_t cycle_errors, overruns, tpdo_lost, rpdo_lost;
+    double cpu_us_per_node_cycle, cpu_percent;
+    Result(unsigned int n, unsigned int t) : nodes(n), threads(t), init_ok(false), init_ms(0), init_sdo(0), cycle_errors(0), overruns(0), tpdo_lost(0), rpdo_lost(0),
+        cpu_us_per_node_cycle(0), cpu_percent(0) {}
+};
+
+void printHeader(){
+    std::cout << "nodes,threads,period_ms,cycles,init_ok,init_ms,init_sdo"
+              << ",cycle_mean_us,cycle_p99_us,cycle_max_us"
+              << ",sync_jitter_mean_us,sync_jitter_p99_us,sync_jitter_max_us"
+              << ",tpdo_latency_mean_us,tpdo_latency_p99_us,tpdo_latency_max_us,tpdo_lost"
+              << ",rpdo_latency_mean_us,rpdo_latency_p99_us,rpdo_latency_max_us,rpdo_lost"
+              << ",cycle_errors,overruns,cpu_us_per_node_cycle,cpu_percent" << std::endl;
+}
+void printHistogram(const Histogram &h){
+    std::cout << "," << h.mean() / 1000.0 << "," << h.percentile(0.99) / 1000.0 << "," << h.max() / 1000.0;
+}
+void printResult(const Options &opt, const Result &r){
+    std::cout << r.nodes << "," << r.threads << "," << opt.period_ms << "," << opt.cycles << "," << r.init_ok << "," << r.init_ms << "," << r.init_sdo;
+    printHistogram(r.cycle);
+    printHistogram(r.sync_jitter);
+    printHistogram(r.tpdo_latency);
+    std::cout << "," << r.tpdo_lost;
+    printHistogram(r.rpdo_latency);
+    std::cout << "," << r.rpdo_lost;
+    std::cout << "," << r.cycle_errors << "," << r.overruns << "," << r.cpu_us_per_node_cycle << "," << r.cpu_percent << std::endl;
+}
+
+/// builds the stack like RosChain does (CAN, SYNC, 301 layer, EMCY layer) against simulated nodes on a virtual bus
+void run(const Options &opt, Result &r){
+    const std::string name = "chain_bench_" + std::to_string(r.nodes) + "_" + std::to_string(r.threads);
+    can::DummyBus bus(name);
+
+    // the sync layer checks its settings, so it is created before any thread runs
+    can::DummyInterfaceSharedPtr interface = std::make_shared<can::DummyInterface>();
+    std::shared_ptr<BenchSyncLayer> sync = std::make_shared<BenchSyncLayer>(SyncProperties(can::MsgHeader(0x80), opt.period_ms, 0), interface, opt.sync_settings);
+
+    // all simulated devices share one receive thread and one timer thread, both are excluded from the CPU time
+    can::DummyInterfaceSharedPtr sim_interface = std::make_shared<can::DummyInterface>();
+    sim_interface->init(bus.name, false, can::NoSettings::create());
+    boost::thread sim_thread(&can::DummyInterface::run, sim_interface);
+    std::vector<clockid_t> sim_clocks(1);
+    if(pthread_getcpuclockid(sim_thread.native_handle(), &sim_clocks[0]) != 0) sim_clocks[0] = CLOCK_PROCESS_CPUTIME_ID;
+    TimerServiceSharedPtr sim_service = TimerService::create(); // heartbeats of the devices
+    sim_clocks.push_back(service_clock(sim_service));
+
+    std::vector<SimDeviceSharedPtr> devices;
+    for(unsigned int id = 1; id <= r.nodes; ++id){
+        devices.push_back(std::make_shared<SimDevice>(sim_interface, makeDict(id, false), id, sim_service));
+        devices.back()->start();
+    }
+
+    // like parallel_threads of RosChain, the calling thread processes nodes as well
+    std::shared_ptr<LayerGroupNoDiag<Node> > nodes = r.threads > 1 ? std::make_shared<ParallelLayerGroup<Node> >("301 layer", r.threads - 1)
+                                                                   : std::make_shared<LayerGroupNoDiag<Node> >("301 layer");
+    std::shared_ptr<LayerGroupNoDiag<EMCYHandler> > emcy_handlers = std::make_shared<LayerGroupNoDiag<EMCYHandler> >("EMCY layer");
+    std::vector<ObjectStorage::Entry<uint16_t> > controlwords, statuswords;
+
+    LayerStack stack("chain bench");
+    stack.add(std::make_shared<CANLayer>(interface, bus.name, false, can::NoSettings::create()));
+    stack.add(sync);
+    stack.add(nodes);
+    stack.add(emcy_handlers);
+    for(unsigned int id = 1; id <= r.nodes; ++id){
+        NodeSharedPtr node = std::make_shared<Node>(interface, makeDict(id, true), id, sync);
+        nodes->add(node);
+        emcy_handlers->add(std::make_shared<EMCYHandler>(interface, node->getStorage()));
+        controlwords.push_back(node->getStorage()->entry<uint16_t>(0x6040));
+        statuswords.push_back(node->getStorage()->entry<uint16_t>(0x6041));
+    }
+
+    // probes, TPDO latency is taken at the master, RPDO latency and SYNC jitter at the devices
+    std::atomic<int64_t> write_ns(0);
+    int64_t last_sync = 0;
+    std::atomic<uint64_t> tpdos(0), rpdos(0);
+    const int64_t period_ns = int64_t(opt.period_ms) * 1000000;
+    can::FrameListenerConstSharedPtr master_probe = interface->createMsgListener([&](const can::Frame &msg){
+        if(msg.id > 0x180 && msg.id < 0x200){
+            r.tpdo_latency.record(now_ns() - sync->getSyncTime());
+            ++tpdos;
+        }
+    });
+    can::FrameListenerConstSharedPtr device_probe = sim_interface->createMsgListener([&](const can::Frame &msg){
+        int64_t now = now_ns();
+        if(msg.id == 0x80){
+            if(last_sync) r.sync_jitter.record(std::abs(now - last_sync - period_ns));
+            last_sync = now;
+        }else if(msg.id > 0x200 && msg.id < 0x280){
+            r.rpdo_latency.record(now - write_ns);
+            ++rpdos;
+        }
+    });
+
+    LayerStatus status;
+    {
+        uint64_t sdo_start = SDOAccessMonitor::getThreadCount();
+        time_point start = get_abs_time();
+        stack.init(status);
+        r.init_ms = to_ns(get_abs_time() - start) / 1e6;
+        r.init_sdo = SDOAccessMonitor::getThreadCount() - sdo_start;
+        r.init_ok = status.bounded<LayerStatus::Warn>();
+    }
+
+    if(r.init_ok){
+        int64_t cpu_start = 0, sim_cpu_start = 0, wall_start = 0;
+        for(unsigned int cycle = 0; cycle < opt.warmup + opt.cycles; ++cycle){
+            if(cycle == opt.warmup){ // listeners of the devices have been updated, start measuring
+                r.cycle.reset();
+                r.sync_jitter.reset();
+                r.tpdo_latency.reset();
+                r.rpdo_latency.reset();
+                r.cycle_errors = 0;
+                tpdos = 0;
+                rpdos = 0;
+                cpu_start = cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+                sim_cpu_start = sim_cpu_ns(sim_clocks);
+                wall_start = now_ns();
+            }
+            LayerStatus cycle_status;
+            time_point start = get_abs_time();
+            stack.read(cycle_status);
+            for(size_t i = 0; i < statuswords.size(); ++i){
+                uint16_t val;
+                statuswords[i].get_cached(val);
+                controlwords[i].set_cached(uint16_t(cycle)); // changes every cycle, so each RPDO is sent
+            }
+            write_ns = now_ns();
+            stack.write(cycle_status);
+            r.cycle.record(get_abs_time() - start - sync->takeIdle());
+            if(!cycle_status.bounded<LayerStatus::Warn>()) ++r.cycle_errors;
+        }
+        int64_t cpu = (cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start) - (sim_cpu_ns(sim_clocks) - sim_cpu_start);
+        int64_t wall = now_ns() - wall_start;
+        r.cpu_us_per_node_cycle = cpu / 1000.0 / opt.cycles / r.nodes;
+        r.cpu_percent = wall > 0 ? 100.0 * cpu / wall : 0;
+        r.overruns = sync->getScheduler().getOverruns();
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(opt.period_ms)); // let the last PDOs arrive
+        uint64_t expected = uint64_t(opt.cycles) * r.nodes;
+        r.tpdo_lost = expected > tpdos ? expected - tpdos : 0;
+        r.rpdo_lost = expected > rpdos ? expected - rpdos : 0;
+    }
+
+    master_probe.reset();
+    device_probe.reset();
+    LayerStatus shutdown_status;
+    stack.shutdown(shutdown_status);
+    devices.clear();
+    sim_interface->shutdown();
+    sim_thread.join();
+}
+
+}
+
+int main(int argc, char** argv){
+    Options opt;
+    std::string nodes = "1,2,4,8,16,32,64,127";
+    std::string threads = "1";
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(i + 1 < argc && (arg == "-n" || arg == "--nodes")) nodes = argv[++i];
+        else if(i + 1 < argc && (arg == "-t" || arg == "--threads")) threads = argv[++i];
+        else if(i + 1 < argc && (arg == "-p" || arg == "--period")) opt.period_ms = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-c" || arg == "--cycles")) opt.cycles = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-w" || arg == "--warmup")) opt.warmup = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-s" || arg == "--sync") && std::string(argv[i + 1]).find('=') != std::string::npos){
+            std::string setting = argv[++i];
+            size_t eq = setting.find('=');
+            opt.sync_settings.set(setting.substr(0, eq), setting.substr(eq + 1));
+        }
+        else{
+            std::cout << "Usage: " << argv[0] << " [-n NODES] [-t THREADS] [-p PERIOD_MS] [-c CYCLES] [-w WARMUP_CYCLES] [-s NAME=VALUE]..." << std::endl;
+            std::cout << "  NODES: list of chain sizes, e.g. 1,8,16-32,127 (default: " << nodes << ")" << std::endl;
+            std::cout << "  THREADS: list of thread counts for the 301 layer, 1 is sequential, e.g. 1-8 (default: " << threads << ")" << std::endl;
+            std::cout << "  NAME=VALUE: setting of the SYNC layer, e.g. rpdo_barrier=1, adaptive_read_offset=1 or process_image=1" << std::endl;
+            std::cout << "Prints one CSV line per chain size and thread count, times in microseconds." << std::endl;
+            return 1;
+        }
+    }
+    if(!parseNodeList(nodes, opt.nodes)){
+        std::cout << "node list is invalid: " << nodes << std::endl;
+        return 1;
+    }
+    if(!parseNodeList(threads, opt.threads)){ // same syntax and range
+        std::cout << "thread list is invalid: " << threads << std::endl;
+        return 1;
+    }
+    if(opt.period_ms == 0 || opt.cycles == 0){
+        std::cout << "period and cycles must be positive" << std::endl;
+        return 1;
+    }
+
+    printHeader();
+    bool ok = true;
+    for(unsigned int n: opt.nodes){
+        for(unsigned int t: opt.threads){
+            Result r(n, t);
+            try{
+                run(opt, r);
+            }
+            catch(const std::exception &e){ // invalid sync settings
+                std::cout << e.what() << std::endl;
+                return 1;
+            }
+            printResult(opt, r);
+            ok = ok && r.init_ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
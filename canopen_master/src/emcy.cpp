@@ -1,8 +1,11 @@
 #include <canopen_master/canopen.h>
+#include <canopen_master/startup_profiler.h>
 #include <socketcan_interface/string.h>
 
 using namespace canopen;
 
+static const StatusCode EMCY_ERROR("Node has emergency error");
+
 #pragma pack(push) /* push current alignment to stack */
 #pragma pack(1) /* set alignment to 1 byte boundary */
 
@@ -47,10 +50,13 @@ void EMCYHandler::handleEMCY(const can::Frame & msg){
     } else {
         ROSCANOPEN_ERROR("canopen_master", "EMCY received: " << msg);
     }
+    history_.push(em.data.error_code, em.data.error_register, em.data.manufacturer_specific_error_field);
+    cached_register_ = em.data.error_register;
     has_error_ = (em.data.error_register & ~32) != 0;
 }
 
-EMCYHandler::EMCYHandler(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr storage): Layer("EMCY handler"), storage_(storage), has_error_(true){
+EMCYHandler::EMCYHandler(const can::CommInterfaceSharedPtr interface, const ObjectStorageSharedPtr storage)
+: Layer("EMCY handler"), storage_(storage), has_error_(true), cached_register_(-1), reset_index_(0){
     storage_->entry(error_register_, 0x1001);
     try{
         storage_->entry(num_errors_, 0x1003,0);
@@ -72,7 +78,7 @@ EMCYHandler::EMCYHandler(const can::CommInterfaceSharedPtr interface, const Obje
 void EMCYHandler::handleRead(LayerStatus &status, const LayerState &current_state) {
     if(current_state == Ready){
         if(has_error_){
-            status.error("Node has emergency error");
+            status.error(EMCY_ERROR);
         }
     }
 }
@@ -80,9 +86,53 @@ void EMCYHandler::handleWrite(LayerStatus &status, const LayerState &current_sta
     // noithing to do
 }
 
+bool EMCYHandler::readErrorRegister(uint8_t &error_register){
+    if(!error_register_.get(error_register)) return false;
+    cached_register_ = error_register;
+    return true;
+}
+
 void EMCYHandler::handleDiag(LayerReport &report){
+    if(!emcy_listener_){ // no EMCY messages, nothing to cache
+        readDeviceErrors(report);
+        return;
+    }
+
+    int cached = cached_register_;
+    uint8_t error_register = 0;
+    if(cached >= 0){
+        error_register = cached;
+    }else if(!readErrorRegister(error_register)){
+        report.error("Could not read error error_register");
+        return;
+    }
+
+    report.add("emcy_count", history_.count());
+    if(error_register){
+        if(error_register & 1){ // first bit should be set on all errors
+            report.error("Node has emergency error");
+        }else if(error_register & ~32){ // filter profile-specific bit
+            report.warn("Error register is not zero");
+        }
+        report.add("error_register", (uint32_t) error_register);
+
+        std::vector<EMCYHistory::Entry> entries = history_.get(reset_index_);
+        std::stringstream buf;
+        for(std::vector<EMCYHistory::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it){
+            if(it->error_code == 0){ // error reset
+                buf.str("");
+                continue;
+            }
+            if(buf.tellp() > 0) buf << ", ";
+            buf << std::hex << it->error_code << "#" << can::buffer2hex(std::string(reinterpret_cast<const char*>(it->manufacturer_specific), sizeof(it->manufacturer_specific)), false);
+        }
+        report.add("errors", buf.str());
+    }
+}
+
+void EMCYHandler::readDeviceErrors(LayerReport &report){
     uint8_t error_register = 0;
-    if(!error_register_.get(error_register)){
+    if(!readErrorRegister(error_register)){
         report.error("Could not read error error_register");
         return;
     }
@@ -121,8 +171,9 @@ void EMCYHandler::handleDiag(LayerReport &report){
     }
 }
 void EMCYHandler::handleInit(LayerStatus &status){
+    StartupProfiler::Phase phase(storage_->node_id_, "emcy_init");
     uint8_t error_register = 0;
-    if(!error_register_.get(error_register)){
+    if(!readErrorRegister(error_register)){
         status.error("Could not read error error_register");
         return;
     }else if(error_register & 1){
@@ -135,6 +186,7 @@ void EMCYHandler::handleInit(LayerStatus &status){
 }
 void EMCYHandler::resetErrors(LayerStatus &status){
     if(num_errors_.valid()) num_errors_.set(0);
+    reset_index_ = history_.count();
     has_error_ = false;
 }
 
@@ -1,105 +1,32 @@
 #include <class_loader/class_loader.hpp>
 #include <socketcan_interface/reader.h>
-#include <canopen_master/canopen.h>
-
-#include <set>
+#include <canopen_master/sync_layer.h>
 
 namespace canopen {
 
-class ManagingSyncLayer: public SyncLayer {
-protected:
-    can::CommInterfaceSharedPtr interface_;
-    boost::chrono::milliseconds step_, half_step_;
-
-    std::set<void *> nodes_;
-    boost::mutex nodes_mutex_;
-    std::atomic<size_t> nodes_size_;
-
-    virtual void handleShutdown(LayerStatus &status) {
-    }
-
-    virtual void handleHalt(LayerStatus &status)  { /* nothing to do */ }
-    virtual void handleDiag(LayerReport &report)  { /* TODO */ }
-    virtual void handleRecover(LayerStatus &status)  { /* TODO */ }
-
-public:
-    ManagingSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface)
-    : SyncLayer(p), interface_(interface), step_(p.period_ms_), half_step_(p.period_ms_/2), nodes_size_(0)
-    {
-    }
-
-    virtual void addNode(void * const ptr) {
-        boost::mutex::scoped_lock lock(nodes_mutex_);
-        nodes_.insert(ptr);
-        nodes_size_ = nodes_.size();
-    }
-    virtual void removeNode(void * const ptr)  {
-        boost::mutex::scoped_lock lock(nodes_mutex_);
-        nodes_.erase(ptr);
-        nodes_size_ = nodes_.size();
-    }
-};
-
-
-class SimpleSyncLayer: public ManagingSyncLayer {
-    time_point read_time_, write_time_;
-    can::Frame frame_;
-    uint8_t overflow_;
-
-    void resetCounter(){
-        frame_.data[0] = 1; // SYNC counter starts at 1
-    }
-    void tryUpdateCounter(){
-        if (frame_.dlc > 0) { // sync counter is used
-            if (frame_.data[0] >= overflow_) {
-                resetCounter();
-            }else{
-                ++frame_.data[0];
-            }
-        }
-    }
-protected:
-    virtual void handleRead(LayerStatus &status, const LayerState &current_state) {
-        if(current_state > Init){
-            boost::this_thread::sleep_until(read_time_);
-            write_time_ += step_;
-        }
-    }
-    virtual void handleWrite(LayerStatus &status, const LayerState &current_state) {
-        if(current_state > Init){
-            boost::this_thread::sleep_until(write_time_);
-            tryUpdateCounter();
-            if(nodes_size_){ //)
-                interface_->send(frame_);
-            }
-            read_time_ = get_abs_time(half_step_);
-        }
-    }
-
-    virtual void handleInit(LayerStatus &status){
-        write_time_ = get_abs_time(step_);
-        read_time_ = get_abs_time(half_step_);
-    }
-public:
-    SimpleSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface)
-    : ManagingSyncLayer(p, interface), frame_(p.header_, 0), overflow_(p.overflow_) {
-        if(overflow_ == 1 || overflow_ > 240){
-            BOOST_THROW_EXCEPTION(Exception("SYNC counter overflow is invalid"));
-        }else if(overflow_ > 1){
-            frame_.dlc = 1;
-            resetCounter();
-        }
-    }
-};
-
 class ExternalSyncLayer: public ManagingSyncLayer {
     can::BufferedReader reader_;
+    const time_duration timeout_; ///< a SYNC of the external producer is considered missing after this
+    time_point last_sync_;
+    can::FrameListenerConstSharedPtr barrier_listener_;
+    void resetBarrier(const can::Frame &msg){
+        barrier_->reset(); // runs in the dispatcher, so it is ordered before the RPDOs of this cycle
+    }
 protected:
     virtual void handleRead(LayerStatus &status, const LayerState &current_state) {
         can::Frame msg;
         if(current_state > Init){
-            if(reader_.readUntil(&msg, get_abs_time(step_))){ // wait for sync
-                boost::this_thread::sleep_until(get_abs_time(half_step_)); // shift readout to middle of period
+            if(reader_.readUntil(&msg, get_abs_time(timeout_))){ // wait for sync
+                time_point now = get_abs_time();
+                if(last_sync_ != time_point()){
+                    time_duration diff = (now - last_sync_) - step_;
+                    period_jitter_.record(diff < time_duration::zero() ? -diff : diff);
+                }
+                last_sync_ = now;
+                waitForRead(now + getReadOffset()); // shift readout to middle of period, or until all RPDOs are in
+                if(image_) image_->swap(msg.dlc > 0 ? msg.data[0] : 0);
+            }else{
+                last_sync_ = time_point();
             }
         }
     }
@@ -107,11 +34,17 @@ protected:
         // nothing to do here
     }
     virtual void handleInit(LayerStatus &status){
+        if(barrier_) barrier_listener_ = interface_->createMsgListenerM(properties.header_, this, &ExternalSyncLayer::resetBarrier);
         reader_.listen(interface_, properties.header_);
+        last_sync_ = time_point();
+    }
+    virtual void handleShutdown(LayerStatus &status) {
+        barrier_listener_.reset();
     }
 public:
-    ExternalSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface)
-    : ManagingSyncLayer(p, interface), reader_(true,1) {}
+    ExternalSyncLayer(const SyncProperties &p, can::CommInterfaceSharedPtr interface, const Settings &settings)
+    : ManagingSyncLayer(p, interface, settings), reader_(true,1),
+      timeout_(boost::chrono::milliseconds(settings.get_optional<unsigned int>("timeout_ms", p.period_ms_))) {}
 };
 
 
@@ -119,7 +52,10 @@ template<typename SyncType> class WrapMaster: public Master{
     can::CommInterfaceSharedPtr interface_;
 public:
     virtual SyncLayerSharedPtr getSync(const SyncProperties &properties){
-        return std::make_shared<SyncType>(properties, interface_);
+        return getSync(properties, can::NoSettings());
+    }
+    virtual SyncLayerSharedPtr getSync(const SyncProperties &properties, const Settings &settings){
+        return std::make_shared<SyncType>(properties, interface_, settings);
     }
     WrapMaster(can::CommInterfaceSharedPtr interface) : interface_(interface)  {}
 
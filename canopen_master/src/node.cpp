@@ -1,7 +1,12 @@
 #include <canopen_master/canopen.h>
+#include <canopen_master/startup_profiler.h>
 
 using namespace canopen;
 
+static const StatusCode HEARTBEAT_PROBLEM("heartbeat problem");
+static const StatusCode NOT_OPERATIONAL("not operational");
+static const StatusCode PDO_WRITE_PROBLEM("PDO write problem");
+
 #pragma pack(push) /* push current alignment to stack */
 #pragma pack(1) /* set alignment to 1 byte boundary */
 
@@ -28,7 +33,7 @@ struct NMTcommand{
 #pragma pack(pop) /* pop previous alignment from stack */
 
 Node::Node(const can::CommInterfaceSharedPtr interface, const ObjectDictSharedPtr dict, uint8_t node_id, const SyncCounterSharedPtr sync)
-: Layer("Node 301"), node_id_(node_id), interface_(interface), sync_(sync) , state_(Unknown), sdo_(interface, dict, node_id), pdo_(interface){
+: Layer("Node 301"), node_id_(node_id), interface_(interface), sync_(sync) , state_(Unknown), sdo_(interface, dict, node_id), pdo_(interface, sync ? sync->getRPDOBarrier() : RPDOBarrierSharedPtr(), sync ? sync->getProcessImage() : ProcessImageSharedPtr()){
     try{
         getStorage()->entry(heartbeat_, 0x1017);
     }
@@ -44,6 +49,7 @@ const Node::State Node::getState(){
 bool Node::reset_com(){
     boost::timed_mutex::scoped_lock lock(mutex); // TODO: timed lock?
     getStorage()->reset();
+    CANOPEN_TRACE_INSTANT("NMT TX", uint32_t(node_id_) << 8 | NMTcommand::Reset_Com);
     interface_->send(NMTcommand::Frame(node_id_, NMTcommand::Reset_Com));
     if(wait_for(BootUp, boost::chrono::seconds(10)) != 1){
         return false;
@@ -56,6 +62,7 @@ bool Node::reset(){
     boost::timed_mutex::scoped_lock lock(mutex); // TODO: timed lock?
     getStorage()->reset();
 
+    CANOPEN_TRACE_INSTANT("NMT TX", uint32_t(node_id_) << 8 | NMTcommand::Reset);
     interface_->send(NMTcommand::Frame(node_id_, NMTcommand::Reset));
     if(wait_for(BootUp, boost::chrono::seconds(10)) != 1){
         return false;
@@ -70,6 +77,7 @@ bool Node::prepare(){
     if(state_ == BootUp){
         // ERROR
     }
+    CANOPEN_TRACE_INSTANT("NMT TX", uint32_t(node_id_) << 8 | NMTcommand::Prepare);
     interface_->send(NMTcommand::Frame(node_id_, NMTcommand::Prepare));
     return 0 != wait_for(PreOperational, boost::chrono::seconds(2));
 }
@@ -78,35 +86,45 @@ bool Node::start(){
     if(state_ == BootUp){
         // ERROR
     }
+    CANOPEN_TRACE_INSTANT("NMT TX", uint32_t(node_id_) << 8 | NMTcommand::Start);
     interface_->send(NMTcommand::Frame(node_id_, NMTcommand::Start));
     return 0 != wait_for(Operational, boost::chrono::seconds(2));
 }
 bool Node::stop(){
     boost::timed_mutex::scoped_lock lock(mutex); // TODO: timed lock?
     if(sync_) sync_->removeNode(this);
+    pdo_.joinBarrier(false);
     if(state_ == BootUp){
         // ERROR
     }
+    CANOPEN_TRACE_INSTANT("NMT TX", uint32_t(node_id_) << 8 | NMTcommand::Stop);
     interface_->send(NMTcommand::Frame(node_id_, NMTcommand::Stop));
     return true;
 }
 
+bool Node::remapPDOs(const PDOMapper::MappingSet &mappings, LayerStatus &status){
+    return pdo_.remap(getStorage(), mappings, status);
+}
+
 void Node::switchState(const uint8_t &s){
     bool changed = state_ != s;
     switch(s){
         case Operational:
             if(changed && sync_) sync_->addNode(this);
+            pdo_.joinBarrier(true);
             break;
         case BootUp:
         case PreOperational:
         case Stopped:
             if(changed && sync_) sync_->removeNode(this);
+            pdo_.joinBarrier(false);
             break;
         default:
             //error
             ;
     }
     if(changed){
+        CANOPEN_TRACE_INSTANT("NMT state", uint32_t(node_id_) << 8 | s);
         state_ = (State) s;
         state_dispatcher_.dispatch(state_);
         cond.notify_one();
@@ -148,9 +166,9 @@ bool Node::checkHeartbeat(){
 void Node::handleRead(LayerStatus &status, const LayerState &current_state) {
     if(current_state > Init){
         if(!checkHeartbeat()){
-            status.error("heartbeat problem");
+            status.error(HEARTBEAT_PROBLEM);
         } else if(getState() != Operational){
-            status.error("not operational");
+            status.error(NOT_OPERATIONAL);
         } else{
             pdo_.read(status);
         }
@@ -158,8 +176,8 @@ void Node::handleRead(LayerStatus &status, const LayerState &current_state) {
 }
 void Node::handleWrite(LayerStatus &status, const LayerState &current_state) {
     if(current_state > Init){
-        if(getState() != Operational)  status.error("not operational");
-        else if(! pdo_.write())  status.error("PDO write problem");
+        if(getState() != Operational)  status.error(NOT_OPERATIONAL);
+        else if(! pdo_.write())  status.error(PDO_WRITE_PROBLEM);
     }
 }
 
@@ -172,12 +190,27 @@ void Node::handleDiag(LayerReport &report){
     }else if(!checkHeartbeat()){
         report.error("Heartbeat timeout");
     }
+    const time_point now = get_abs_time();
+    std::vector<PDOMapper::RPDOStatistics> stats = pdo_.getRPDOStatistics();
+    for(std::vector<PDOMapper::RPDOStatistics>::iterator it = stats.begin(); it != stats.end(); ++it){
+        const std::string key = boost::str(boost::format("RPDO %1%") % (it->map_index - 0x1A00 + 1));
+        if(!it->received){
+            report.add(key, "not received");
+            continue;
+        }
+        report.add(key, boost::format("age: %1% ms, period: %2% ms, jitter: %3% us, missed SYNCs: %4%, DLC mismatches: %5%")
+            % boost::chrono::duration_cast<boost::chrono::milliseconds>(it->age(now)).count()
+            % (boost::chrono::duration_cast<boost::chrono::microseconds>(it->period).count() / 1000.0)
+            % boost::chrono::duration_cast<boost::chrono::microseconds>(it->jitter).count()
+            % it->missed_syncs % it->dlc_mismatches);
+    }
 }
 void Node::handleInit(LayerStatus &status){
     nmt_listener_ = interface_->createMsgListenerM(can::MsgHeader(0x700 + node_id_), this, &Node::handleNMT);
 
     sdo_.init();
     try{
+        StartupProfiler::Phase phase(node_id_, "nmt_reset");
         if(!reset_com()) BOOST_THROW_EXCEPTION( TimeoutException("reset_timeout") );
     }
     catch(const TimeoutException&){
@@ -185,14 +218,21 @@ void Node::handleInit(LayerStatus &status){
         return;
     }
 
-    if(!pdo_.init(getStorage(), status)){
-        return;
+    {
+        StartupProfiler::Phase phase(node_id_, "pdo_mapping");
+        if(!pdo_.init(getStorage(), status)){
+            return;
+        }
+    }
+    {
+        StartupProfiler::Phase phase(node_id_, "sdo_init");
+        getStorage()->init_all();
+        sdo_.init(); // reread SDO paramters;
     }
-    getStorage()->init_all();
-    sdo_.init(); // reread SDO paramters;
     // TODO: set SYNC data
 
     try{
+        StartupProfiler::Phase phase(node_id_, "nmt_start");
         if(!start()) BOOST_THROW_EXCEPTION( TimeoutException("start timeout") );
     }
     catch(const TimeoutException&){
@@ -380,6 +380,22 @@ size_t ObjectStorage::map(uint16_t index, uint8_t sub_index, const ReadFunc & re
     }
 }
 
+void ObjectStorage::unmap(uint16_t index, uint8_t sub_index){
+    boost::mutex::scoped_lock lock(mutex_);
+
+    ObjectStorageMap::iterator it = storage_.find(ObjectDict::Key(index, sub_index));
+    if(it == storage_.end() && sub_index == 0) it = storage_.find(ObjectDict::Key(index));
+    if(it != storage_.end()) it->second->set_delegates(read_delegate_, write_delegate_);
+}
+
+ObjectStorage::ChangeNotifier ObjectStorage::getChangeNotifier(uint16_t index, uint8_t sub_index){
+    boost::mutex::scoped_lock lock(mutex_);
+
+    ObjectStorageMap::iterator it = storage_.find(ObjectDict::Key(index, sub_index));
+    if(it == storage_.end() && sub_index == 0) it = storage_.find(ObjectDict::Key(index));
+    return it != storage_.end() ? ChangeNotifier(it->second) : ChangeNotifier();
+}
+
 ObjectStorage::ObjectStorage(ObjectDictConstSharedPtr dict, uint8_t node_id, ReadFunc read_delegate, WriteFunc write_delegate)
 :read_delegate_(read_delegate), write_delegate_(write_delegate), dict_(dict), node_id_(node_id){
     assert(dict_);
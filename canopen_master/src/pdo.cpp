@@ -1,7 +1,10 @@
 #include <canopen_master/canopen.h>
+#include <algorithm>
 
 using namespace canopen;
 
+static const StatusCode RPDO_TIMEOUT("RPDO %1% of node %2% timed out");
+
 #pragma pack(push) /* push current alignment to stack */
 #pragma pack(1) /* set alignment to 1 byte boundary */
 
@@ -48,6 +51,12 @@ const uint16_t RPDO_MAP_BASE =0x1600;
 const uint16_t TPDO_COM_BASE =0x1800;
 const uint16_t TPDO_MAP_BASE =0x1A00;
 
+const uint8_t MPDO_SAM = 0xFE; ///< source address mode, the producer lists its objects in the object scanner list
+const uint8_t MPDO_DAM = 0xFF; ///< destination address mode, the consumer writes the addressed object
+const uint8_t MPDO_DAM_FLAG = 0x80;
+const uint16_t MPDO_SCANNER_BASE = 0x1FA0;
+const uint16_t MPDO_SCANNER_LAST = 0x1FCF;
+
 bool check_com_changed(const ObjectDict &dict, const uint16_t com_id){
     bool com_changed = false;
 
@@ -83,9 +92,10 @@ bool check_map_changed(const uint8_t &num, const ObjectDict &dict, const uint16_
     }
     return map_changed;
 }
-void PDOMapper::PDO::parse_and_set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const bool &read, const bool &write){
+void PDOMapper::PDO::parse_and_set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const bool &read, const bool &write, const ProcessImageSharedPtr &image){
 
     const canopen::ObjectDict & dict = *storage->dict_;
+    map_index_ = map_index;
 
     ObjectStorage::Entry<uint8_t> num_entry;
     storage->entry(num_entry, map_index, SUB_MAP_NUM);
@@ -120,29 +130,46 @@ void PDOMapper::PDO::parse_and_set_mapping(const ObjectStorageSharedPtr &storage
             const HoldAny init = dict(map_index ,sub).init_val;
             if(!init.is_empty()) mapentry.set(init.get<uint32_t>());
 
-            PDOmap param(mapentry.get_cached());
-            BufferSharedPtr b = std::make_shared<Buffer>(param.length/8);
-            if(param.index < 0x1000){
-                // TODO: check DummyUsage
-            }else{
-                ObjectStorage::ReadFunc rd;
-                ObjectStorage::WriteFunc wd;
-
-                if(read){
-                  rd = std::bind<void(Buffer::*)(const canopen::ObjectDict::Entry&, String&)>(&Buffer::read, b.get(), std::placeholders::_1, std::placeholders::_2);
-                }
-                if(read || write)
-                {
-                    wd = std::bind<void(Buffer::*)(const canopen::ObjectDict::Entry&, const String&)>(&Buffer::write, b.get(), std::placeholders::_1, std::placeholders::_2);
-                    size_t l = storage->map(param.index, param.sub_index, rd, wd);
-                    assert(l  == param.length/8);
-                }
-            }
-
+            BufferSharedPtr b = map_object(storage, mapentry.get_cached(), read, write, image);
             frame.dlc += b->size;
             assert( frame.dlc <= 8 );
-            b->clean();
             buffers.push_back(b);
+            objects.push_back(mapentry.get_cached());
+        }
+    }else if(map_num == MPDO_DAM && write){
+        // the device accepts any object, the objects to be sent are taken from the mapping entries but are not written to the device
+        mpdo = map_num;
+        for(uint8_t sub = 1; sub <= 0x40 && dict.has(map_index, sub); ++sub){
+            const ObjectDict::Entry &e = dict(map_index, sub);
+            objects.push_back((e.init_val.is_empty() ? e.value() : e.init_val).get<uint32_t>());
+        }
+    }else if(map_num == MPDO_SAM && read){
+        // the device sends the objects of its object scanner list, each entry is index << 8 | sub-index with the number of sub-indices in the upper byte
+        mpdo = map_num;
+        for(uint16_t index = MPDO_SCANNER_BASE; index <= MPDO_SCANNER_LAST; ++index){
+            for(uint16_t sub = 1; sub <= 0xFE && dict.has(index, sub); ++sub){
+                const ObjectDict::Entry &e = dict(index, sub);
+                const uint32_t val = (e.init_val.is_empty() ? e.value() : e.init_val).get<uint32_t>();
+                if(val == 0) continue;
+                const uint8_t count = std::max(val >> 24, 1u);
+                for(uint8_t i = 0; i < count; ++i){
+                    const uint16_t obj_index = (val >> 8) & 0xFFFF;
+                    const uint8_t obj_sub = (val & 0xFF) + i;
+                    const ObjectDict::Key key = (obj_sub == 0 && !dict.has(obj_index, 0)) ? ObjectDict::Key(obj_index) : ObjectDict::Key(obj_index, obj_sub);
+                    objects.push_back(uint32_t(obj_index) << 16 | uint32_t(obj_sub) << 8 | (dict.get(key)->def_val.type().get_size() * 8));
+                }
+            }
+        }
+    }
+    if(mpdo){
+        node_id = storage->node_id_;
+        frame.dlc = 8;
+        for(std::vector<uint32_t>::iterator it = objects.begin(); it != objects.end(); ++it){
+            PDOmap param(*it);
+            if(param.index < 0x1000 || param.length == 0 || param.length > 32 || param.length % 8 != 0){
+                THROW_WITH_KEY(std::out_of_range("MPDO objects must be 1 to 4 bytes long"), ObjectDict::Key(param.index, param.sub_index));
+            }
+            buffers.push_back(map_object(storage, *it, read, write, image));
         }
     }
     if(com_changed){
@@ -168,25 +195,121 @@ void PDOMapper::PDO::parse_and_set_mapping(const ObjectStorageSharedPtr &storage
 
 
 }
-PDOMapper::PDOMapper(const can::CommInterfaceSharedPtr interface)
-:interface_(interface)
+static void check_mapping_size(const uint16_t &map_index, const PDOMapper::Mapping &mapping){
+    size_t bits = 0;
+    for(PDOMapper::Mapping::const_iterator it = mapping.begin(); it != mapping.end(); ++it) bits += PDOmap(*it).length;
+    if(mapping.size() > 0x40 || bits > 64){
+        THROW_WITH_KEY(std::out_of_range("PDO mapping exceeds 8 bytes"), ObjectDict::Key(map_index));
+    }
+}
+
+void PDOMapper::PDO::set_mapping(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping &mapping, const Mapping *current, const bool &read, const bool &write, const ProcessImageSharedPtr &image){
+    map_index_ = map_index;
+    check_mapping_size(map_index, mapping);
+
+    ObjectStorage::Entry<uint32_t> cob_id;
+    storage->entry(cob_id, com_index, SUB_COM_COB_ID);
+    ObjectStorage::Entry<uint8_t> num_entry;
+    storage->entry(num_entry, map_index, SUB_MAP_NUM);
+
+    const uint32_t id = cob_id.get_cached() & ~PDOid::INVALID_MASK;
+    cob_id.set(id | PDOid::INVALID_MASK);
+    num_entry.set(0);
+    for(size_t i = 0; i < mapping.size(); ++i){
+        if(current && i < current->size() && (*current)[i] == mapping[i]) continue; // still set in the device
+        storage->entry<uint32_t>(map_index, i + 1).set(mapping[i]);
+    }
+    if(mapping.empty()) return; // stays disabled
+    num_entry.set(mapping.size());
+    cob_id.set(id);
+
+    frame.dlc = 0;
+    for(Mapping::const_iterator it = mapping.begin(); it != mapping.end(); ++it){
+        BufferSharedPtr b = map_object(storage, *it, read, write, image);
+        frame.dlc += b->size;
+        buffers.push_back(b);
+        objects.push_back(*it);
+    }
+}
+
+void PDOMapper::PDO::unmap(const ObjectStorageSharedPtr &storage){
+    for(std::vector<uint32_t>::iterator it = objects.begin(); it != objects.end(); ++it){
+        PDOmap param(*it);
+        if(param.index >= 0x1000) storage->unmap(param.index, param.sub_index);
+    }
+}
+
+PDOMapper::BufferSharedPtr PDOMapper::PDO::map_object(const ObjectStorageSharedPtr &storage, uint32_t mapping, const bool &read, const bool &write, const ProcessImageSharedPtr &image){
+    const canopen::ObjectDict & dict = *storage->dict_;
+    PDOmap param(mapping);
+    BufferSharedPtr b = std::make_shared<Buffer>(param.length/8);
+    if(param.index < 0x1000){
+        // TODO: check DummyUsage
+    }else{
+        ObjectStorage::ReadFunc rd;
+        ObjectStorage::WriteFunc wd;
+
+        if(read && image){
+            const bool var = param.sub_index == 0 && !dict.has(param.index, param.sub_index); // variables have no sub-index
+            b->attach(image, image->allocate(var ? dict(param.index) : dict(param.index, param.sub_index), storage->node_id_, b->size));
+        }
+        if(read){
+          rd = std::bind<void(Buffer::*)(const canopen::ObjectDict::Entry&, String&)>(&Buffer::read, b.get(), std::placeholders::_1, std::placeholders::_2);
+        }
+        if(read || write)
+        {
+            wd = std::bind<void(Buffer::*)(const canopen::ObjectDict::Entry&, const String&)>(&Buffer::write, b.get(), std::placeholders::_1, std::placeholders::_2);
+            size_t l = storage->map(param.index, param.sub_index, rd, wd);
+            assert(l  == param.length/8);
+        }
+        if(read){
+            b->attach(storage->getChangeNotifier(param.index, param.sub_index));
+        }
+    }
+    b->clean();
+    return b;
+}
+PDOMapper::PDOMapper(const can::CommInterfaceSharedPtr interface, const RPDOBarrierSharedPtr &barrier, const ProcessImageSharedPtr &image)
+:interface_(interface), barrier_(barrier), barrier_rpdos_(0), barrier_joined_(false), image_(image)
 {
 }
+void PDOMapper::updateBarrierRPDOs(){
+    size_t n = 0;
+    for(std::unordered_set<RPDO::RPDOSharedPtr>::iterator it = rpdos_.begin(); it != rpdos_.end(); ++it){
+        if((*it)->isSynchronous()) ++n;
+    }
+    setBarrierRPDOs(n);
+}
+void PDOMapper::setBarrierRPDOs(size_t n){
+    if(barrier_ && barrier_joined_){
+        barrier_->remove(barrier_rpdos_);
+        barrier_->add(n);
+    }
+    barrier_rpdos_ = n;
+}
+
 bool PDOMapper::init(const ObjectStorageSharedPtr storage, LayerStatus &status){
     boost::mutex::scoped_lock lock(mutex_);
 
     try{
+        // the buffers are released, objects that will not be mapped again must not refer to them
+        for(std::unordered_set<RPDO::RPDOSharedPtr>::iterator it = rpdos_.begin(); it != rpdos_.end(); ++it) (*it)->unmap(storage);
+        for(std::unordered_set<TPDO::TPDOSharedPtr>::iterator it = tpdos_.begin(); it != tpdos_.end(); ++it) (*it)->unmap(storage);
         rpdos_.clear();
+        disabled_.clear();
 
+        size_t barrier_rpdos = 0;
         const canopen::ObjectDict & dict = *storage->dict_;
         for(uint16_t i=0; i < 512 && rpdos_.size() < dict.device_info.nr_of_tx_pdo;++i){ // TPDOs of device
             if(!dict.has(TPDO_COM_BASE + i,0) && !dict.has(TPDO_MAP_BASE + i,0)) continue;
 
-            RPDO::RPDOSharedPtr rpdo = RPDO::create(interface_,storage, TPDO_COM_BASE + i, TPDO_MAP_BASE + i);
+            RPDO::RPDOSharedPtr rpdo = RPDO::create(interface_,storage, TPDO_COM_BASE + i, TPDO_MAP_BASE + i, barrier_, image_);
             if(rpdo){
                 rpdos_.insert(rpdo);
+                if(rpdo->isSynchronous()) ++barrier_rpdos;
             }
         }
+        setBarrierRPDOs(barrier_rpdos);
         // ROSCANOPEN_DEBUG("canopen_master", "RPDOs: " << rpdos_.size());
 
         tpdos_.clear();
@@ -209,13 +332,20 @@ bool PDOMapper::init(const ObjectStorageSharedPtr storage, LayerStatus &status){
 }
 
 
-bool PDOMapper::RPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index){
+bool PDOMapper::RPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping *mapping, const Mapping *current){
     boost::mutex::scoped_lock lock(mutex);
     listener_.reset();
     const canopen::ObjectDict & dict = *storage->dict_;
-    parse_and_set_mapping(storage, com_index, map_index, true, false);
+    uint32_t cob_id;
+    if(mapping){
+        set_mapping(storage, com_index, map_index, *mapping, current, true, false, image_);
+        cob_id = storage->entry<uint32_t>(com_index, SUB_COM_COB_ID).get_cached();
+    }else{
+        parse_and_set_mapping(storage, com_index, map_index, true, false, image_);
+        cob_id = NodeIdOffset<uint32_t>::apply(dict(com_index, SUB_COM_COB_ID).value(), storage->node_id_);
+    }
 
-    PDOid pdoid( NodeIdOffset<uint32_t>::apply(dict(com_index, SUB_COM_COB_ID).value(), storage->node_id_) );
+    PDOid pdoid(cob_id);
 
     if(buffers.empty() || pdoid.isInvalid()){
        return false;
@@ -224,21 +354,34 @@ bool PDOMapper::RPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t
     frame = pdoid.header(true);
 
     transmission_type = dict(com_index, SUB_COM_TRANSMISSION_TYPE).value().get<uint8_t>();
+    node_id = storage->node_id_;
+
+    stats_ = RPDOStatistics();
+    syncs_ = 0;
+    stats_.map_index = map_index;
+    stats_.header = pdoid.header();
+    stats_.transmission_type = transmission_type;
 
     listener_ = interface_->createMsgListenerM(pdoid.header(), this, &RPDO::handleFrame);
 
     return true;
 }
 
-bool PDOMapper::TPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index){
+bool PDOMapper::TPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t &com_index, const uint16_t &map_index, const Mapping *mapping, const Mapping *current){
     boost::mutex::scoped_lock lock(mutex);
     const canopen::ObjectDict & dict = *storage->dict_;
 
-
-    PDOid pdoid( NodeIdOffset<uint32_t>::apply(dict(com_index, SUB_COM_COB_ID).value(), storage->node_id_) );
+    if(mapping){
+        set_mapping(storage, com_index, map_index, *mapping, current, false, true);
+    }
+    PDOid pdoid( mapping ? storage->entry<uint32_t>(com_index, SUB_COM_COB_ID).get_cached() : NodeIdOffset<uint32_t>::apply(dict(com_index, SUB_COM_COB_ID).value(), storage->node_id_) );
+    const uint8_t dlc = frame.dlc;
     frame = pdoid.header();
+    frame.dlc = dlc;
 
-    parse_and_set_mapping(storage, com_index, map_index, false, true);
+    if(!mapping){
+        parse_and_set_mapping(storage, com_index, map_index, false, true);
+    }
     if(buffers.empty() || pdoid.isInvalid()){
        return false;
     }
@@ -255,6 +398,22 @@ bool PDOMapper::TPDO::init(const ObjectStorageSharedPtr &storage, const uint16_t
 void PDOMapper::TPDO::sync(){
     boost::mutex::scoped_lock lock(mutex);
 
+    if(mpdo){ // one frame per changed object
+        for(size_t i = 0; i < buffers.size(); ++i){
+            PDOmap param(objects[i]);
+            can::Frame msg(frame, 8);
+            msg.data.fill(0);
+            if(!buffers[i]->read(&msg.data[4], 4)) continue;
+            msg.data[0] = MPDO_DAM_FLAG | node_id;
+            msg.data[1] = param.index & 0xFF;
+            msg.data[2] = param.index >> 8;
+            msg.data[3] = param.sub_index;
+            CANOPEN_TRACE_INSTANT("MPDO TX", frame.id);
+            interface_->send(msg);
+        }
+        return;
+    }
+
     bool updated = false;
     size_t len = frame.dlc;
     can::Frame::value_type * dest = frame.c_array();
@@ -273,6 +432,7 @@ void PDOMapper::TPDO::sync(){
         // ERROR
     }
     if(updated){
+        CANOPEN_TRACE_INSTANT("TPDO TX", frame.id);
         interface_->send( frame );
     }else{
         // TODO: Notify
@@ -281,38 +441,77 @@ void PDOMapper::TPDO::sync(){
 
 void PDOMapper::RPDO::sync(LayerStatus &status){
     boost::mutex::scoped_lock lock(mutex);
-    if((transmission_type >= 1 && transmission_type <= 240) || transmission_type == 0xFC){ // cyclic
+    if(!mpdo && ((transmission_type >= 1 && transmission_type <= 240) || transmission_type == 0xFC)){ // cyclic, MPDOs only carry changed objects
+        const unsigned int period = transmission_type == 0xFC ? 1 : transmission_type;
+        if(stats_.received > 0 && ++syncs_ > period && (syncs_ - 1) % period == 0){ // another period passed without the PDO
+            ++stats_.missed_syncs;
+        }
         if(timeout > 0){
             --timeout;
         }else if(timeout == 0) {
-            status.warn("RPDO timeout");
+            status.warn(RPDO_TIMEOUT, stats_.map_index - TPDO_MAP_BASE + 1, node_id);
         }
     }
     if(transmission_type == 0xFC || transmission_type == 0xFD){
         if(frame.is_rtr){
+            CANOPEN_TRACE_INSTANT("RTR TX", frame.id);
             interface_->send(frame);
         }
     }
 }
 
-void PDOMapper::RPDO::handleFrame(const can::Frame & msg){
-    size_t offset = 0;
-    const uint8_t * src = msg.data.data();
-    for(std::vector<BufferSharedPtr >::iterator it = buffers.begin(); it != buffers.end(); ++it){
-        Buffer &b = **it;
+void PDOMapper::RPDO::flush(){
+    for(std::vector<BufferSharedPtr>::iterator it = buffers.begin(); it != buffers.end(); ++it){
+        (*it)->notifier().flush();
+    }
+}
 
-        if( offset + b.size <= msg.dlc ){
-            b.write(src+offset, b.size);
+void PDOMapper::RPDO::handleFrame(const can::Frame & msg){
+    const time_point now = get_abs_time();
+    if(mpdo){ // other nodes might share the COB-ID
+        if(msg.dlc != 8){
+            boost::mutex::scoped_lock lock(mutex);
+            ++stats_.dlc_mismatches;
+            return;
+        }
+        if((msg.data[0] & MPDO_DAM_FLAG) || (msg.data[0] & 0x7F) != node_id) return;
+        const uint32_t object = uint32_t(msg.data[1] | (msg.data[2] << 8)) << 16 | uint32_t(msg.data[3]) << 8;
+        size_t i = 0;
+        while(i < objects.size() && (objects[i] & ~0xFFu) != object) ++i;
+        if(i == objects.size()) return; // not in the scanner list
+        if(buffers[i]->write(&msg.data[4], buffers[i]->size)) buffers[i]->notifyChanged();
+    }else{
+        size_t size = 0;
+        for(std::vector<BufferSharedPtr >::iterator it = buffers.begin(); it != buffers.end(); ++it) size += (*it)->size;
+        if(msg.dlc != size){
+            boost::mutex::scoped_lock lock(mutex);
+            ++stats_.dlc_mismatches;
+            if(msg.dlc < size) return; // dropped, it neither counts as arrival nor resets the timeout
+            // longer frames are processed, the bytes beyond the mapping get ignored as in CiA 301
+        }
+        size_t offset = 0;
+        const uint8_t * src = msg.data.data();
+        for(std::vector<BufferSharedPtr >::iterator it = buffers.begin(); it != buffers.end(); ++it){
+            Buffer &b = **it;
+            if(b.write(src+offset, b.size)) b.notifyChanged();
             offset += b.size;
-        }else{
-            // ERROR
         }
     }
-    if( offset != msg.dlc ){
-        // ERROR
-    }
     {
         boost::mutex::scoped_lock lock(mutex);
+        syncs_ = 0;
+        if(mpdo){
+            // one frame per changed object, the intervals say nothing about the cycle
+        }else if(stats_.received == 1){
+            stats_.period = now - stats_.last_arrival;
+        }else if(stats_.received > 1){
+            const time_duration interval = now - stats_.last_arrival;
+            const time_duration deviation = interval > stats_.period ? interval - stats_.period : stats_.period - interval;
+            stats_.jitter += (deviation - stats_.jitter) / 16;
+            stats_.period += (interval - stats_.period) / 16;
+        }
+        stats_.last_arrival = now;
+        ++stats_.received;
         if(transmission_type >= 1 && transmission_type <= 240){
             timeout = transmission_type + 2;
         }else if(transmission_type == 0xFC || transmission_type == 0xFD){
@@ -320,15 +519,165 @@ void PDOMapper::RPDO::handleFrame(const can::Frame & msg){
                 timeout = 1+2;
             }
         }
+        if(barrier_ && isSynchronous()){
+            barrier_->arrive(barrier_generation_, now);
+        }
+    }
+}
+
+PDOMapper::RPDOStatistics PDOMapper::RPDO::getStatistics(){
+    boost::mutex::scoped_lock lock(mutex);
+    return stats_;
+}
+
+std::vector<PDOMapper::RPDOStatistics> PDOMapper::getRPDOStatistics(){
+    boost::mutex::scoped_lock lock(mutex_);
+    std::vector<RPDOStatistics> stats;
+    for(std::unordered_set<RPDO::RPDOSharedPtr>::iterator it = rpdos_.begin(); it != rpdos_.end(); ++it){
+        stats.push_back((*it)->getStatistics());
+    }
+    std::sort(stats.begin(), stats.end(), [](const RPDOStatistics &a, const RPDOStatistics &b){ return a.map_index < b.map_index; });
+    return stats;
+}
+
+time_duration PDOMapper::getRPDOAge(){
+    boost::mutex::scoped_lock lock(mutex_);
+    const time_point now = get_abs_time();
+    time_duration age(0);
+    for(std::unordered_set<RPDO::RPDOSharedPtr>::iterator it = rpdos_.begin(); it != rpdos_.end(); ++it){
+        age = std::max(age, (*it)->getStatistics().age(now));
+    }
+    return age;
+}
+
+/// one PDO that is switched by remap, the new PDOs are built without the mapper lock and swapped in at the end
+struct PDOMapper::Remapping{
+    uint16_t map_index;
+    const Mapping *mapping;
+    Mapping previous; ///< empty if the PDO was disabled
+    RPDO::RPDOSharedPtr old_rpdo, rpdo;
+    TPDO::TPDOSharedPtr old_tpdo, tpdo;
+    bool isRPDO() const { return map_index >= TPDO_MAP_BASE && map_index < TPDO_MAP_BASE + 512; } // TPDO of device
+    bool isTPDO() const { return map_index >= RPDO_MAP_BASE && map_index < RPDO_MAP_BASE + 512; } // RPDO of device
+};
+
+void PDOMapper::build(const ObjectStorageSharedPtr &storage, Remapping &r, const Mapping &mapping, const Mapping *current){
+    if(r.rpdo) r.rpdo->unmap(storage);
+    if(r.tpdo) r.tpdo->unmap(storage);
+    r.rpdo.reset();
+    r.tpdo.reset();
+    if(r.isRPDO()){
+        r.rpdo = RPDO::create(interface_, storage, TPDO_COM_BASE + (r.map_index - TPDO_MAP_BASE), r.map_index, barrier_, image_, &mapping, current);
+    }else{
+        r.tpdo = TPDO::create(interface_, storage, RPDO_COM_BASE + (r.map_index - RPDO_MAP_BASE), r.map_index, &mapping, current);
+    }
+}
+
+bool PDOMapper::remap(const ObjectStorageSharedPtr storage, const MappingSet &mappings, LayerStatus &status){
+    boost::mutex::scoped_lock remap_lock(remap_mutex_);
+
+    std::vector<Remapping> changes;
+    try{
+        boost::mutex::scoped_lock lock(mutex_);
+        for(MappingSet::const_iterator it = mappings.begin(); it != mappings.end(); ++it){
+            Remapping r;
+            r.map_index = it->first;
+            r.mapping = &it->second;
+            if(!r.isRPDO() && !r.isTPDO()) THROW_WITH_KEY(std::out_of_range("not a PDO mapping parameter"), ObjectDict::Key(r.map_index));
+            check_mapping_size(r.map_index, it->second);
+
+            for(std::unordered_set<RPDO::RPDOSharedPtr>::iterator p = rpdos_.begin(); r.isRPDO() && p != rpdos_.end(); ++p){
+                if((*p)->getMapIndex() == r.map_index) r.old_rpdo = *p;
+            }
+            for(std::unordered_set<TPDO::TPDOSharedPtr>::iterator p = tpdos_.begin(); r.isTPDO() && p != tpdos_.end(); ++p){
+                if((*p)->getMapIndex() == r.map_index) r.old_tpdo = *p;
+            }
+            if(r.old_rpdo) r.previous = r.old_rpdo->getObjects();
+            if(r.old_tpdo) r.previous = r.old_tpdo->getObjects();
+            const bool enabled = r.old_rpdo || r.old_tpdo;
+            if(enabled ? r.previous == it->second : it->second.empty() && disabled_.count(r.map_index)) continue; // unchanged
+            changes.push_back(r);
+        }
+    }
+    catch(const std::exception &e){
+        status.error(std::string("PDO remapping failed: ") + e.what());
+        return false;
+    }
+
+    // the SDO transfers run without the lock, so the other PDOs keep running,
+    // each changed PDO is taken out right before its device is reconfigured
+    std::string error;
+    size_t applied = 0;
+    try{
+        for(; applied < changes.size(); ++applied){
+            Remapping &r = changes[applied];
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                if(r.old_rpdo){
+                    rpdos_.erase(r.old_rpdo);
+                    r.old_rpdo->unmap(storage);
+                    updateBarrierRPDOs();
+                }
+                if(r.old_tpdo){
+                    tpdos_.erase(r.old_tpdo);
+                    r.old_tpdo->unmap(storage);
+                }
+            }
+            r.old_rpdo.reset(); // its listener is released without the lock
+            r.old_tpdo.reset();
+            build(storage, r, *r.mapping, r.previous.empty() ? 0 : &r.previous);
+        }
     }
+    catch(const std::exception &e){
+        error = e.what();
+    }
+
+    if(!error.empty()){
+        status.error("PDO remapping failed, restoring the previous mappings: " + error);
+        changes.resize(std::min(applied + 1, changes.size())); // the others were not touched
+        for(std::vector<Remapping>::iterator r = changes.begin(); r != changes.end(); ++r){
+            try{
+                build(storage, *r, r->previous, 0); // the state of the device is unknown, all entries are written
+            }
+            catch(const std::exception &e){
+                r->rpdo.reset();
+                r->tpdo.reset();
+                status.error(boost::str(boost::format("PDO mapping 0x%04X of node %d stays disabled: %s") % r->map_index % int(storage->node_id_) % e.what()));
+            }
+        }
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    for(std::vector<Remapping>::iterator r = changes.begin(); r != changes.end(); ++r){
+        if(r->rpdo){
+            rpdos_.insert(r->rpdo);
+            disabled_.erase(r->map_index);
+        }else if(r->tpdo){
+            tpdos_.insert(r->tpdo);
+            disabled_.erase(r->map_index);
+        }else{
+            disabled_.insert(r->map_index);
+        }
+    }
+    updateBarrierRPDOs();
+    return error.empty();
 }
 
 void PDOMapper::read(LayerStatus &status){
     boost::mutex::scoped_lock lock(mutex_);
     for(std::unordered_set<RPDO::RPDOSharedPtr >::iterator it = rpdos_.begin(); it != rpdos_.end(); ++it){
         (*it)->sync(status);
+        (*it)->flush();
     }
 }
+void PDOMapper::joinBarrier(bool join){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(!barrier_ || barrier_joined_ == join) return;
+
+    if(join) barrier_->add(barrier_rpdos_);
+    else barrier_->remove(barrier_rpdos_);
+    barrier_joined_ = join;
+}
 bool PDOMapper::write(){
     boost::mutex::scoped_lock lock(mutex_);
     for(std::unordered_set<TPDO::TPDOSharedPtr >::iterator it = tpdos_.begin(); it != tpdos_.end(); ++it){
@@ -349,16 +698,33 @@ bool PDOMapper::Buffer::read(uint8_t* b, const size_t len){
     dirty = false;
     return was_dirty;
 }
-void PDOMapper::Buffer::write(const uint8_t* b, const size_t len){
+bool PDOMapper::Buffer::write(const uint8_t* b, const size_t len){
     boost::mutex::scoped_lock lock(mutex);
     if(size > len){
         BOOST_THROW_EXCEPTION( std::bad_cast() );
     }
+    const bool changed = empty || memcmp(&buffer[0], b, size) != 0;
     empty = false;
     dirty = true;
     memcpy(&buffer[0], b, size);
+    if(image_) image_->write(image_offset_, b, size);
+    return changed;
+}
+void PDOMapper::Buffer::notifyChanged(){
+    if(notifier_ == ObjectStorage::ChangeNotifier()) return;
+    if(image_) image_->notifyAfterSwap(notifier_);
+    else notifier_.notify();
 }
 void PDOMapper::Buffer::read(const canopen::ObjectDict::Entry &entry, String &data){
+    if(image_){ // serve the snapshot of the current cycle
+        if(size != data.size()){
+            THROW_WITH_KEY(std::bad_cast(), ObjectDict::Key(entry));
+        }
+        if(!image_->read(image_offset_, reinterpret_cast<uint8_t*>(&data.front()), size)){
+            THROW_WITH_KEY(TimeoutException("PDO data empty"), ObjectDict::Key(entry));
+        }
+        return;
+    }
     boost::mutex::scoped_lock lock(mutex);
     time_point abs_time = get_abs_time(boost::chrono::seconds(1));
     if(size != data.size()){
@@ -381,3 +747,54 @@ void PDOMapper::Buffer::write(const canopen::ObjectDict::Entry &entry, const Str
     dirty = true;
     buffer.assign(data.begin(),data.end());
 }
+
+void RPDOBarrier::add(size_t n){
+    boost::mutex::scoped_lock lock(mutex_);
+    expected_ += n;
+}
+void RPDOBarrier::remove(size_t n){
+    boost::mutex::scoped_lock lock(mutex_);
+    expected_ -= std::min(n, expected_);
+    if(arrived_ >= expected_) cond_.notify_all();
+}
+void RPDOBarrier::reset(){
+    boost::mutex::scoped_lock lock(mutex_);
+    previous_valid_ = expected_ > 0 && arrived_ >= expected_ && sync_time_ != time_point(); // a partial cycle understates the latency
+    if(previous_valid_) previous_latency_ = last_arrival_ - sync_time_;
+    sync_time_ = get_abs_time();
+    arrived_ = 0;
+    ++generation_;
+}
+void RPDOBarrier::arrive(uint32_t &generation, const time_point &arrival){
+    boost::mutex::scoped_lock lock(mutex_);
+    // received before the SYNC of this cycle, or a second frame in it, so one of them was sent for an earlier SYNC
+    if(arrival < sync_time_ || generation == generation_){
+        ++late_;
+    }else{
+        generation = generation_;
+        last_arrival_ = arrival;
+        if(++arrived_ >= expected_) cond_.notify_all();
+    }
+}
+bool RPDOBarrier::waitUntil(const time_point &abs_time){
+    boost::mutex::scoped_lock lock(mutex_);
+    while(arrived_ < expected_){
+        if(cond_.wait_until(lock, abs_time) == boost::cv_status::timeout){
+            return arrived_ >= expected_;
+        }
+    }
+    return true;
+}
+size_t RPDOBarrier::getExpected(){
+    boost::mutex::scoped_lock lock(mutex_);
+    return expected_;
+}
+uint64_t RPDOBarrier::getLate(){
+    boost::mutex::scoped_lock lock(mutex_);
+    return late_;
+}
+bool RPDOBarrier::getPreviousLatency(time_duration &latency){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(previous_valid_) latency = previous_latency_;
+    return previous_valid_;
+}
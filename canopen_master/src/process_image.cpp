@@ -0,0 +1,113 @@
+#include <canopen_master/process_image.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace canopen;
+
+size_t ProcessImage::allocate(const ObjectDict::Entry &entry, uint8_t node_id, size_t size){
+    boost::mutex::scoped_lock lock(mutex_);
+    for(const Region &e: regions_){ // nodes get re-initialized, keep their layout
+        if(e.node_id == node_id && e.index == entry.index && e.sub_index == entry.sub_index && e.size == size) return e.offset;
+    }
+    Region r;
+    r.offset = back_.size();
+    r.size = size;
+    r.node_id = node_id;
+    r.index = entry.index;
+    r.sub_index = entry.sub_index;
+    r.data_type = entry.data_type;
+    regions_.push_back(r);
+
+    back_.resize(r.offset + size);
+    back_valid_.resize(r.offset + size);
+
+    boost::unique_lock<boost::shared_mutex> front_lock(front_mutex_);
+    front_.resize(back_.size());
+    front_valid_.resize(back_valid_.size());
+    ++layout_;
+
+    return r.offset;
+}
+
+void ProcessImage::write(size_t offset, const uint8_t *data, size_t size){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(offset + size > back_.size()) return;
+    memcpy(&back_[offset], data, size);
+    memset(&back_valid_[offset], 1, size);
+}
+
+void ProcessImage::swap(uint8_t sync_counter){
+    std::vector<ObjectStorage::ChangeNotifier> pending;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        sequence_.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_release);
+        if(!back_.empty()){
+            memcpy(&front_[0], &back_[0], back_.size());
+            memcpy(&front_valid_[0], &back_valid_[0], back_valid_.size());
+        }
+        ++tag_.cycle;
+        tag_.sync_counter = sync_counter;
+        tag_.time = boost::chrono::high_resolution_clock::now();
+        sequence_.fetch_add(1, std::memory_order_release);
+        pending.swap(pending_);
+    }
+    // listeners might read the image
+    for(std::vector<ObjectStorage::ChangeNotifier>::const_iterator it = pending.begin(); it != pending.end(); ++it) it->notify();
+}
+
+void ProcessImage::notifyAfterSwap(const ObjectStorage::ChangeNotifier &notifier){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(std::find(pending_.begin(), pending_.end(), notifier) == pending_.end()) pending_.push_back(notifier);
+}
+
+bool ProcessImage::read(size_t offset, uint8_t *data, size_t size, Tag *tag) const{
+    bool valid = false;
+    readFront([&](){
+        if(offset + size > front_.size()){
+            valid = false;
+            return;
+        }
+        valid = front_valid_[offset] != 0;
+        memcpy(data, &front_[offset], size);
+        if(tag) *tag = tag_;
+    });
+    return valid;
+}
+
+void ProcessImage::snapshot(std::vector<uint8_t> &data, std::vector<uint8_t> &valid, Tag &tag) const{
+    readFront([&](){
+        data = front_;
+        valid = front_valid_;
+        tag = tag_;
+    });
+}
+
+size_t ProcessImage::snapshot(uint8_t *data, uint8_t *valid, size_t size, Tag &tag) const{
+    size_t n = 0;
+    readFront([&](){
+        n = std::min(size, front_.size());
+        if(n){
+            memcpy(data, &front_[0], n);
+            memcpy(valid, &front_valid_[0], n);
+        }
+        tag = tag_;
+    });
+    return n;
+}
+
+ProcessImage::Tag ProcessImage::getTag() const{
+    Tag tag;
+    readFront([&](){ tag = tag_; });
+    return tag;
+}
+
+std::vector<ProcessImage::Region> ProcessImage::getRegions() const{
+    boost::mutex::scoped_lock lock(mutex_);
+    return regions_;
+}
+
+size_t ProcessImage::size() const{
+    boost::mutex::scoped_lock lock(mutex_);
+    return back_.size();
+}
@@ -0,0 +1,84 @@
+#include <canopen_master/program_download.h>
+#include <fstream>
+#include <iomanip>
+
+using namespace canopen;
+
+namespace {
+
+const uint16_t PROGRAM_DATA = 0x1F50;
+const uint16_t PROGRAM_CONTROL = 0x1F51;
+const uint16_t PROGRAM_IDENTIFICATION = 0x1F56;
+
+std::string hex(uint32_t val){
+    std::stringstream sstr;
+    sstr << "0x" << std::hex << std::setw(8) << std::setfill('0') << val;
+    return sstr.str();
+}
+
+}
+
+ProgramDownload::ProgramDownload(SDOClient &client, const Options &options)
+: client_(client), options_(options)
+{
+    if(options_.program == 0 || options_.program == 255) BOOST_THROW_EXCEPTION(std::invalid_argument("program number must be 1..254"));
+}
+
+void ProgramDownload::control(Control c, const char *step){
+    try{
+        client_.storage_->entry<uint8_t>(ObjectDict::Key(PROGRAM_CONTROL, options_.program)).set(c);
+    }
+    catch(const std::exception &e){
+        BOOST_THROW_EXCEPTION(ProgramDownloadException(std::string(step) + " failed: " + e.what()));
+    }
+}
+
+ProgramDownload::Result ProgramDownload::run(const SDOClient::DomainSource &source, size_t size, const ProgressFunc &progress){
+    Result result;
+    if(size == 0) BOOST_THROW_EXCEPTION(ProgramDownloadException("program image is empty"));
+    const SDOClient::BlockOptions block(1, options_.block_size);
+
+    control(Stop, "stop program");
+    if(options_.clear) control(Clear, "clear program");
+
+    const time_point start = get_abs_time();
+    SDOClient::ProgressFunc report;
+    if(progress){
+        report = [&progress, start](size_t done, size_t total){
+            double s = boost::chrono::duration_cast<boost::chrono::duration<double> >(get_abs_time() - start).count();
+            progress(done, total, s > 0 ? done / s : 0);
+        };
+    }
+    try{
+        client_.download(ObjectDict::Key(PROGRAM_DATA, options_.program), source, size, report, block);
+    }
+    catch(const std::exception &e){
+        BOOST_THROW_EXCEPTION(ProgramDownloadException(std::string("download failed: ") + e.what()));
+    }
+    result.bytes = size;
+    result.seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(get_abs_time() - start).count();
+
+    try{
+        result.identification = client_.storage_->entry<uint32_t>(ObjectDict::Key(PROGRAM_IDENTIFICATION, options_.program)).get();
+    }
+    catch(const std::exception &e){
+        if(options_.identification) BOOST_THROW_EXCEPTION(ProgramDownloadException(std::string("verification failed: ") + e.what()));
+    }
+    if(options_.identification && options_.identification != result.identification){
+        BOOST_THROW_EXCEPTION(ProgramDownloadException("verification failed: identification is " + hex(result.identification) + ", expected " + hex(options_.identification)));
+    }
+
+    if(options_.start) control(Start, "start program");
+    return result;
+}
+
+ProgramDownload::Result ProgramDownload::runFile(const std::string &path, const ProgressFunc &progress){
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if(!file) BOOST_THROW_EXCEPTION(ProgramDownloadException("could not open " + path));
+    size_t size = file.tellg();
+    file.seekg(0);
+    return run([&file](uint8_t *data, size_t len) -> size_t {
+        file.read(reinterpret_cast<char*>(data), len);
+        return file.gcount();
+    }, size, progress);
+}
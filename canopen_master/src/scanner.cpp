@@ -0,0 +1,164 @@
+#include <canopen_master/scanner.h>
+
+using namespace canopen;
+
+namespace {
+
+const uint16_t IDENTITY_INDEX = 0x1018;
+const int MAX_SEND_ATTEMPTS = 10;
+
+uint32_t get32(const uint8_t *data){ return data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24); }
+
+}
+
+BusScanner::BusScanner(const can::CommInterfaceSharedPtr &interface, const time_duration &window)
+: interface_(interface), window_(window), first_(1), last_(127), listen_(false) {}
+
+can::Frame BusScanner::request(uint8_t node_id, uint16_t index, uint8_t sub_index){
+    can::Frame msg(can::MsgHeader(0x600 + node_id), 8);
+    msg.data.fill(0);
+    msg.data[0] = 0x40; // initiate upload
+    msg.data[1] = index & 0xFF;
+    msg.data[2] = index >> 8;
+    msg.data[3] = sub_index;
+
+    Pending &p = pending_[node_id];
+    p.sub_index = index == IDENTITY_INDEX ? sub_index : 0;
+    p.sent = get_abs_time();
+    return msg;
+}
+
+void BusScanner::send(const can::Frame &msg, int attempts){
+    if(interface_->send(msg)) return;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    const uint8_t node_id = msg.id & 0x7F;
+    if(++attempts < MAX_SEND_ATTEMPTS){ // the transmit queue might be full during the burst
+        retry_.push_back(std::make_pair(msg, attempts));
+    }else{
+        pending_.erase(node_id);
+    }
+    cond_.notify_all();
+}
+
+bool BusScanner::handleSDO(uint8_t node_id, const can::Frame &msg, can::Frame &next){
+    std::map<uint8_t, Pending>::iterator it = pending_.find(node_id);
+    if(it == pending_.end() || msg.dlc != 8) return false;
+
+    const uint16_t index = msg.data[1] | (msg.data[2] << 8);
+    const uint8_t sub_index = msg.data[3];
+    const uint8_t expected_sub = it->second.sub_index;
+    if(expected_sub == 0 ? (index != 0x1000 || sub_index != 0) : (index != IDENTITY_INDEX || sub_index != expected_sub)) return false;
+
+    const bool ok = (msg.data[0] & 0xE2) == 0x42; // expedited upload response, segmented is not expected for UNSIGNED32
+    Device &d = devices_[node_id];
+    d.node_id = node_id;
+
+    if(expected_sub == 0){
+        d.sdo = true;
+        if(ok) d.device_type = get32(&msg.data[4]);
+    }else if(ok){
+        uint32_t val = get32(&msg.data[4]);
+        switch(expected_sub){
+            case 1: d.vendor_id = val; break;
+            case 2: d.product_code = val; break;
+            case 3: d.revision = val; break;
+            case 4: d.serial = val; break;
+        }
+        d.identity = expected_sub;
+    }
+
+    if(ok && expected_sub < 4){
+        next = request(node_id, IDENTITY_INDEX, expected_sub + 1);
+        return true;
+    }
+    pending_.erase(it); // aborted or complete, 0x1018 sub 1 is mandatory, the others are optional
+    return false;
+}
+
+void BusScanner::handleFrame(const can::Frame &msg){
+    if(msg.is_error || msg.is_rtr || msg.is_extended) return;
+    const unsigned int id = msg.id;
+    const uint8_t node_id = id & 0x7F;
+
+    can::Frame next;
+    bool has_next = false;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if(node_id < first_ || node_id > last_) return;
+
+        const bool known = devices_.find(node_id) != devices_.end();
+        if((id & ~0x7F) == 0x580 && pending_.find(node_id) != pending_.end()){
+            if(!known) devices_[node_id].response_time = get_abs_time() - start_;
+            has_next = handleSDO(node_id, msg, next);
+        }else if(listen_ && (id & ~0x7F) == 0x700 && msg.dlc == 1){
+            Device &d = devices_[node_id];
+            if(!known) d.response_time = get_abs_time() - start_;
+            d.node_id = node_id;
+            d.heartbeat = true;
+            d.state = Node::State(msg.data[0] & 0x7F);
+            if(d.state == Node::BootUp) d.boot_up = true;
+        }else{
+            return;
+        }
+        cond_.notify_all();
+    }
+    if(has_next) send(next); // never waits, retries are left to scan()
+}
+
+BusScanner::Devices BusScanner::scan(uint8_t first, uint8_t last, bool listen, const time_duration &listen_time){
+    boost::mutex::scoped_lock lock(mutex_);
+    devices_.clear();
+    pending_.clear();
+    retry_.clear();
+    first_ = first;
+    last_ = last;
+    listen_ = listen;
+    start_ = get_abs_time();
+
+    // the listener must not be created or destroyed while the lock is held, the dispatcher calls handleFrame with its own lock
+    lock.unlock();
+    can::FrameListenerConstSharedPtr listener = interface_->createMsgListenerM(this, &BusScanner::handleFrame);
+    lock.lock();
+
+    for(unsigned int id = first; id <= last; ++id){
+        can::Frame msg = request(id, 0x1000, 0);
+        lock.unlock();
+        send(msg);
+        lock.lock();
+    }
+
+    const time_point listen_end = start_ + (listen ? listen_time : time_duration::zero());
+    while(true){
+        while(!retry_.empty()){
+            std::vector<std::pair<can::Frame, int> > retry;
+            retry.swap(retry_);
+            lock.unlock();
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1)); // give the transmit queue some time
+            for(size_t i = 0; i < retry.size(); ++i) send(retry[i].first, retry[i].second);
+            lock.lock();
+            for(size_t i = 0; i < retry.size(); ++i){ // the window starts with the actual transmission
+                std::map<uint8_t, Pending>::iterator it = pending_.find(retry[i].first.id & 0x7F);
+                if(it != pending_.end()) it->second.sent = get_abs_time();
+            }
+        }
+        time_point now = get_abs_time();
+        time_point deadline = listen_end;
+        for(std::map<uint8_t, Pending>::iterator it = pending_.begin(); it != pending_.end();){
+            time_point timeout = it->second.sent + window_;
+            if(timeout <= now){
+                pending_.erase(it++);
+            }else{
+                if(deadline <= now || timeout < deadline) deadline = timeout;
+                ++it;
+            }
+        }
+        if(pending_.empty() && listen_end <= now) break;
+        cond_.wait_until(lock, deadline);
+    }
+    listen_ = false;
+    Devices devices = devices_;
+    lock.unlock();
+    listener.reset();
+    return devices;
+}
@@ -0,0 +1,111 @@
+#include <canopen_master/scheduler.h>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <time.h>
+
+using namespace canopen;
+
+typedef boost::chrono::high_resolution_clock clock_type;
+
+void canopen::sleep_until_precise(const clock_type::time_point &abs_time, const clock_type::duration &busy_wait){
+#if defined(_POSIX_MONOTONIC_CLOCK) && defined(BOOST_CHRONO_HAS_CLOCK_STEADY)
+    static_assert(clock_type::is_steady, "high_resolution_clock has to be based on CLOCK_MONOTONIC");
+    boost::this_thread::interruption_point();
+
+    const boost::chrono::nanoseconds ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>((abs_time - busy_wait).time_since_epoch());
+    timespec ts;
+    ts.tv_sec = ns.count() / 1000000000;
+    ts.tv_nsec = ns.count() % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) {}
+
+    boost::this_thread::interruption_point();
+#else
+    boost::this_thread::sleep_until(abs_time - busy_wait);
+#endif
+    while(busy_wait > clock_type::duration::zero() && clock_type::now() < abs_time) {}
+}
+
+void PeriodicScheduler::start(const clock::time_point &start){
+    deadline_ = start + period_;
+    last_wakeup_ = clock::time_point();
+}
+
+PeriodicScheduler::clock::time_point PeriodicScheduler::wait(){
+    sleep_until_precise(deadline_, busy_wait_);
+    clock::time_point now = clock::now();
+    clock::time_point deadline = deadline_;
+
+    latency_.record(now - deadline);
+    if(last_wakeup_ != clock::time_point()){
+        clock::duration diff = (now - last_wakeup_) - period_;
+        jitter_.record(diff < clock::duration::zero() ? -diff : diff);
+    }
+    last_wakeup_ = now;
+
+    deadline_ += period_;
+    if(deadline_ <= now){
+        ++overruns_;
+        switch(policy_){
+        case Skip:
+            while(deadline_ <= now){ // keep the phase, but do not burst missed deadlines
+                deadline_ += period_;
+                ++missed_;
+            }
+            break;
+        case CatchUp:
+            break;
+        case ShiftPhase:
+            missed_ += (now - deadline_) / period_ + 1;
+            deadline_ = now + period_;
+            break;
+        }
+    }
+    return deadline;
+}
+
+PeriodicScheduler::OverrunPolicy PeriodicScheduler::parsePolicy(const std::string &str){
+    if(str == "skip") return Skip;
+    if(str == "catch_up") return CatchUp;
+    if(str == "shift_phase") return ShiftPhase;
+    throw std::invalid_argument("unknown overrun policy '" + str + "'");
+}
+
+void PeriodicScheduler::report(LayerReport &report, const std::string &prefix) const {
+    report.add(prefix + "_missed", getMissed());
+    report.add(prefix + "_overruns", getOverruns());
+    jitter_.report(report, prefix + "_jitter");
+    latency_.report(report, prefix + "_latency");
+}
+
+void PeriodicScheduler::resetStatistics(){
+    missed_ = 0;
+    overruns_ = 0;
+    jitter_.reset();
+    latency_.reset();
+}
+
+void AdaptiveOffset::update(const clock::duration &latency){
+    latency_.record(latency);
+
+    clock::duration offset = get();
+    if(latency > offset) ++late_;
+
+    window_[next_] = latency;
+    next_ = (next_ + 1) % window_.size();
+    if(next_ == 0) filled_ = true;
+
+    clock::duration worst = *std::max_element(window_.begin(), filled_ ? window_.end() : window_.begin() + next_);
+    clock::duration target = std::min(worst + margin_, std::max(max_ - margin_, clock::duration::zero()));
+
+    if(target > offset || (filled_ && offset - target > hysteresis_)){
+        offset_ = target.count();
+    }
+}
+
+void AdaptiveOffset::report(LayerReport &report, const std::string &prefix) const {
+    report.add(prefix + "_us", boost::chrono::duration_cast<boost::chrono::microseconds>(get()).count());
+    report.add(prefix + "_late", getLate());
+    latency_.report(report, prefix + "_latency");
+}
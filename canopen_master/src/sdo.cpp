@@ -1,4 +1,5 @@
 #include <canopen_master/canopen.h>
+#include <canopen_master/sdo_monitor.h>
 
 using namespace canopen;
 
@@ -12,6 +13,18 @@ const uint8_t INITIATE_UPLOAD_RESPONSE =  (2 << 5);
 const uint8_t UPLOAD_SEGMENT_REQUEST =  (3 << 5);
 const uint8_t UPLOAD_SEGMENT_RESPONSE =  (0 << 5);
 const uint8_t ABORT_TRANSFER_REQUEST =  (4 << 5);
+const uint8_t BLOCK_UPLOAD_REQUEST =  (5 << 5);
+const uint8_t BLOCK_UPLOAD_RESPONSE =  (6 << 5);
+const uint8_t BLOCK_DOWNLOAD_REQUEST =  (6 << 5);
+const uint8_t BLOCK_DOWNLOAD_RESPONSE =  (5 << 5);
+const uint8_t BLOCK_CRC = (1<<2);
+const uint8_t BLOCK_SIZE_INDICATED = (1<<1);
+const uint8_t BLOCK_SUBCOMMAND_MASK = 3 | COMMAND_MASK;
+const uint8_t BLOCK_UPLOAD_SUBCOMMAND_MASK = 1 | COMMAND_MASK; // bit 1 indicates the size
+const uint8_t BLOCK_LAST_SEGMENT = (1<<7);
+const uint8_t MAX_BLOCK_SIZE = 127;
+const size_t STREAM_CHUNK_SIZE = 1024; ///< bytes read from the source or passed to the sink at once
+const uint32_t ABORT_APPLICATION = 0x08000020; // Data cannot be transferred or stored to the application
 
 
 #pragma pack(push) /* push current alignment to stack */
@@ -50,16 +63,14 @@ struct InitiateLong{
 
     size_t data_size(){
         if(expedited && size_indicated) return 4-num;
-        else if(!expedited && size_indicated) return payload[0] | (payload[3]<<8);
+        else if(!expedited && size_indicated) return payload[0] | (payload[1]<<8) | (payload[2]<<16) | (uint32_t(payload[3])<<24);
         else return 0;
     }
-    size_t apply_buffer(const String &buffer){
-        size_t size = buffer.size();
+    size_t apply_buffer(const String &buffer, size_t size){
         size_indicated = 1;
         if(size > 4){
             expedited = 0;
-            payload[0] = size & 0xFF;
-            payload[3] = (size >> 8) & 0xFF;
+            for(int i = 0; i < 4; ++i) payload[i] = (size >> (8*i)) & 0xFF;
             return 0;
         }else{
             expedited = 1;
@@ -100,11 +111,11 @@ struct SegmentLong{
 struct DownloadInitiateRequest: public FrameOverlay<InitiateLong>{
     static const uint8_t command = 1;
 
-    DownloadInitiateRequest(const Header &h, const canopen::ObjectDict::Entry &entry, const String &buffer, size_t &offset) : FrameOverlay(h) {
+    DownloadInitiateRequest(const Header &h, const canopen::ObjectDict::Entry &entry, const String &buffer, size_t &offset, size_t size) : FrameOverlay(h) {
         data.command = command;
         data.index = entry.index;
         data.sub_index = entry.sub_index;
-        offset = data.apply_buffer(buffer);
+        offset = data.apply_buffer(buffer, size);
    }
     DownloadInitiateRequest(const can::Frame &f) : FrameOverlay(f){ }
 };
@@ -289,14 +300,239 @@ struct AbortTranserRequest: public FrameOverlay<AbortData>{
 
 #pragma pack(pop) /* pop previous alignment from stack */
 
-void SDOClient::abort(uint32_t reason){
+/// block transfer frames, these are built bytewise because segments carry sequence numbers instead of commands
+struct BlockFrame: public can::Frame{
+    BlockFrame(const can::Header &h, uint8_t command) : can::Frame(h, 8) {
+        data.fill(0);
+        data[0] = command;
+    }
+    BlockFrame(const can::Header &h, uint8_t command, const canopen::ObjectDict::Entry &entry, uint32_t value) : BlockFrame(h, command) {
+        data[1] = entry.index & 0xFF;
+        data[2] = entry.index >> 8;
+        data[3] = entry.sub_index;
+        for(int i = 0; i < 4; ++i) data[4+i] = (value >> (8*i)) & 0xFF;
+    }
+    static bool matches(const can::Frame &msg, const canopen::ObjectDict::Entry &entry){
+        return msg.data[1] == (entry.index & 0xFF) && msg.data[2] == (entry.index >> 8) && msg.data[3] == entry.sub_index;
+    }
+};
+
+uint16_t SDOClient::crc(const uint8_t *data, size_t size, uint16_t crc){
+    for(size_t i = 0; i < size; ++i){
+        crc ^= uint16_t(data[i]) << 8;
+        for(int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+void SDOClient::setBlockTransfer(size_t threshold, uint8_t block_size){
+    if(block_size < 1 || block_size > MAX_BLOCK_SIZE) BOOST_THROW_EXCEPTION(std::invalid_argument("block size must be 1..127"));
+    block_threshold_ = threshold;
+    block_size_ = block_size;
+}
+
+SDOClient::BlockOptions::BlockOptions(size_t threshold, uint8_t size) : threshold(threshold), size(size) {
+    if(size < 1 || size > MAX_BLOCK_SIZE) BOOST_THROW_EXCEPTION(std::invalid_argument("block size must be 1..127"));
+}
+
+bool SDOClient::Channel::useBlockTransfer(const canopen::ObjectDict::Entry &entry, size_t size, bool upload){
+    if(segmented_only_) return false;
+    const size_t threshold = block_options_ ? block_options_->threshold : client_.block_threshold_.load();
+    if(threshold == 0 || (!block_options_ && !client_.block_supported_)) return false;
+    if(!upload) return size >= threshold;
+    switch(entry.data_type){
+        case ObjectDict::DEFTYPE_VISIBLE_STRING:
+        case ObjectDict::DEFTYPE_OCTET_STRING:
+        case ObjectDict::DEFTYPE_UNICODE_STRING:
+        case ObjectDict::DEFTYPE_DOMAIN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool SDOClient::Channel::fillBuffer(size_t n){
+    if(!source_) return true;
+    const size_t end = std::min(offset + n, total);
+    while(buffer_base_ + buffer.size() < end){
+        size_t pos = buffer.size();
+        size_t len = std::min(STREAM_CHUNK_SIZE, total - buffer_base_ - pos);
+        buffer.resize(pos + len);
+        size_t read = std::min(source_(reinterpret_cast<uint8_t*>(&buffer[pos]), len), len);
+        buffer.resize(pos + read);
+        if(read == 0) return false; // less data than indicated
+    }
+    return true;
+}
+
+void SDOClient::Channel::trimBuffer(){
+    const size_t n = offset - buffer_base_;
+    if(!source_ || n < STREAM_CHUNK_SIZE) return;
+    crc_ = crc(reinterpret_cast<const uint8_t*>(buffer.data()), n, crc_);
+    buffer.erase(buffer.begin(), buffer.begin() + n);
+    buffer_base_ += n;
+    if(progress_) progress_(offset, total);
+}
+
+bool SDOClient::Channel::flushBuffer(bool all){
+    if(!sink_ || buffer.empty() || (!all && buffer.size() < STREAM_CHUNK_SIZE)) return true;
+    crc_ = crc(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), crc_);
+    bool ok = sink_(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+    buffer_base_ += buffer.size();
+    buffer.clear();
+    if(progress_) progress_(buffer_base_, total);
+    return ok;
+}
+
+bool SDOClient::Channel::sendDownloadSegment(bool toggle){
+    trimBuffer();
+    if(!fillBuffer(8)) return false; // one more byte than the segment tells if it is the last one
+    size_t pos = offset - buffer_base_;
+    client_.interface_->send(last_msg = DownloadSegmentRequest(client_id, toggle, buffer, pos));
+    offset = buffer_base_ + pos;
+    return true;
+}
+
+bool SDOClient::Channel::sendDownloadBlock(){
+    trimBuffer(); // everything before offset was acknowledged
+    if(!fillBuffer(7 * size_t(block_ack_size_))) return false;
+    block_start_ = offset;
+    block_seq_ = 0;
+    while(block_seq_ < block_ack_size_ && offset < total){
+        size_t n = std::min<size_t>(7, total - offset);
+        BlockFrame frame(client_id, ++block_seq_ | (offset + n == total ? BLOCK_LAST_SEGMENT : 0));
+        memcpy(&frame.data[1], &buffer[offset - buffer_base_], n);
+        offset += n;
+        client_.interface_->send(frame);
+    }
+    block_state_ = BlockDownloadSub;
+    return true;
+}
+
+bool SDOClient::Channel::processBlockFrame(const can::Frame & msg){
+    uint32_t reason = 0;
+    const uint8_t command = msg.data[0];
+
+    if(command == ABORT_TRANSFER_REQUEST){ // never a valid segment, sequence numbers start at 1
+        AbortTranserRequest abort(msg);
+        ROSCANOPEN_ERROR("canopen_master", "abort" << std::hex << (uint32_t) abort.data.index << "#"<< std::dec << (uint32_t) abort.data.sub_index << ", reason: " << abort.data.text());
+        server_abort_ = abort.data.reason;
+        offset = 0;
+        return false;
+    }
+
+    switch(block_state_){
+        case BlockDownloadInit:
+            if((command & BLOCK_SUBCOMMAND_MASK) != BLOCK_DOWNLOAD_RESPONSE || !BlockFrame::matches(msg, *current_entry)){
+                reason = 0x08000000; // General error
+            }else if(msg.data[4] < 1 || msg.data[4] > MAX_BLOCK_SIZE){
+                reason = 0x05040002; // Invalid block size
+            }else{
+                block_crc_ = block_crc_ && (command & BLOCK_CRC);
+                block_ack_size_ = msg.data[4];
+                if(!sendDownloadBlock()) reason = ABORT_APPLICATION;
+            }
+            break;
+        case BlockDownloadSub:
+            if((command & BLOCK_SUBCOMMAND_MASK) != (BLOCK_DOWNLOAD_RESPONSE | 2)){
+                reason = 0x08000000; // General error
+            }else if(msg.data[1] > block_seq_){
+                reason = 0x05040003; // Invalid sequence number
+            }else if(msg.data[2] < 1 || msg.data[2] > MAX_BLOCK_SIZE){
+                reason = 0x05040002; // Invalid block size
+            }else{
+                offset = std::min(block_start_ + 7 * size_t(msg.data[1]), total); // repeat segments that were not acknowledged
+                block_ack_size_ = msg.data[2];
+                if(offset == total){
+                    size_t last = total % 7;
+                    BlockFrame frame(client_id, BLOCK_DOWNLOAD_REQUEST | ((last ? 7 - last : 0) << 2) | 1);
+                    uint16_t checksum = block_crc_ ? crc(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), crc_) : 0;
+                    frame.data[1] = checksum & 0xFF;
+                    frame.data[2] = checksum >> 8;
+                    client_.interface_->send(last_msg = frame);
+                    block_state_ = BlockDownloadEnd;
+                }else if(!sendDownloadBlock()){
+                    reason = ABORT_APPLICATION;
+                }
+            }
+            break;
+        case BlockDownloadEnd:
+            if((command & BLOCK_SUBCOMMAND_MASK) != (BLOCK_DOWNLOAD_RESPONSE | 1)) reason = 0x08000000; // General error
+            else done = true;
+            break;
+        case BlockUploadInit:
+            if((command & BLOCK_UPLOAD_SUBCOMMAND_MASK) != BLOCK_UPLOAD_RESPONSE || !BlockFrame::matches(msg, *current_entry)){
+                reason = 0x08000000; // General error
+            }else{
+                block_crc_ = block_crc_ && (command & BLOCK_CRC);
+                total = (command & BLOCK_SIZE_INDICATED) ? (msg.data[4] | (msg.data[5] << 8) | (msg.data[6] << 16) | (uint32_t(msg.data[7]) << 24)) : 0;
+                buffer.clear();
+                if(!sink_) buffer.reserve(total);
+                block_seq_ = 0;
+                block_state_ = BlockUpload;
+                client_.interface_->send(last_msg = BlockFrame(client_id, BLOCK_UPLOAD_REQUEST | 3)); // start
+            }
+            break;
+        case BlockUpload:
+        {
+            const uint8_t seq = command & ~BLOCK_LAST_SEGMENT;
+            bool last = false;
+            if(seq == block_seq_ + 1){ // out-of-order segments are dropped and repeated by the server
+                buffer.insert(buffer.end(), msg.data.begin() + 1, msg.data.end());
+                block_seq_ = seq;
+                last = command & BLOCK_LAST_SEGMENT;
+            }
+            if((command & BLOCK_LAST_SEGMENT) || seq >= block_ack_size_){ // end of sub-block
+                BlockFrame ack(client_id, BLOCK_UPLOAD_REQUEST | 2);
+                ack.data[1] = block_seq_;
+                ack.data[2] = block_ack_size_;
+                client_.interface_->send(last_msg = ack);
+                block_seq_ = 0;
+                if(last) block_state_ = BlockUploadEnd; // the last segment is padded, the size is known at the end
+                else if(!flushBuffer(false)) reason = ABORT_APPLICATION;
+            }
+            break;
+        }
+        case BlockUploadEnd:
+            if((command & BLOCK_UPLOAD_SUBCOMMAND_MASK) != (BLOCK_UPLOAD_RESPONSE | 1)){
+                reason = 0x08000000; // General error
+                break;
+            }
+            buffer.resize(buffer.size() - std::min<size_t>((command >> 2) & 7, buffer.size()));
+            if(block_crc_ && crc(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), crc_) != (msg.data[1] | (msg.data[2] << 8))){
+                reason = 0x05040004; // CRC error
+            }else if(total != 0 && total != buffer_base_ + buffer.size()){
+                reason = 0x06070010; // Data type does not match, length of service parameter does not match
+            }else{
+                offset = total = buffer_base_ + buffer.size();
+                if(!flushBuffer(true)){
+                    reason = ABORT_APPLICATION;
+                    break;
+                }
+                client_.interface_->send(last_msg = BlockFrame(client_id, BLOCK_UPLOAD_REQUEST | 1));
+                done = true;
+            }
+            break;
+        default:
+            reason = 0x08000000; // General error
+    }
+    if(reason){
+        abort(reason);
+        offset = 0;
+        return false;
+    }
+    return true;
+}
+
+void SDOClient::Channel::abort(uint32_t reason){
     if(current_entry){
-        interface_->send(last_msg = AbortTranserRequest(client_id, current_entry->index, current_entry->sub_index, reason));
+        client_.interface_->send(last_msg = AbortTranserRequest(client_id, current_entry->index, current_entry->sub_index, reason));
     }
 }
 
-bool SDOClient::processFrame(const can::Frame & msg){
+bool SDOClient::Channel::processFrame(const can::Frame & msg){
     if(msg.dlc != 8) return false;
+    if(block_state_ != NoBlock) return processBlockFrame(msg);
 
     uint32_t reason = 0;
     switch(msg.data[0] >> 5){
@@ -305,7 +541,7 @@ bool SDOClient::processFrame(const can::Frame & msg){
             DownloadInitiateResponse resp(msg);
             if(resp.test(last_msg, reason) ){
                 if(offset < total){
-                    interface_->send(last_msg = DownloadSegmentRequest(client_id, false, buffer, offset));
+                    if(!sendDownloadSegment(false)) reason = ABORT_APPLICATION;
                 }else{
                     done = true;
                 }
@@ -317,7 +553,7 @@ bool SDOClient::processFrame(const can::Frame & msg){
             DownloadSegmentResponse resp(msg);
             if( resp.test(last_msg, reason) ){
                 if(offset < total){
-                    interface_->send(last_msg = DownloadSegmentRequest(client_id, !resp.data.toggle, buffer, offset));
+                    if(!sendDownloadSegment(!resp.data.toggle)) reason = ABORT_APPLICATION;
                 }else{
                     done = true;
                 }
@@ -329,10 +565,13 @@ bool SDOClient::processFrame(const can::Frame & msg){
         {
             UploadInitiateResponse resp(msg);
             if( resp.test(last_msg, total, reason) ){
-                if(resp.read_data(buffer, offset, total)){
+                if(sink_ && !resp.data.expedited){ // do not allocate the indicated size
+                    total = resp.data.data_size();
+                    client_.interface_->send(last_msg = UploadSegmentRequest(client_id, false));
+                }else if(resp.read_data(buffer, offset, total)){
                     done = true;
                 }else{
-                    interface_->send(last_msg = UploadSegmentRequest(client_id, false));
+                    client_.interface_->send(last_msg = UploadSegmentRequest(client_id, false));
                 }
             }
             break;
@@ -341,11 +580,15 @@ bool SDOClient::processFrame(const can::Frame & msg){
         {
             UploadSegmentResponse resp(msg);
             if( resp.test(last_msg, reason) ){
-                if(resp.read_data(buffer, offset, total)){
+                size_t pos = offset - buffer_base_;
+                if(resp.read_data(buffer, pos, sink_ ? 0 : total) && (total == 0 || buffer_base_ + pos <= total)){
+                    offset = buffer_base_ + pos;
                     if(resp.data.done || offset == total){
                         done = true;
+                    }else if(!flushBuffer(false)){
+                        reason = ABORT_APPLICATION;
                     }else{
-                        interface_->send(last_msg = UploadSegmentRequest(client_id, !resp.data.toggle));
+                        client_.interface_->send(last_msg = UploadSegmentRequest(client_id, !resp.data.toggle));
                     }
                 }else{
                     // abort, size mismatch
@@ -356,6 +599,7 @@ bool SDOClient::processFrame(const can::Frame & msg){
             break;
         }
         case AbortTranserRequest::command:
+            server_abort_ = AbortTranserRequest(msg).data.reason;
             ROSCANOPEN_ERROR("canopen_master", "abort" << std::hex << (uint32_t) AbortTranserRequest(msg).data.index << "#"<< std::dec << (uint32_t) AbortTranserRequest(msg).data.sub_index << ", reason: " << AbortTranserRequest(msg).data.text());
             offset = 0;
             return false;
@@ -370,44 +614,38 @@ bool SDOClient::processFrame(const can::Frame & msg){
 
 }
 
-void SDOClient::init(){
-    assert(storage_);
-    assert(interface_);
-    const canopen::ObjectDict & dict = *storage_->dict_;
-
-    try{
-        client_id = SDOid(NodeIdOffset<uint32_t>::apply(dict(0x1200, 1).value(), storage_->node_id_)).header();
-    }
-    catch(...){
-        client_id = can::MsgHeader(0x600+ storage_->node_id_);
-    }
-
-    last_msg = AbortTranserRequest(client_id, 0,0,0);
-    current_entry = 0;
-
-    can::Header server_id;
-    try{
-        server_id = SDOid(NodeIdOffset<uint32_t>::apply(dict(0x1200, 2).value(), storage_->node_id_)).header();
-    }
-    catch(...){
-        server_id = can::MsgHeader(0x580+ storage_->node_id_);
-    }
-    reader_.listen(interface_, server_id);
-}
-
-void SDOClient::transmitAndWait(const canopen::ObjectDict::Entry &entry, const String &data,  String *result){
+void SDOClient::Channel::transmitAndWait(const canopen::ObjectDict::Entry &entry, const String &data,  String *result){
     buffer = data;
     offset = 0;
-    total = buffer.size();
+    buffer_base_ = 0;
+    crc_ = 0;
+    total = source_ ? stream_size_ : buffer.size();
     current_entry = &entry;
     done = false;
+    server_abort_ = 0;
+    block_crc_ = true;
 
+    const bool upload = result || sink_;
+    bool block = useBlockTransfer(entry, total, upload);
+    if(!block && !upload && !fillBuffer(8)){
+        THROW_WITH_KEY(Exception("SDO download source provided less data than indicated"), ObjectDict::Key(entry));
+    }
     can::BufferedReader::ScopedEnabler enabler(reader_);
 
-    if(result){
-        interface_->send(last_msg = UploadInitiateRequest(client_id, entry));
+    if(block && upload){
+        block_ack_size_ = block_options_ ? block_options_->size : client_.block_size_.load();
+        reader_.setMaxLen(block_ack_size_ + 1); // a whole sub-block might be queued
+        block_state_ = BlockUploadInit;
+        BlockFrame req(client_id, BLOCK_UPLOAD_REQUEST | BLOCK_CRC, entry, 0);
+        req.data[4] = block_ack_size_; // protocol switch threshold stays 0
+        client_.interface_->send(last_msg = req);
+    }else if(block){
+        block_state_ = BlockDownloadInit;
+        client_.interface_->send(last_msg = BlockFrame(client_id, BLOCK_DOWNLOAD_REQUEST | BLOCK_CRC | BLOCK_SIZE_INDICATED, entry, total));
+    }else if(upload){
+        client_.interface_->send(last_msg = UploadInitiateRequest(client_id, entry));
     }else{
-        interface_->send(last_msg = DownloadInitiateRequest(client_id, entry, buffer, offset));
+        client_.interface_->send(last_msg = DownloadInitiateRequest(client_id, entry, buffer, offset, total));
     }
 
     boost::this_thread::disable_interruption di;
@@ -425,27 +663,232 @@ void SDOClient::transmitAndWait(const canopen::ObjectDict::Entry &entry, const S
             break;
         }
     }
+    BlockState block_state = block_state_;
+    if(block){
+        block_state_ = NoBlock;
+        reader_.setMaxLen(1);
+    }
+    if(!done && server_abort_ == 0x05040001 && (block_state == BlockUploadInit || block_state == BlockDownloadInit)){
+        ROSCANOPEN_WARN("canopen_master", "node " << int(client_.storage_->node_id_) << " does not support block transfers, falling back to segmented transfers");
+        if(!block_options_) client_.block_supported_ = false; // Client/server command specifier not valid or unknown
+        segmented_only_ = true;
+        try{
+            transmitAndWait(entry, data, result);
+        }
+        catch(...){
+            segmented_only_ = false;
+            throw;
+        }
+        segmented_only_ = false;
+        return;
+    }
+    if(done && !flushBuffer(true)) offset = 0; // the sink refused the rest
     if(offset == 0 || offset != total){
         THROW_WITH_KEY(TimeoutException("SDO"), ObjectDict::Key(*current_entry));
     }
+    if(progress_) progress_(offset, total);
 
     if(result) *result=buffer;
 
 }
 
+SDOClient::Channel::Channel(SDOClient &client)
+: client_(client), reader_(false, 1), offset(0), total(0), done(false), current_entry(0), block_state_(NoBlock),
+  block_options_(0), segmented_only_(false), stream_size_(0), buffer_base_(0), crc_(0)
+{
+}
+
+void SDOClient::Channel::init(const can::Header &client_header, const can::Header &server_header){
+    client_id = client_header;
+    last_msg = AbortTranserRequest(client_id, 0,0,0);
+    current_entry = 0;
+    reader_.listen(client_.interface_, server_header);
+}
+
+void SDOClient::Channel::setStream(const DomainSink &sink, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions *block){
+    sink_ = sink;
+    block_options_ = block;
+    source_ = source;
+    stream_size_ = size;
+    progress_ = progress;
+}
+
+/// COB-ID from the dictionary, false if it is missing or marked as invalid
+static bool readSDOid(const canopen::ObjectDict & dict, uint16_t index, uint8_t sub_index, uint8_t node_id, uint32_t &cob_id){
+    if(!dict.has(index, sub_index)) return false;
+    try{
+        cob_id = NodeIdOffset<uint32_t>::apply(dict(index, sub_index).value(), node_id);
+    }
+    catch(...){
+        return false;
+    }
+    return !SDOid(cob_id).invalid;
+}
+
+void SDOClient::init(){
+    assert(storage_);
+    assert(interface_);
+    const canopen::ObjectDict & dict = *storage_->dict_;
+    const uint8_t node_id = storage_->node_id_;
+
+    std::vector<std::pair<uint32_t, uint32_t> > ids(1, std::make_pair(0x600 + node_id, 0x580 + node_id));
+    readSDOid(dict, 0x1200, 1, node_id, ids.front().first);
+    readSDOid(dict, 0x1200, 2, node_id, ids.front().second);
+
+    for(uint16_t index = 0x1201; index <= 0x12FF; ++index){
+        std::pair<uint32_t, uint32_t> id;
+        if(!readSDOid(dict, index, 1, node_id, id.first) || !readSDOid(dict, index, 2, node_id, id.second)) continue;
+        if(index >= 0x1280){ // client SDO parameter, sub 3 holds the node id of the server
+            try{
+                if(!dict.has(index, 3) || NodeIdOffset<uint8_t>::apply(dict(index, 3).value(), node_id) != node_id) continue;
+            }
+            catch(...){
+                continue;
+            }
+        }
+        ids.push_back(id);
+    }
+
+    boost::mutex::scoped_lock lock(channels_mutex_);
+    ids.insert(ids.end(), extra_ids_.begin(), extra_ids_.end());
+    while(std::find(busy_.begin(), busy_.end(), true) != busy_.end()){
+        channels_cond_.wait(lock);
+    }
+    channels_.clear();
+    for(size_t i = 0; i < ids.size(); ++i){
+        if(std::find(ids.begin(), ids.begin() + i, ids[i]) != ids.begin() + i){
+            ROSCANOPEN_WARN("canopen_master", "node " << int(node_id) << ": SDO channel " << std::hex << ids[i].first << "/" << ids[i].second << " is configured twice");
+            continue;
+        }
+        ChannelSharedPtr channel = std::make_shared<Channel>(*this);
+        channel->init(SDOid(ids[i].first).header(), SDOid(ids[i].second).header());
+        channels_.push_back(channel);
+    }
+    busy_.assign(channels_.size(), false);
+}
+
+void SDOClient::addChannel(uint32_t client_cob_id, uint32_t server_cob_id){
+    boost::mutex::scoped_lock lock(channels_mutex_);
+    extra_ids_.push_back(std::make_pair(client_cob_id, server_cob_id));
+}
+
+size_t SDOClient::getChannelCount(){
+    boost::mutex::scoped_lock lock(channels_mutex_);
+    return channels_.size();
+}
+
+bool SDOClient::isExpedited(const canopen::ObjectDict::Entry &entry, const String &data, bool upload){
+    if(!upload) return data.size() <= 4;
+    switch(entry.data_type){
+        case ObjectDict::DEFTYPE_VISIBLE_STRING:
+        case ObjectDict::DEFTYPE_OCTET_STRING:
+        case ObjectDict::DEFTYPE_UNICODE_STRING:
+        case ObjectDict::DEFTYPE_DOMAIN:
+            return false;
+        default:
+            return data.size() <= 4;
+    }
+}
+
+/// reserves an idle channel for one transfer. Expedited transfers go first and may use every channel,
+/// the others wait while expedited transfers are pending and leave the first channel to them if there are more.
+struct SDOClient::ChannelLock{
+    SDOClient &client;
+    size_t index;
+    ChannelSharedPtr channel;
+    ChannelLock(SDOClient &c, bool expedited) : client(c) {
+        boost::mutex::scoped_lock lock(client.channels_mutex_);
+        const time_point deadline = get_abs_time() + boost::chrono::seconds(2);
+        if(expedited) ++client.expedited_waiting_;
+        const size_t first = (expedited || client.channels_.size() < 2) ? 0 : 1;
+        while(!client.channels_.empty()){
+            if(expedited || client.expedited_waiting_ == 0){
+                for(size_t i = first; i < client.channels_.size() && !channel; ++i){
+                    if(!client.busy_[i]){
+                        index = i;
+                        channel = client.channels_[i];
+                    }
+                }
+            }
+            if(channel || client.channels_cond_.wait_until(lock, deadline) == boost::cv_status::timeout) break;
+        }
+        if(channel) client.busy_[index] = true;
+        if(expedited && --client.expedited_waiting_ == 0) client.channels_cond_.notify_all();
+    }
+    ~ChannelLock(){
+        if(!channel) return;
+        boost::mutex::scoped_lock lock(client.channels_mutex_);
+        client.busy_[index] = false;
+        client.channels_cond_.notify_all();
+    }
+};
+
 void SDOClient::read(const canopen::ObjectDict::Entry &entry, String &data){
-    boost::timed_mutex::scoped_lock lock(mutex, boost::chrono::seconds(2));
-    if(lock){
-        transmitAndWait(entry, data, &data);
+    SDOAccessMonitor::Transfer transfer(storage_->node_id_, entry, false);
+    ChannelLock lock(*this, isExpedited(entry, data, true));
+    if(lock.channel){
+        lock.channel->transmitAndWait(entry, data, &data);
     }else{
         THROW_WITH_KEY(TimeoutException("SDO read"), ObjectDict::Key(entry));
     }
 }
 void SDOClient::write(const canopen::ObjectDict::Entry &entry, const String &data){
-    boost::timed_mutex::scoped_lock lock(mutex, boost::chrono::seconds(2));
-    if(lock){
-        transmitAndWait(entry, data, 0);
+    SDOAccessMonitor::Transfer transfer(storage_->node_id_, entry, true);
+    ChannelLock lock(*this, isExpedited(entry, data, false));
+    if(lock.channel){
+        lock.channel->transmitAndWait(entry, data, 0);
     }else{
         THROW_WITH_KEY(TimeoutException("SDO write"), ObjectDict::Key(entry));
     }
 }
+
+/// resets the stream callbacks when the transfer is done or failed
+struct SDOClient::StreamScope{
+    Channel &channel;
+    StreamScope(Channel &c, const DomainSink &sink, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions *block) : channel(c) {
+        channel.setStream(sink, source, size, progress, block);
+    }
+    ~StreamScope(){
+        channel.setStream(nullptr, nullptr, 0, nullptr, 0);
+    }
+};
+
+void SDOClient::upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress){
+    upload(key, sink, progress, nullptr);
+}
+
+void SDOClient::upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress, const BlockOptions &block){
+    upload(key, sink, progress, &block);
+}
+
+void SDOClient::upload(const ObjectDict::Key &key, const DomainSink &sink, const ProgressFunc &progress, const BlockOptions *block){
+    const canopen::ObjectDict::Entry &entry = *storage_->dict_->get(key);
+    if(!entry.readable) THROW_WITH_KEY(AccessException("no read access"), key);
+
+    SDOAccessMonitor::Transfer transfer(storage_->node_id_, entry, false);
+    ChannelLock lock(*this, false);
+    if(!lock.channel) THROW_WITH_KEY(TimeoutException("SDO upload"), key);
+
+    StreamScope scope(*lock.channel, sink, nullptr, 0, progress, block);
+    lock.channel->transmitAndWait(entry, String(), 0);
+}
+
+void SDOClient::download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress){
+    download(key, source, size, progress, nullptr);
+}
+
+void SDOClient::download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions &block){
+    download(key, source, size, progress, &block);
+}
+
+void SDOClient::download(const ObjectDict::Key &key, const DomainSource &source, size_t size, const ProgressFunc &progress, const BlockOptions *block){
+    const canopen::ObjectDict::Entry &entry = *storage_->dict_->get(key);
+    if(!entry.writable) THROW_WITH_KEY(AccessException("no write access"), key);
+
+    SDOAccessMonitor::Transfer transfer(storage_->node_id_, entry, true);
+    ChannelLock lock(*this, size <= 4);
+    if(!lock.channel) THROW_WITH_KEY(TimeoutException("SDO download"), key);
+
+    StreamScope scope(*lock.channel, nullptr, source, size, progress, block);
+    lock.channel->transmitAndWait(entry, String(), 0);
+}
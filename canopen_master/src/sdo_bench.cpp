@@ -0,0 +1,270 @@
+#include <canopen_master/canopen.h>
+#include <canopen_master/histogram.h>
+#include <canopen_master/node_list.h>
+#include <canopen_master/sim_device.h>
+#include <socketcan_interface/dummy.h>
+#include <socketcan_interface/socketcan.h>
+
+#include <iostream>
+
+using namespace canopen;
+
+namespace {
+
+struct Options{
+    std::string device;
+    std::vector<unsigned int> nodes;
+    std::string read_key, write_key, domain_key;
+    std::vector<size_t> sizes;
+    unsigned int count;
+    uint8_t block_size;
+    Options() : read_key("1000"), sizes({64, 1024, 16384}), count(100), block_size(127) {}
+};
+
+bool parseSizes(const std::string &str, std::vector<size_t> &sizes){
+    std::stringstream sstr(str);
+    std::string item;
+    sizes.clear();
+    while(std::getline(sstr, item, ',')){
+        try{
+            size_t s = std::stoul(item);
+            if(s == 0) return false;
+            sizes.push_back(s);
+        }
+        catch(...){
+            return false;
+        }
+    }
+    return !sizes.empty();
+}
+
+void addDomain(const ObjectDictSharedPtr &dict, const std::string &str, bool writable){
+    ObjectDict::Key key(str);
+    if(dict->has(key)) return;
+    if(key.hasSub()){
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(key.index(), key.sub_index(), ObjectDict::DEFTYPE_DOMAIN, "", true, writable));
+    }else{
+        dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, key.index(), ObjectDict::DEFTYPE_DOMAIN, "", true, writable));
+    }
+}
+
+/// the client side only knows the objects under test, all are accessed as DOMAIN, so any size is accepted
+ObjectDictSharedPtr makeClientDict(const Options &opt){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    addDomain(dict, opt.read_key, false);
+    if(!opt.write_key.empty()) addDomain(dict, opt.write_key, true);
+    if(!opt.domain_key.empty()) addDomain(dict, opt.domain_key, true);
+    return dict;
+}
+
+/// device type (read-only), a UNSIGNED32 and a DOMAIN for the simulated nodes
+ObjectDictSharedPtr makeSimDict(){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x1000, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x20192))));
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x2000, ObjectDict::DEFTYPE_DOMAIN, "", true, true, false, HoldAny(String())));
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x2001, ObjectDict::DEFTYPE_UNSIGNED32, "", true, true, false, HoldAny(uint32_t(0))));
+    return dict;
+}
+
+typedef std::shared_ptr<SDOClient> SDOClientSharedPtr;
+
+/// all values in microseconds unless stated otherwise
+struct Result{
+    Histogram latency;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytes;
+    Result() : errors(0), bytes(0) {}
+};
+
+/// one transfer, returns the number of payload bytes or -1 on error
+typedef std::function<int64_t(SDOClient &client, size_t node_index)> TransferFunc;
+
+void runNode(SDOClient &client, size_t node_index, unsigned int count, const TransferFunc &func, Result &r){
+    for(unsigned int i = 0; i < count; ++i){
+        time_point start = get_abs_time();
+        int64_t bytes = -1;
+        try{
+            bytes = func(client, node_index);
+        }
+        catch(...){
+        }
+        if(bytes < 0){
+            ++r.errors;
+        }else{
+            r.latency.record(get_abs_time() - start);
+            r.bytes += bytes;
+        }
+    }
+}
+
+void printHeader(){
+    std::cout << "test,nodes,size,count,errors,p50_us,p90_us,p99_us,max_us,bytes_per_s" << std::endl;
+}
+
+/// runs func count times on all clients concurrently and prints one CSV line
+bool run(const std::string &test, size_t size, const Options &opt, std::vector<SDOClientSharedPtr> &clients, const TransferFunc &func){
+    Result r;
+    time_point start = get_abs_time();
+    boost::thread_group threads;
+    for(size_t i = 0; i < clients.size(); ++i){
+        threads.create_thread(std::bind(&runNode, std::ref(*clients[i]), i, opt.count, func, std::ref(r)));
+    }
+    threads.join_all();
+    double seconds = boost::chrono::duration_cast<boost::chrono::duration<double> >(get_abs_time() - start).count();
+
+    std::cout << test << "," << clients.size() << "," << size << "," << r.latency.count() + r.errors << "," << r.errors
+              << "," << r.latency.percentile(0.5) / 1000.0 << "," << r.latency.percentile(0.9) / 1000.0
+              << "," << r.latency.percentile(0.99) / 1000.0 << "," << r.latency.max() / 1000.0
+              << "," << (seconds > 0 ? r.bytes / seconds : 0) << std::endl;
+    return r.errors == 0;
+}
+
+int64_t readValue(SDOClient &client, const ObjectDict::Key &key, String *value){
+    String v = client.storage_->entry<String>(key).get();
+    if(value) *value = v;
+    return v.size();
+}
+int64_t writeValue(SDOClient &client, const ObjectDict::Key &key, const String &value){
+    client.storage_->entry<String>(key).set(value);
+    return value.size();
+}
+int64_t readBack(SDOClient &client, const ObjectDict::Key &key, const String &expected){
+    String v = client.storage_->entry<String>(key).get();
+    return v == expected ? int64_t(v.size()) : -1;
+}
+
+bool runAll(const Options &opt, std::vector<SDOClientSharedPtr> &clients){
+    bool ok = true;
+    ObjectDict::Key read_key(opt.read_key);
+    std::vector<String> values(clients.size());
+
+    for(size_t i = 0; i < clients.size(); ++i) clients[i]->setBlockTransfer(0);
+    ok = run("expedited_read", 0, opt, clients,
+             [&](SDOClient &c, size_t n){ return readValue(c, read_key, &values[n]); }) && ok;
+
+    if(!opt.write_key.empty()){
+        ObjectDict::Key write_key(opt.write_key);
+        for(size_t i = 0; i < clients.size(); ++i) readValue(*clients[i], write_key, &values[i]);
+        ok = run("expedited_write", 0, opt, clients,
+                 [&](SDOClient &c, size_t n){ return writeValue(c, write_key, values[n]); }) && ok;
+    }
+
+    if(opt.domain_key.empty()) return ok;
+    ObjectDict::Key domain_key(opt.domain_key);
+
+    for(size_t size: opt.sizes){
+        String data(std::string(size, 0));
+        for(size_t i = 0; i < size; ++i) data[i] = i * 7;
+
+        for(size_t i = 0; i < clients.size(); ++i) clients[i]->setBlockTransfer(0);
+        ok = run("segmented_download", size, opt, clients,
+                 [&](SDOClient &c, size_t){ return writeValue(c, domain_key, data); }) && ok;
+        ok = run("segmented_upload", size, opt, clients,
+                 [&](SDOClient &c, size_t){ return readBack(c, domain_key, data); }) && ok;
+
+        for(size_t i = 0; i < clients.size(); ++i) clients[i]->setBlockTransfer(1, opt.block_size);
+        ok = run("block_download", size, opt, clients,
+                 [&](SDOClient &c, size_t){ return writeValue(c, domain_key, data); }) && ok;
+        ok = run("block_upload", size, opt, clients,
+                 [&](SDOClient &c, size_t){ return readBack(c, domain_key, data); }) && ok;
+    }
+    return ok;
+}
+
+}
+
+int main(int argc, char** argv){
+    Options opt;
+    std::string nodes = "1";
+    std::string sizes = "64,1024,16384";
+    bool write_set = false, domain_set = false;
+    int block_size = opt.block_size;
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(i + 1 < argc && (arg == "-n" || arg == "--nodes")) nodes = argv[++i];
+        else if(i + 1 < argc && (arg == "-r" || arg == "--read")) opt.read_key = argv[++i];
+        else if(i + 1 < argc && (arg == "-w" || arg == "--write")){ opt.write_key = argv[++i]; write_set = true; }
+        else if(i + 1 < argc && (arg == "-d" || arg == "--domain")){ opt.domain_key = argv[++i]; domain_set = true; }
+        else if(i + 1 < argc && (arg == "-s" || arg == "--sizes")) sizes = argv[++i];
+        else if(i + 1 < argc && (arg == "-c" || arg == "--count")) opt.count = atoi(argv[++i]);
+        else if(i + 1 < argc && (arg == "-b" || arg == "--block-size")) block_size = atoi(argv[++i]);
+        else if(opt.device.empty() && arg[0] != '-') opt.device = arg;
+        else{
+            opt.device.clear();
+            break;
+        }
+    }
+    if(opt.device.empty()){
+        std::cout << "Usage: " << argv[0] << " DEVICE [-n NODES] [-r KEY] [-w KEY] [-d KEY] [-s SIZES] [-c COUNT] [-b BLOCK_SIZE]" << std::endl;
+        std::cout << "  DEVICE: SocketCAN device or 'sim' for simulated nodes" << std::endl;
+        std::cout << "  NODES: node ids, e.g. 1,8,16-32 (default: " << nodes << "), all are tested concurrently" << std::endl;
+        std::cout << "  -r KEY: object for expedited reads (default: " << opt.read_key << ")" << std::endl;
+        std::cout << "  -w KEY: object for expedited writes, its value is read and written back (default for sim: 2001)" << std::endl;
+        std::cout << "  -d KEY: DOMAIN object for segmented and block transfers of SIZES bytes (default for sim: 2000)" << std::endl;
+        std::cout << "Keys are given as index or indexsubN in hex, e.g. 1018sub1. The objects will be overwritten!" << std::endl;
+        std::cout << "Prints one CSV line per test, times in microseconds." << std::endl;
+        return 1;
+    }
+    if(!parseNodeList(nodes, opt.nodes)){
+        std::cout << "node list is invalid: " << nodes << std::endl;
+        return 1;
+    }
+    if(!parseSizes(sizes, opt.sizes)){
+        std::cout << "size list is invalid: " << sizes << std::endl;
+        return 1;
+    }
+    if(opt.count == 0 || block_size < 1 || block_size > 127){
+        std::cout << "count must be positive and block size 1..127" << std::endl;
+        return 1;
+    }
+    opt.block_size = block_size;
+
+    const bool sim = opt.device == "sim";
+    if(sim){
+        if(!write_set) opt.write_key = "2001";
+        if(!domain_set) opt.domain_key = "2000";
+    }
+
+    std::shared_ptr<can::DummyBus> bus;
+    can::ThreadedDummyInterfaceSharedPtr sim_interface;
+    std::vector<SimDeviceSharedPtr> devices;
+    can::DriverInterfaceSharedPtr interface;
+
+    if(sim){
+        bus = std::make_shared<can::DummyBus>("sdo_bench");
+        sim_interface = std::make_shared<can::ThreadedDummyInterface>();
+        sim_interface->init(bus->name, false, can::NoSettings::create());
+        for(unsigned int id: opt.nodes){
+            devices.push_back(std::make_shared<SimDevice>(sim_interface, makeSimDict(), id));
+            devices.back()->start();
+        }
+        interface = std::make_shared<can::ThreadedDummyInterface>();
+    }else{
+        interface = std::make_shared<can::ThreadedSocketCANInterface>();
+    }
+    if(!interface->init(sim ? bus->name : opt.device, false, can::NoSettings::create())){
+        std::cout << "could not open " << opt.device << std::endl;
+        return 1;
+    }
+
+    std::vector<SDOClientSharedPtr> clients;
+    for(unsigned int id: opt.nodes){
+        clients.push_back(std::make_shared<SDOClient>(interface, makeClientDict(opt), id));
+        clients.back()->init();
+    }
+
+    printHeader();
+    bool ok = runAll(opt, clients);
+
+    clients.clear();
+    devices.clear();
+    interface->shutdown();
+    if(sim_interface) sim_interface->shutdown();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#include <canopen_master/sdo_monitor.h>
+#include <socketcan_interface/logging.h>
+#include <stdexcept>
+
+using namespace canopen;
+
+SDOAccessMonitor& SDOAccessMonitor::instance(){
+    static SDOAccessMonitor monitor;
+    return monitor;
+}
+
+SDOAccessMonitor::Policy SDOAccessMonitor::parsePolicy(const std::string &str){
+    if(str == "allow") return Allow;
+    if(str == "warn") return Warn;
+    if(str == "refuse") return Refuse;
+    throw std::invalid_argument("unknown SDO policy '" + str + "'");
+}
+
+namespace {
+uint16_t traceId(bool write){
+    static const uint16_t read_id = TraceRecorder::intern("SDO read"), write_id = TraceRecorder::intern("SDO write");
+    return write ? write_id : read_id;
+}
+/// node id, index and sub index packed into one argument
+uint32_t traceArg(uint8_t node_id, const ObjectDict::Entry &entry){
+    return uint32_t(node_id) << 24 | uint32_t(entry.index) << 8 | entry.sub_index;
+}
+}
+
+SDOAccessMonitor::Transfer::Transfer(uint8_t node_id, const ObjectDict::Entry &entry, bool write, SDOAccessMonitor &monitor)
+: monitor_(monitor), node_id_(node_id), entry_(entry), write_(write), layer_(Layer::cyclicLayer()), phase_(Layer::cyclicPhase()),
+  start_(boost::chrono::high_resolution_clock::now())
+{
+    ++thread_count();
+    if(layer_ && monitor_.policy_ == Refuse){
+        {
+            boost::mutex::scoped_lock lock(monitor_.mutex_);
+            ++monitor_.record(Key(node_id_, entry_.index, entry_.sub_index, write_, layer_, phase_)).refused;
+        }
+        THROW_WITH_KEY(HotPathSDOException(std::string("SDO access refused in ") + phase_ + " of '" + layer_->name + "'"), ObjectDict::Key(entry_));
+    }
+    TraceRecorder::record(traceId(write_), TraceRecorder::Begin, traceArg(node_id_, entry_));
+}
+
+SDOAccessMonitor::Transfer::~Transfer(){
+    TraceRecorder::record(traceId(write_), TraceRecorder::End);
+    monitor_.add(node_id_, entry_, write_, layer_, phase_, boost::chrono::high_resolution_clock::now() - start_);
+}
+
+SDOAccessMonitor::Record& SDOAccessMonitor::record(const Key &key){
+    std::map<Key, Record>::iterator it = records_.find(key);
+    if(it == records_.end()){
+        Record r;
+        const Layer *layer;
+        const char *phase;
+        std::tie(r.node_id, r.index, r.sub_index, r.write, layer, phase) = key;
+        if(layer) r.layer = layer->name;
+        if(phase) r.phase = phase;
+        r.count = r.refused = 0;
+        r.sum_ns = r.max_ns = 0;
+        it = records_.insert(std::make_pair(key, r)).first;
+    }
+    return it->second;
+}
+
+void SDOAccessMonitor::add(uint8_t node_id, const ObjectDict::Entry &entry, bool write, const Layer *layer, const char *phase, const boost::chrono::high_resolution_clock::duration &latency){
+    int64_t ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(latency).count();
+    bool first = false;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        Record &r = record(Key(node_id, entry.index, entry.sub_index, write, layer, layer ? phase : 0));
+        first = r.count == 0;
+        ++r.count;
+        r.sum_ns += ns;
+        if(ns > r.max_ns) r.max_ns = ns;
+    }
+    if(layer){
+        ++cyclic_count_;
+        if(first && policy_ == Warn){
+            ROSCANOPEN_WARN("canopen_master", "SDO " << (write ? "write" : "read") << " of " << ObjectDict::Key(entry) << " on node " << int(node_id)
+                            << " in " << phase << " of '" << layer->name << "', consider mapping it to a PDO");
+        }
+    }
+}
+
+std::vector<SDOAccessMonitor::Record> SDOAccessMonitor::getRecords() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::vector<Record> res;
+    for(std::map<Key, Record>::const_iterator it = records_.begin(); it != records_.end(); ++it) res.push_back(it->second);
+    return res;
+}
+
+void SDOAccessMonitor::reset(){
+    boost::mutex::scoped_lock lock(mutex_);
+    records_.clear();
+    cyclic_count_ = 0;
+    reported_count_ = 0;
+}
+
+void SDOAccessMonitor::report(LayerReport &report) const {
+    const uint64_t count = getCyclicCount();
+    const bool recent = reported_count_.exchange(count) != count;
+    report.add("sdo_cyclic_count", count);
+    std::stringstream sstr;
+    for(const Record &r: getRecords()){
+        if(!r.cyclic()) continue;
+        if(sstr.tellp() > 0) sstr << ", ";
+        sstr << int(r.node_id) << ":" << ObjectDict::Key(r.index, r.sub_index) << (r.write ? " write" : " read")
+             << " in " << r.layer << "/" << r.phase << " x" << r.count;
+        if(r.count) sstr << " (mean " << r.sum_ns / r.count / 1000.0 << "us, max " << r.max_ns / 1000.0 << "us)";
+        if(r.refused) sstr << " refused x" << r.refused;
+    }
+    if(sstr.tellp() > 0){
+        if(recent && policy_ != Allow) report.warn("SDO access in control loop");
+        report.add("sdo_cyclic_objects", sstr.str());
+    }
+}
@@ -0,0 +1,141 @@
+#include <canopen_master/shared_image.h>
+#include <canopen_master/exceptions.h>
+#include <boost/chrono/duration.hpp>
+#include <boost/throw_exception.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace canopen;
+
+const uint32_t SharedImageHeader::MAGIC;
+const uint32_t SharedImageHeader::VERSION;
+
+namespace {
+const char * typeName(uint16_t t){
+    switch(t){
+        case ObjectDict::DEFTYPE_INTEGER8: return "int8";
+        case ObjectDict::DEFTYPE_INTEGER16: return "int16";
+        case ObjectDict::DEFTYPE_INTEGER32: return "int32";
+        case ObjectDict::DEFTYPE_INTEGER64: return "int64";
+        case ObjectDict::DEFTYPE_UNSIGNED8: return "uint8";
+        case ObjectDict::DEFTYPE_UNSIGNED16: return "uint16";
+        case ObjectDict::DEFTYPE_UNSIGNED32: return "uint32";
+        case ObjectDict::DEFTYPE_UNSIGNED64: return "uint64";
+        case ObjectDict::DEFTYPE_REAL32: return "float32";
+        case ObjectDict::DEFTYPE_REAL64: return "float64";
+        default: return "bytes";
+    }
+}
+}
+
+SharedImageExport::SharedImageExport(const ProcessImageSharedPtr &image, const std::string &name)
+: image_(image), name_(name), fd_(-1), mem_(0), mapped_(0), size_(0), layout_(0) {
+    if(!image_){
+        BOOST_THROW_EXCEPTION(Exception("process image is not enabled"));
+    }
+    fd_ = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if(fd_ < 0){
+        BOOST_THROW_EXCEPTION(Exception("shm_open '" + name_ + "' failed: " + strerror(errno)));
+    }
+    remap(image_->size());
+    layout_ = image_->getLayout();
+}
+
+SharedImageExport::~SharedImageExport(){
+    unmap();
+    if(fd_ >= 0){
+        ::close(fd_);
+        shm_unlink(name_.c_str());
+    }
+}
+
+void SharedImageExport::unmap(){
+    if(mem_) munmap(mem_, mapped_);
+    mem_ = 0;
+    mapped_ = 0;
+}
+
+void SharedImageExport::remap(size_t size){
+    unmap();
+    size_t total = sizeof(SharedImageHeader) + 2 * size;
+    if(ftruncate(fd_, total) != 0){
+        BOOST_THROW_EXCEPTION(Exception("ftruncate '" + name_ + "' failed: " + strerror(errno)));
+    }
+    void *mem = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(mem == MAP_FAILED){
+        BOOST_THROW_EXCEPTION(Exception("mmap '" + name_ + "' failed: " + strerror(errno)));
+    }
+    mem_ = mem;
+    mapped_ = total;
+    size_ = size;
+
+    SharedImageHeader *header = static_cast<SharedImageHeader*>(mem_);
+    uint64_t seq = header->magic == SharedImageHeader::MAGIC ? header->sequence.load() : 0; // readers must not see the sequence restart
+    header->sequence.store(seq | 1);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SharedImageHeader::MAGIC;
+    header->version = SharedImageHeader::VERSION;
+    header->size = size;
+    header->layout = layout_ + 1;
+    uint8_t *data = reinterpret_cast<uint8_t*>(header + 1);
+    std::fill(data, data + 2 * size, uint8_t());
+    header->sequence.store(seq + 2 - (seq & 1), std::memory_order_release);
+}
+
+bool SharedImageExport::update(){
+    uint64_t layout = image_->getLayout();
+    bool changed = layout != layout_;
+    if(changed || image_->size() != size_){
+        remap(image_->size());
+        layout_ = layout;
+    }
+
+    SharedImageHeader *header = static_cast<SharedImageHeader*>(mem_);
+    uint8_t *data = reinterpret_cast<uint8_t*>(header + 1);
+
+    header->sequence.fetch_add(1, std::memory_order_acq_rel);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ProcessImage::Tag tag;
+    image_->snapshot(data, data + size_, size_, tag);
+    header->layout = layout_;
+    header->cycle = tag.cycle;
+    header->sync_counter = tag.sync_counter;
+    header->stamp_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(tag.time.time_since_epoch()).count();
+
+    header->sequence.fetch_add(1, std::memory_order_release);
+    return changed;
+}
+
+void SharedImageExport::writeDescriptor(std::ostream &os, const std::map<uint8_t, std::string> &node_names) const {
+    os << "name: \"" << name_ << "\"\n";
+    os << "version: " << SharedImageHeader::VERSION << "\n";
+    os << "layout: " << layout_ << "\n";
+    os << "header_size: " << sizeof(SharedImageHeader) << "\n";
+    os << "size: " << size_ << "\n";
+    os << "data_offset: " << sizeof(SharedImageHeader) << "\n";
+    os << "valid_offset: " << sizeof(SharedImageHeader) + size_ << "\n";
+    os << "header:\n";
+    os << "  sequence: {offset: 8, type: uint64}\n";
+    os << "  layout: {offset: 16, type: uint64}\n";
+    os << "  size: {offset: 24, type: uint64}\n";
+    os << "  cycle: {offset: 32, type: uint64}\n";
+    os << "  stamp_ns: {offset: 40, type: int64}\n";
+    os << "  sync_counter: {offset: 48, type: uint8}\n";
+    os << "objects:\n";
+    for(const ProcessImage::Region &r: image_->getRegions()){
+        if(r.offset + r.size > size_) continue; // not exported yet
+        std::map<uint8_t, std::string>::const_iterator it = node_names.find(r.node_id);
+        os << "  - {node: \"" << (it != node_names.end() ? it->second : std::to_string(r.node_id)) << "\""
+           << ", node_id: " << int(r.node_id)
+           << ", object: \"" << ObjectDict::Key(r.index, r.sub_index) << "\""
+           << ", type: " << typeName(r.data_type)
+           << ", data_type: " << r.data_type
+           << ", offset: " << r.offset
+           << ", size: " << r.size << "}\n";
+    }
+}
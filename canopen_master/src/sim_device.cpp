@@ -0,0 +1,725 @@
+#include <canopen_master/sim_device.h>
+#include <socketcan_interface/logging.h>
+
+using namespace canopen;
+
+namespace {
+
+const uint32_t ABORT_TOGGLE = 0x05030000;
+const uint32_t ABORT_COMMAND = 0x05040001;
+const uint32_t ABORT_BLOCK_SIZE = 0x05040002;
+const uint32_t ABORT_CRC = 0x05040004;
+const uint32_t ABORT_WRITE_ONLY = 0x06010001;
+const uint32_t ABORT_READ_ONLY = 0x06010002;
+const uint32_t ABORT_NO_OBJECT = 0x06020000;
+const uint32_t ABORT_LENGTH = 0x06070010;
+const uint32_t ABORT_NO_SUB_INDEX = 0x06090011;
+const uint32_t ABORT_GENERAL = 0x08000000;
+
+const uint8_t MAX_BLOCK_SIZE = 127;
+
+uint32_t get32(const uint8_t *data){ return data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24); }
+void put32(uint8_t *data, uint32_t val){ for(int i = 0; i < 4; ++i) data[i] = (val >> (8*i)) & 0xFF; }
+
+template<typename T> void toRaw(const T &val, String &data){
+    data.resize(sizeof(T));
+    memcpy(&data.front(), &val, sizeof(T));
+}
+void toRaw(const String &val, String &data){ data = val; }
+template<typename T> bool fromRaw(const String &data, T &val){
+    if(data.size() != sizeof(T)) return false;
+    memcpy(&val, &data.front(), sizeof(T));
+    return true;
+}
+bool fromRaw(const String &data, String &val){ val = data; return true; }
+
+/// untyped access to the typed storage entries
+struct RawAccess{
+    typedef std::pair<std::function<void(String&)>, std::function<bool(const String&)> > Funcs;
+    template<typename T> static void read(ObjectStorage::Entry<T> entry, String &data){
+        toRaw(entry.get_cached(), data);
+    }
+    template<typename T> static bool write(ObjectStorage::Entry<T> entry, const String &data){
+        T val;
+        return fromRaw(data, val) && entry.set_cached(val);
+    }
+    template<const ObjectDict::DataTypes dt> static Funcs func(ObjectStorage &storage, const ObjectDict::Key &key){
+        typedef typename ObjectStorage::DataType<dt>::type T;
+        ObjectStorage::Entry<T> entry = storage.entry<T>(key);
+        return Funcs(std::bind(&RawAccess::read<T>, entry, std::placeholders::_1), std::bind(&RawAccess::write<T>, entry, std::placeholders::_1));
+    }
+    static Funcs get(ObjectStorage &storage, const ObjectDict::Entry &entry, const ObjectDict::Key &key){
+        return branch_type<RawAccess, Funcs (ObjectStorage &, const ObjectDict::Key &)>(entry.data_type)(storage, key);
+    }
+};
+
+/// the application may write any object, access rights are only enforced by the SDO server
+ObjectDictSharedPtr applicationDict(const ObjectDict &dict){
+    ObjectDictSharedPtr copy = std::make_shared<ObjectDict>(dict.device_info);
+    ObjectDict::ObjectDictMap::const_iterator it;
+    while(dict.iterate(it)){
+        std::shared_ptr<ObjectDict::Entry> entry = std::make_shared<ObjectDict::Entry>(*it->second);
+        entry->writable = true;
+        copy->insert(it->first.hasSub(), entry);
+    }
+    return copy;
+}
+
+/// key under which the entry is stored, VAR objects have no sub-index
+ObjectDict::Key storageKey(const ObjectDictConstSharedPtr &dict, const ObjectDict::Entry &entry){
+    return dict->has(entry.index, entry.sub_index) ? ObjectDict::Key(entry.index, entry.sub_index) : ObjectDict::Key(entry.index);
+}
+
+}
+
+uint16_t SimDevice::crc(const uint8_t *data, size_t size, uint16_t crc){
+    return SDOClient::crc(data, size, crc);
+}
+
+SimDevice::SimDevice(const can::CommInterfaceSharedPtr &interface, const ObjectDictConstSharedPtr &dict, uint8_t node_id,
+                     const TimerServiceSharedPtr &service)
+: node_id_(node_id), interface_(interface), dict_(dict), state_(Node::Unknown), pdos_changed_(true),
+  guard_(std::make_shared<Guard>(this)), service_(service), heartbeat_timer_(service_), heartbeat_ms_(0),
+  sdo_requests_(0), rpdo_count_(0), tpdo_count_(0)
+{
+    storage_ = std::make_shared<ObjectStorage>(applicationDict(*dict), node_id,
+                                               [](const ObjectDict::Entry&, String &){}, // values are held by the storage
+                                               std::bind(&SimDevice::handleWrite, this, std::placeholders::_1, std::placeholders::_2));
+    storage_->init_all();
+}
+
+SimDevice::~SimDevice(){
+    stop();
+}
+
+SimDeviceSharedPtr SimDevice::fromFile(const can::CommInterfaceSharedPtr &interface, const std::string &path, uint8_t node_id, const ObjectDict::Overlay &overlay){
+    ObjectDictSharedPtr dict = ObjectDict::fromFile(path, overlay);
+    if(!dict) BOOST_THROW_EXCEPTION(ParseException("could not parse " + path));
+    return std::make_shared<SimDevice>(interface, dict, node_id);
+}
+
+void SimDevice::start(){
+    {
+        boost::mutex::scoped_lock lock(guard_->mutex);
+        guard_->device = this;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    readSDOConfig();
+    nmt_listener_ = interface_->createMsgListenerM(can::MsgHeader(0x000), this, &SimDevice::handleNMT);
+    sync_listener_ = interface_->createMsgListenerM(can::MsgHeader(0x080), this, &SimDevice::handleSync);
+    for(size_t i = 0; i < sdo_servers_.size(); ++i){
+        sdo_servers_[i].listener = interface_->createMsgListener(sdo_servers_[i].rx, std::bind(&SimDevice::handleSDO, this, i, std::placeholders::_1));
+    }
+    buildPDOs();
+    lock.unlock();
+    updateListeners();
+    lock.lock();
+    bootUp();
+}
+
+void SimDevice::stop(){
+    {
+        boost::mutex::scoped_lock lock(guard_->mutex); // waits for pending updates
+        guard_->device = 0;
+    }
+    heartbeat_timer_.stop();
+    nmt_listener_.reset();
+    sync_listener_.reset();
+    for(SDOServer &server: sdo_servers_) server.listener.reset();
+    {
+        boost::mutex::scoped_lock lock(listeners_mutex_);
+        rpdo_listeners_.clear();
+    }
+    state_ = Node::Unknown;
+}
+
+Node::State SimDevice::getState(){
+    return state_;
+}
+
+void SimDevice::readSDOConfig(){
+    sdo_servers_.clear();
+    SDOServer server;
+    server.rx = can::MsgHeader(0x600 + node_id_);
+    server.tx = can::MsgHeader(0x580 + node_id_);
+    try{
+        if(dict_->has(0x1200, 1)) server.rx = can::MsgHeader(storage_->entry<uint32_t>(0x1200, 1).get_cached() & 0x1FFFFFFF);
+        if(dict_->has(0x1200, 2)) server.tx = can::MsgHeader(storage_->entry<uint32_t>(0x1200, 2).get_cached() & 0x1FFFFFFF);
+    }
+    catch(...){
+    }
+    sdo_servers_.push_back(server);
+
+    for(uint16_t index = 0x1201; index < 0x1280; ++index){ // additional server SDOs
+        if(!dict_->has(index, 1) || !dict_->has(index, 2)) continue;
+        try{
+            uint32_t rx = storage_->entry<uint32_t>(index, 1).get_cached();
+            uint32_t tx = storage_->entry<uint32_t>(index, 2).get_cached();
+            if((rx | tx) & 0x80000000) continue; // not valid
+            server.rx = can::MsgHeader(rx & 0x1FFFFFFF);
+            server.tx = can::MsgHeader(tx & 0x1FFFFFFF);
+            sdo_servers_.push_back(server);
+        }
+        catch(...){
+        }
+    }
+}
+
+void SimDevice::bootUp(){
+    state_ = Node::BootUp;
+    for(SDOServer &server: sdo_servers_) server.transfer = SDOTransfer();
+    if(dict_->has(0x1017)) heartbeat_ms_ = storage_->entry<uint16_t>(0x1017).get_cached();
+    else heartbeat_ms_ = 0;
+    pdos_changed_ = true;
+
+    can::Frame frame(can::MsgHeader(0x700 + node_id_), 1);
+    frame.data[0] = Node::BootUp;
+    interface_->send(frame);
+
+    state_ = Node::PreOperational;
+    restartHeartbeat();
+}
+
+void SimDevice::switchState(Node::State state){
+    if(state_ != state){
+        state_ = state;
+        if(heartbeat_ms_){ // report the new state immediately
+            sendHeartbeat();
+            restartHeartbeat();
+        }
+    }
+}
+
+bool SimDevice::sendHeartbeat(){
+    Node::State state = state_;
+    if(state == Node::Unknown || heartbeat_ms_ == 0) return false;
+    can::Frame frame(can::MsgHeader(0x700 + node_id_), 1);
+    frame.data[0] = state;
+    interface_->send(frame);
+    return true;
+}
+
+void SimDevice::restartHeartbeat(){
+    uint16_t ms = heartbeat_ms_;
+    if(ms) heartbeat_timer_.start(std::bind(&SimDevice::sendHeartbeat, this), boost::chrono::milliseconds(ms));
+    else heartbeat_timer_.stop();
+}
+
+void SimDevice::handleWrite(const ObjectDict::Entry &entry, const String &data){
+    if(entry.index == 0x1017 && data.size() == sizeof(uint16_t)){
+        uint16_t ms;
+        memcpy(&ms, &data.front(), sizeof(ms));
+        if(ms != heartbeat_ms_){
+            heartbeat_ms_ = ms;
+            if(state_ != Node::Unknown) restartHeartbeat();
+        }
+    }else if(entry.index >= 0x1400 && entry.index < 0x1C00){
+        pdos_changed_ = true;
+    }
+}
+
+void SimDevice::handleNMT(const can::Frame &msg){
+    if(msg.dlc != 2 || (msg.data[1] != 0 && msg.data[1] != node_id_)) return;
+    bool rebuilt = false;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_ == Node::Unknown) return;
+        switch(msg.data[0]){
+        case 1: // start
+            if(pdos_changed_){
+                buildPDOs();
+                rebuilt = true;
+            }
+            switchState(Node::Operational);
+            break;
+        case 2: // stop
+            switchState(Node::Stopped);
+            break;
+        case 128: // enter pre-operational
+            switchState(Node::PreOperational);
+            break;
+        case 129: // reset node
+            storage_->reset();
+            storage_->init_all();
+            bootUp();
+            break;
+        case 130: // reset communication
+            bootUp();
+            break;
+        }
+    }
+    if(rebuilt) scheduleUpdate(false);
+}
+
+void SimDevice::handleSync(const can::Frame &msg){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(state_ != Node::Operational) return;
+    for(PDO &pdo: tpdos_){
+        if(pdo.transmission_type > 240) continue;
+        if(++pdo.sync_count >= std::max<uint8_t>(pdo.transmission_type, 1)){ // acyclic PDOs are sent with every SYNC
+            pdo.sync_count = 0;
+            sendPDO(pdo);
+        }
+    }
+}
+
+void SimDevice::sendEventPDOs(){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(state_ != Node::Operational) return;
+    for(PDO &pdo: tpdos_){
+        if(pdo.transmission_type >= 254) sendPDO(pdo);
+    }
+}
+
+void SimDevice::sendPDO(PDO &pdo){
+    if(pdo.mpdo){ // one frame per object, addressed with the source node id
+        for(const Mapping &m: pdo.mappings){
+            can::Frame frame(pdo.header, 8);
+            frame.data.fill(0);
+            frame.data[0] = node_id_;
+            frame.data[1] = m.index & 0xFF;
+            frame.data[2] = m.index >> 8;
+            frame.data[3] = m.sub_index;
+            String buffer;
+            m.read(buffer);
+            memcpy(&frame.data[4], buffer.data(), std::min<size_t>(4, buffer.size()));
+            ++tpdo_count_;
+            interface_->send(frame);
+        }
+        return;
+    }
+    can::Frame frame(pdo.header, pdo.size);
+    frame.data.fill(0);
+    String buffer;
+    for(const Mapping &m: pdo.mappings){
+        if(!m.read) continue;
+        m.read(buffer);
+        memcpy(&frame.data[m.offset], &buffer.front(), std::min<size_t>(m.length, buffer.size()));
+    }
+    ++tpdo_count_;
+    interface_->send(frame);
+}
+
+void SimDevice::handleRPDO(const can::Frame &msg){
+    boost::mutex::scoped_lock lock(mutex_);
+    if(state_ != Node::Operational) return;
+    for(const PDO &pdo: rpdos_){
+        if(pdo.header.key() != msg.key()) continue;
+        if(msg.dlc < pdo.size) return;
+        if(pdo.mpdo){ // destination address mode, 0 addresses all nodes
+            const uint8_t dest = msg.data[0] & 0x7F;
+            if(!(msg.data[0] & 0x80) || (dest != 0 && dest != node_id_)) return;
+            uint32_t reason = 0;
+            ObjectDict::EntryConstSharedPtr entry = findEntry(msg.data[1] | (msg.data[2] << 8), msg.data[3], reason);
+            String current;
+            if(!entry || !entry->writable || !readValue(*entry, current, reason)) return;
+            const size_t size = std::min<size_t>(4, current.size());
+            if(writeValue(*entry, String(std::string(msg.data.begin() + 4, msg.data.begin() + 4 + size)), reason)) ++rpdo_count_;
+            return;
+        }
+        for(const Mapping &m: pdo.mappings){
+            if(m.write) m.write(String(std::string(msg.data.begin() + m.offset, msg.data.begin() + m.offset + m.length)));
+        }
+        ++rpdo_count_;
+        return;
+    }
+}
+
+bool SimDevice::buildPDO(uint16_t comm_index, uint16_t map_index, PDO &pdo){
+    if(!dict_->has(comm_index, 1) || !dict_->has(map_index, 0)) return false;
+    uint32_t cob_id = storage_->entry<uint32_t>(comm_index, 1).get_cached();
+    if(cob_id & (1u << 31)) return false; // invalid
+    pdo.header = can::Header(cob_id & 0x1FFFFFFF, cob_id & (1 << 29), false, false);
+    pdo.transmission_type = dict_->has(comm_index, 2) ? storage_->entry<uint8_t>(comm_index, 2).get_cached() : 255;
+    pdo.sync_count = 0;
+    pdo.size = 0;
+    pdo.mpdo = 0;
+
+    uint8_t num = storage_->entry<uint8_t>(map_index, 0).get_cached();
+    if(num == 0xFF && comm_index < 0x1800){ // DAM-MPDO consumer, the frame addresses the object
+        pdo.mpdo = num;
+        pdo.size = 8;
+        return true;
+    }
+    if(num == 0xFE && comm_index >= 0x1800){ // SAM-MPDO producer, sends the objects of the object scanner list
+        pdo.mpdo = num;
+        pdo.size = 8;
+        for(uint16_t index = 0x1FA0; index <= 0x1FCF; ++index){
+            for(uint16_t sub = 1; sub <= 0xFE && dict_->has(index, sub); ++sub){
+                uint32_t val = storage_->entry<uint32_t>(index, sub).get_cached();
+                for(uint32_t i = 0; val != 0 && i < std::max(val >> 24, 1u); ++i){
+                    Mapping m;
+                    m.index = (val >> 8) & 0xFFFF;
+                    m.sub_index = (val & 0xFF) + i;
+                    m.offset = 4;
+                    m.length = 4;
+                    uint32_t reason = 0;
+                    ObjectDict::EntryConstSharedPtr entry = findEntry(m.index, m.sub_index, reason);
+                    if(!entry) return false;
+                    RawAccess::Funcs funcs = RawAccess::get(*storage_, *entry, storageKey(dict_, *entry));
+                    m.read = funcs.first;
+                    m.write = funcs.second;
+                    pdo.mappings.push_back(m);
+                }
+            }
+        }
+        return true;
+    }
+    if(num > 0x40){
+        ROSCANOPEN_ERROR("canopen_master", "simulated node " << int(node_id_) << ": unsupported number of mapped objects " << int(num));
+        return false;
+    }
+    for(uint8_t sub = 1; sub <= num; ++sub){
+        uint32_t val = storage_->entry<uint32_t>(map_index, sub).get_cached();
+        uint16_t index = val >> 16;
+        uint8_t sub_index = (val >> 8) & 0xFF;
+        uint8_t bits = val & 0xFF;
+        if(bits % 8 != 0 || pdo.size + bits / 8 > 8){
+            ROSCANOPEN_ERROR("canopen_master", "simulated node " << int(node_id_) << ": unsupported mapping " << std::hex << val);
+            return false;
+        }
+        Mapping m;
+        m.offset = pdo.size;
+        m.length = bits / 8;
+        m.index = index;
+        m.sub_index = sub_index;
+        if(index >= 0x1000){ // otherwise dummy entry
+            uint32_t reason = 0;
+            ObjectDict::EntryConstSharedPtr entry = findEntry(index, sub_index, reason);
+            if(!entry) return false;
+            RawAccess::Funcs funcs = RawAccess::get(*storage_, *entry, storageKey(dict_, *entry));
+            m.read = funcs.first;
+            m.write = funcs.second;
+        }
+        pdo.size += m.length;
+        pdo.mappings.push_back(m);
+    }
+    return true;
+}
+
+void SimDevice::buildPDOs(){
+    pdos_changed_ = false;
+    rpdos_.clear();
+    tpdos_.clear();
+    for(uint16_t i = 0; i < 512; ++i){
+        PDO rpdo, tpdo;
+        if(buildPDO(0x1400 + i, 0x1600 + i, rpdo)) rpdos_.push_back(rpdo);
+        if(buildPDO(0x1800 + i, 0x1A00 + i, tpdo)) tpdos_.push_back(tpdo);
+    }
+}
+
+void SimDevice::updateListeners(){
+    std::vector<can::Header> headers;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        for(const PDO &pdo: rpdos_) headers.push_back(pdo.header);
+    }
+    boost::mutex::scoped_lock lock(listeners_mutex_);
+    std::map<unsigned int, can::FrameListenerConstSharedPtr> listeners;
+    for(const can::Header &h: headers){
+        std::map<unsigned int, can::FrameListenerConstSharedPtr>::iterator it = rpdo_listeners_.find(h.key());
+        listeners[h.key()] = it != rpdo_listeners_.end() ? it->second : interface_->createMsgListenerM(h, this, &SimDevice::handleRPDO);
+    }
+    rpdo_listeners_.swap(listeners); // stale listeners are released here
+}
+
+void SimDevice::scheduleUpdate(bool build){
+    std::shared_ptr<Guard> guard = guard_;
+    service_->getIOService().post([guard, build](){
+        boost::mutex::scoped_lock lock(guard->mutex);
+        if(!guard->device) return;
+        if(build){
+            boost::mutex::scoped_lock lock(guard->device->mutex_);
+            guard->device->buildPDOs();
+        }
+        guard->device->updateListeners();
+    });
+}
+
+ObjectDict::EntryConstSharedPtr SimDevice::findEntry(uint16_t index, uint8_t sub_index, uint32_t &reason){
+    if(dict_->has(index, sub_index)) return dict_->get(ObjectDict::Key(index, sub_index));
+    if(sub_index == 0 && dict_->has(index)) return dict_->get(ObjectDict::Key(index));
+    reason = (dict_->has(index) || dict_->has(index, 0)) ? ABORT_NO_SUB_INDEX : ABORT_NO_OBJECT;
+    return ObjectDict::EntryConstSharedPtr();
+}
+
+bool SimDevice::readValue(const ObjectDict::Entry &entry, String &data, uint32_t &reason){
+    if(!entry.readable){
+        reason = ABORT_WRITE_ONLY;
+        return false;
+    }
+    try{
+        RawAccess::get(*storage_, entry, storageKey(dict_, entry)).first(data);
+        return true;
+    }
+    catch(...){
+        reason = ABORT_GENERAL;
+        return false;
+    }
+}
+
+bool SimDevice::writeValue(const ObjectDict::Entry &entry, const String &data, uint32_t &reason){
+    if(!entry.writable){
+        reason = ABORT_READ_ONLY;
+        return false;
+    }
+    try{
+        if(RawAccess::get(*storage_, entry, storageKey(dict_, entry)).second(data)) return true;
+        reason = ABORT_LENGTH;
+    }
+    catch(...){
+        reason = ABORT_GENERAL;
+    }
+    return false;
+}
+
+void SimDevice::sendSDO(const SDOServer &server, uint8_t command, uint16_t index, uint8_t sub_index, const uint8_t *payload, size_t len){
+    can::Frame frame(server.tx, 8);
+    frame.data.fill(0);
+    frame.data[0] = command;
+    frame.data[1] = index & 0xFF;
+    frame.data[2] = index >> 8;
+    frame.data[3] = sub_index;
+    if(payload) memcpy(&frame.data[4], payload, std::min<size_t>(len, 4));
+    interface_->send(frame);
+}
+
+void SimDevice::abortSDO(SDOServer &server, uint16_t index, uint8_t sub_index, uint32_t reason){
+    uint8_t payload[4];
+    put32(payload, reason);
+    sendSDO(server, 0x80, index, sub_index, payload, 4);
+    server.transfer = SDOTransfer();
+}
+
+void SimDevice::sendUploadBlock(SDOServer &server){
+    SDOTransfer &sdo = server.transfer;
+    sdo.block_start = sdo.offset;
+    for(uint8_t seq = 1; seq <= sdo.block_size; ++seq){
+        size_t n = std::min<size_t>(7, sdo.buffer.size() - sdo.offset);
+        bool last = sdo.offset + n == sdo.buffer.size();
+        can::Frame frame(server.tx, 8);
+        frame.data.fill(0);
+        frame.data[0] = seq | (last ? 0x80 : 0);
+        if(n) memcpy(&frame.data[1], &sdo.buffer[sdo.offset], n);
+        sdo.offset += n;
+        interface_->send(frame);
+        if(last) break;
+    }
+    sdo.mode = SDOTransfer::BlockUpload;
+}
+
+void SimDevice::handleSDO(size_t server_index, const can::Frame &msg){
+    if(msg.dlc != 8) return;
+    bool update = false;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if(state_ == Node::Unknown || state_ == Node::Stopped || server_index >= sdo_servers_.size()) return;
+        SDOServer &server = sdo_servers_[server_index];
+        SDOTransfer &sdo = server.transfer;
+        const uint8_t *data = msg.data.data();
+        const uint16_t index = data[1] | (data[2] << 8);
+        const uint8_t sub_index = data[3];
+        uint32_t reason = 0;
+
+        if(sdo.mode == SDOTransfer::BlockDownload){ // sub-blocks carry sequence numbers instead of commands
+            if(data[0] == 0x80){ // abort
+                sdo = SDOTransfer();
+                return;
+            }
+            uint8_t seq = data[0] & 0x7F;
+            bool last = false;
+            if(seq == sdo.sequence + 1){ // out-of-order segments are dropped, the client repeats them after the acknowledge
+                sdo.buffer.insert(sdo.buffer.end(), data + 1, data + 8);
+                sdo.sequence = seq;
+                last = data[0] & 0x80;
+            }
+            if((data[0] & 0x80) || seq == sdo.block_size){ // end of sub-block
+                can::Frame frame(server.tx, 8);
+                frame.data.fill(0);
+                frame.data[0] = 0xA2;
+                frame.data[1] = sdo.sequence;
+                frame.data[2] = sdo.block_size;
+                interface_->send(frame);
+                sdo.sequence = 0;
+                if(last) sdo.mode = SDOTransfer::BlockDownloadEnd;
+            }
+            return;
+        }
+
+        ++sdo_requests_;
+        switch(data[0] >> 5){
+        case 1: // initiate download
+        {
+            sdo = SDOTransfer();
+            ObjectDict::EntryConstSharedPtr entry = findEntry(index, sub_index, reason);
+            if(entry && !entry->writable) reason = ABORT_READ_ONLY;
+            if(reason) break;
+            if(data[0] & 0x02){ // expedited
+                size_t size = 4;
+                if(data[0] & 0x01){
+                    size -= (data[0] >> 2) & 3;
+                }else{ // size not indicated, use the size of the current value
+                    String current;
+                    if(readValue(*entry, current, reason) && current.size() < size) size = current.size();
+                    reason = 0;
+                }
+                if(!writeValue(*entry, String(std::string(data + 4, data + 4 + size)), reason)) break;
+                sendSDO(server, 0x60, index, sub_index);
+            }else{
+                sdo.mode = SDOTransfer::SegmentedDownload;
+                sdo.entry = entry;
+                sdo.total = (data[0] & 0x01) ? get32(data + 4) : 0;
+                sendSDO(server, 0x60, index, sub_index);
+            }
+            update = pdos_changed_;
+            break;
+        }
+        case 0: // download segment
+        {
+            if(sdo.mode != SDOTransfer::SegmentedDownload){ reason = ABORT_COMMAND; break; }
+            bool toggle = data[0] & 0x10;
+            if(toggle != sdo.toggle){ reason = ABORT_TOGGLE; break; }
+            size_t n = 7 - ((data[0] >> 1) & 7);
+            sdo.buffer.insert(sdo.buffer.end(), data + 1, data + 1 + n);
+            if(data[0] & 0x01){ // last segment
+                if(sdo.total && sdo.total != sdo.buffer.size()){ reason = ABORT_LENGTH; break; }
+                if(!writeValue(*sdo.entry, sdo.buffer, reason)) break;
+                sdo.mode = SDOTransfer::Idle;
+                update = pdos_changed_;
+            }
+            can::Frame frame(server.tx, 8);
+            frame.data.fill(0);
+            frame.data[0] = 0x20 | (toggle ? 0x10 : 0);
+            interface_->send(frame);
+            sdo.toggle = !toggle;
+            break;
+        }
+        case 2: // initiate upload
+        {
+            sdo = SDOTransfer();
+            ObjectDict::EntryConstSharedPtr entry = findEntry(index, sub_index, reason);
+            String buffer;
+            if(!entry || !readValue(*entry, buffer, reason)) break;
+            if(!buffer.empty() && buffer.size() <= 4){ // expedited transfers carry at least one byte
+                sendSDO(server, 0x43 | ((4 - buffer.size()) << 2), index, sub_index, reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+            }else{
+                uint8_t size[4];
+                put32(size, buffer.size());
+                sendSDO(server, 0x41, index, sub_index, size, 4);
+                sdo.mode = SDOTransfer::SegmentedUpload;
+                sdo.entry = entry;
+                sdo.buffer = buffer;
+            }
+            break;
+        }
+        case 3: // upload segment
+        {
+            if(sdo.mode != SDOTransfer::SegmentedUpload){ reason = ABORT_COMMAND; break; }
+            bool toggle = data[0] & 0x10;
+            if(toggle != sdo.toggle){ reason = ABORT_TOGGLE; break; }
+            size_t n = std::min<size_t>(7, sdo.buffer.size() - sdo.offset);
+            bool last = sdo.offset + n == sdo.buffer.size();
+            can::Frame frame(server.tx, 8);
+            frame.data.fill(0);
+            frame.data[0] = (toggle ? 0x10 : 0) | ((7 - n) << 1) | (last ? 0x01 : 0);
+            memcpy(&frame.data[1], &sdo.buffer[sdo.offset], n);
+            interface_->send(frame);
+            sdo.offset += n;
+            sdo.toggle = !toggle;
+            if(last) sdo.mode = SDOTransfer::Idle;
+            break;
+        }
+        case 4: // abort
+            sdo = SDOTransfer();
+            break;
+        case 6: // block download
+            if((data[0] & 0x01) == 0){ // initiate
+                sdo = SDOTransfer();
+                ObjectDict::EntryConstSharedPtr entry = findEntry(index, sub_index, reason);
+                if(entry && !entry->writable) reason = ABORT_READ_ONLY;
+                if(reason) break;
+                sdo.mode = SDOTransfer::BlockDownload;
+                sdo.entry = entry;
+                sdo.crc = data[0] & 0x04;
+                sdo.total = (data[0] & 0x02) ? get32(data + 4) : 0;
+                sdo.block_size = MAX_BLOCK_SIZE;
+                uint8_t payload[1] = { sdo.block_size };
+                sendSDO(server, 0xA4, index, sub_index, payload, 1);
+            }else{ // end
+                if(sdo.mode != SDOTransfer::BlockDownloadEnd){ reason = ABORT_COMMAND; break; }
+                size_t unused = (data[0] >> 2) & 7;
+                sdo.buffer.resize(sdo.buffer.size() - std::min(unused, sdo.buffer.size()));
+                uint16_t expected = data[1] | (data[2] << 8);
+                if(sdo.crc && crc(reinterpret_cast<const uint8_t*>(sdo.buffer.data()), sdo.buffer.size()) != expected){ reason = ABORT_CRC; break; }
+                if(sdo.total && sdo.total != sdo.buffer.size()){ reason = ABORT_LENGTH; break; }
+                if(!writeValue(*sdo.entry, sdo.buffer, reason)) break;
+                can::Frame frame(server.tx, 8);
+                frame.data.fill(0);
+                frame.data[0] = 0xA1;
+                interface_->send(frame);
+                sdo = SDOTransfer();
+                update = pdos_changed_;
+            }
+            break;
+        case 5: // block upload
+            switch(data[0] & 0x03){
+            case 0: // initiate
+            {
+                sdo = SDOTransfer();
+                ObjectDict::EntryConstSharedPtr entry = findEntry(index, sub_index, reason);
+                String buffer;
+                if(!entry || !readValue(*entry, buffer, reason)) break;
+                if(data[4] < 1 || data[4] > MAX_BLOCK_SIZE){ reason = ABORT_BLOCK_SIZE; break; }
+                sdo.mode = SDOTransfer::BlockUploadInit;
+                sdo.entry = entry;
+                sdo.buffer = buffer;
+                sdo.crc = data[0] & 0x04;
+                sdo.block_size = data[4];
+                uint8_t size[4];
+                put32(size, buffer.size());
+                sendSDO(server, 0xC6, index, sub_index, size, 4);
+                break;
+            }
+            case 3: // start
+                if(sdo.mode != SDOTransfer::BlockUploadInit){ reason = ABORT_COMMAND; break; }
+                sendUploadBlock(server);
+                break;
+            case 2: // acknowledge
+            {
+                if(sdo.mode != SDOTransfer::BlockUpload){ reason = ABORT_COMMAND; break; }
+                if(data[2] < 1 || data[2] > MAX_BLOCK_SIZE){ reason = ABORT_BLOCK_SIZE; break; }
+                sdo.offset = std::min(sdo.block_start + 7 * size_t(data[1]), sdo.buffer.size());
+                bool all_acked = sdo.offset == sdo.buffer.size() && (sdo.buffer.size() == 0 || data[1] > 0);
+                sdo.block_size = data[2];
+                if(all_acked){
+                    size_t last = sdo.buffer.size() % 7;
+                    size_t unused = (sdo.buffer.size() && last == 0) ? 0 : 7 - last;
+                    uint16_t checksum = sdo.crc ? crc(reinterpret_cast<const uint8_t*>(sdo.buffer.data()), sdo.buffer.size()) : 0;
+                    can::Frame frame(server.tx, 8);
+                    frame.data.fill(0);
+                    frame.data[0] = 0xC1 | (unused << 2);
+                    frame.data[1] = checksum & 0xFF;
+                    frame.data[2] = checksum >> 8;
+                    interface_->send(frame);
+                    sdo.mode = SDOTransfer::BlockUploadEnd;
+                }else{
+                    sendUploadBlock(server);
+                }
+                break;
+            }
+            case 1: // end
+                if(sdo.mode != SDOTransfer::BlockUploadEnd) reason = ABORT_COMMAND;
+                else sdo = SDOTransfer();
+                break;
+            }
+            break;
+        default:
+            reason = ABORT_COMMAND;
+        }
+        if(reason){
+            if(sdo.entry) abortSDO(server, sdo.entry->index, sdo.entry->sub_index, reason); // segment of a running transfer
+            else abortSDO(server, index, sub_index, reason);
+        }
+    }
+    if(update) scheduleUpdate(true);
+}
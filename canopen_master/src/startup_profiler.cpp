@@ -0,0 +1,84 @@
+#include <canopen_master/startup_profiler.h>
+#include <canopen_master/sdo_monitor.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace canopen;
+
+StartupProfiler::Phase::Phase(uint8_t node_id, const char *phase, StartupProfiler &profiler)
+: profiler_(profiler), node_id_(node_id), phase_(phase), start_(boost::chrono::high_resolution_clock::now()),
+  sdo_start_(SDOAccessMonitor::getThreadCount())
+{}
+
+StartupProfiler::Phase::~Phase(){
+    profiler_.add(node_id_, phase_, boost::chrono::high_resolution_clock::now() - start_, SDOAccessMonitor::getThreadCount() - sdo_start_);
+}
+
+StartupProfiler& StartupProfiler::instance(){
+    static StartupProfiler profiler;
+    return profiler;
+}
+
+void StartupProfiler::add(uint8_t node_id, const std::string &phase, const boost::chrono::high_resolution_clock::duration &d, uint64_t sdo_transfers){
+    int64_t ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(d).count();
+    boost::mutex::scoped_lock lock(mutex_);
+    for(Entry &e: entries_){
+        if(e.node_id == node_id && e.phase == phase){
+            e.ns = ns;
+            e.sdo_transfers = sdo_transfers;
+            return;
+        }
+    }
+    Entry e = {node_id, phase, ns, sdo_transfers};
+    entries_.push_back(e);
+}
+
+std::vector<StartupProfiler::Entry> StartupProfiler::getEntries() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return entries_;
+}
+
+void StartupProfiler::reset(){
+    boost::mutex::scoped_lock lock(mutex_);
+    entries_.clear();
+}
+
+void StartupProfiler::write(std::ostream &os, const NameFunc &name) const {
+    std::vector<Entry> entries = getEntries();
+    std::vector<uint8_t> nodes;
+    for(const Entry &e: entries){
+        if(std::find(nodes.begin(), nodes.end(), e.node_id) == nodes.end()) nodes.push_back(e.node_id);
+    }
+    os << std::fixed << std::setprecision(1);
+    for(uint8_t id: nodes){
+        int64_t total_ns = 0;
+        uint64_t total_sdo = 0;
+        os << name(id) << ":\n";
+        os << "  id: " << int(id) << "\n";
+        os << "  phases:\n";
+        for(const Entry &e: entries){
+            if(e.node_id != id) continue;
+            os << "    " << e.phase << ": {ms: " << e.ns / 1e6 << ", sdo: " << e.sdo_transfers << "}\n";
+            total_ns += e.ns;
+            total_sdo += e.sdo_transfers;
+        }
+        os << "  total: {ms: " << total_ns / 1e6 << ", sdo: " << total_sdo << "}\n";
+    }
+}
+
+void StartupProfiler::report(LayerReport &report, const NameFunc &name, size_t slowest) const {
+    std::vector<Entry> entries = getEntries();
+    int64_t total_ns = 0;
+    for(const Entry &e: entries) total_ns += e.ns;
+    report.add("startup_total_ms", total_ns / 1000000);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b){ return a.ns > b.ns; });
+    if(entries.size() > slowest) entries.resize(slowest);
+    for(size_t i = 0; i < entries.size(); ++i){
+        std::stringstream sstr;
+        sstr << std::fixed << std::setprecision(1) << name(entries[i].node_id) << " " << entries[i].phase << ": "
+             << entries[i].ns / 1e6 << " ms, " << entries[i].sdo_transfers << " SDO";
+        report.add("startup_slowest_" + std::to_string(i + 1), sstr.str());
+    }
+}
@@ -0,0 +1,40 @@
+#include <canopen_master/timer.h>
+
+using namespace canopen;
+
+TimerServiceSharedPtr TimerService::instance(){
+    static boost::mutex mutex;
+    static std::weak_ptr<TimerService> weak;
+
+    boost::mutex::scoped_lock lock(mutex);
+    TimerServiceSharedPtr service = weak.lock();
+    if(!service){
+        service = create();
+        weak = service;
+    }
+    return service;
+}
+
+TimerServiceSharedPtr TimerService::create(){
+    return TimerServiceSharedPtr(new TimerService(), &TimerService::release);
+}
+
+void TimerService::release(TimerService *service){
+    if(service->thread_.get_id() == boost::this_thread::get_id()){
+        // released by a handler, the io_service has to stay alive until the handler has returned
+        service->io_.stop();
+        boost::thread([service](){ delete service; }).detach();
+    }else{
+        delete service;
+    }
+}
+
+TimerService::TimerService()
+: work_(io_), thread_(std::bind(static_cast<size_t(boost::asio::io_service::*)(void)>(&boost::asio::io_service::run), &io_))
+{
+}
+
+TimerService::~TimerService(){
+    io_.stop();
+    thread_.join();
+}
@@ -0,0 +1,144 @@
+#include <canopen_master/trace.h>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <vector>
+
+using namespace canopen;
+
+const size_t TraceRecorder::RING_SIZE;
+const size_t TraceRecorder::MAX_EXITED_RINGS;
+
+namespace {
+struct Registry{
+    boost::mutex mutex;
+    std::vector<std::string> names;
+    std::map<std::string, uint16_t> ids;
+    std::vector<std::shared_ptr<TraceRecorder::Ring> > rings; ///< kept after their threads have ended, until they are dumped
+    uint32_t next_tid;
+    Registry() : next_tid(1) {}
+    static Registry& instance() { static Registry r; return r; }
+
+    /// drops the oldest rings of ended threads until at most keep of them are left, mutex has to be locked
+    void prune(size_t keep){
+        size_t exited = std::count_if(rings.begin(), rings.end(), [](const std::shared_ptr<TraceRecorder::Ring> &r){ return r->exited.load(); });
+        for(std::vector<std::shared_ptr<TraceRecorder::Ring> >::iterator it = rings.begin(); it != rings.end() && exited > keep;){
+            if((*it)->exited){
+                it = rings.erase(it);
+                --exited;
+            }else{
+                ++it;
+            }
+        }
+    }
+};
+
+/// marks the ring of the thread as exited once the thread ends
+struct RingHolder{
+    std::shared_ptr<TraceRecorder::Ring> ring;
+    ~RingHolder(){
+        if(!ring) return;
+        Registry &reg = Registry::instance();
+        boost::mutex::scoped_lock lock(reg.mutex);
+        ring->exited = true;
+        reg.prune(TraceRecorder::MAX_EXITED_RINGS);
+    }
+};
+
+void escape(std::ostream &os, const std::string &str){
+    for(char c: str){
+        if(c == '"' || c == '\\') os << '\\';
+        if(static_cast<unsigned char>(c) >= 0x20) os << c;
+    }
+}
+}
+
+uint16_t TraceRecorder::intern(const std::string &name){
+    Registry &reg = Registry::instance();
+    boost::mutex::scoped_lock lock(reg.mutex);
+    std::map<std::string, uint16_t>::iterator it = reg.ids.find(name);
+    if(it != reg.ids.end()) return it->second;
+    uint16_t id = reg.names.size();
+    reg.names.push_back(name);
+    reg.ids.insert(std::make_pair(name, id));
+    return id;
+}
+
+TraceRecorder::Ring& TraceRecorder::ring(){
+    static thread_local RingHolder holder;
+    if(!holder.ring){
+        Registry &reg = Registry::instance();
+        boost::mutex::scoped_lock lock(reg.mutex);
+        holder.ring = std::make_shared<Ring>(reg.next_tid++);
+        reg.rings.push_back(holder.ring);
+    }
+    return *holder.ring;
+}
+
+bool TraceRecorder::Ring::read(uint64_t pos, Event &e) const {
+    const Slot &slot = slots[pos & (RING_SIZE - 1)];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if(seq != pos + 1) return false;
+    e.ns = slot.ns.load(std::memory_order_relaxed);
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot.seq.load(std::memory_order_relaxed) != seq) return false;
+    e.arg = data >> 32;
+    e.name = data >> 16;
+    e.phase = data >> 8;
+    e.has_arg = data & 1;
+    return true;
+}
+
+void TraceRecorder::dump(std::ostream &os){
+    Registry &reg = Registry::instance();
+    std::vector<std::shared_ptr<Ring> > rings;
+    std::vector<std::string> names;
+    {
+        boost::mutex::scoped_lock lock(reg.mutex);
+        rings = reg.rings;
+        names = reg.names;
+        reg.prune(0); // ended threads do not add events, so theirs are complete in this dump
+    }
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<Event> events;
+    for(const std::shared_ptr<Ring> &r: rings){
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(head > RING_SIZE ? head - RING_SIZE : 0, r->cleared.load());
+        events.clear();
+        Event e;
+        for(uint64_t i = begin; i < head; ++i){
+            if(r->read(i, e)) events.push_back(e); // skips slots the writer overwrote meanwhile
+        }
+
+        for(const Event &e: events){
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "{\"name\":\"";
+            if(e.name < names.size()) escape(os, names[e.name]);
+            os << "\",\"ph\":\"" << char(e.phase) << "\",\"pid\":1,\"tid\":" << r->tid << ",\"ts\":" << e.ns / 1000 << "." ;
+            os.width(3); os.fill('0'); os << e.ns % 1000; os.width(0);
+            if(e.phase == Instant) os << ",\"s\":\"t\"";
+            if(e.has_arg) os << ",\"args\":{\"v\":" << e.arg << "}";
+            os << "}";
+        }
+    }
+    os << "\n]}\n";
+}
+
+bool TraceRecorder::dump(const std::string &path){
+    std::ofstream file(path.c_str());
+    if(!file) return false;
+    dump(file);
+    return file.good();
+}
+
+void TraceRecorder::clear(){
+    Registry &reg = Registry::instance();
+    boost::mutex::scoped_lock lock(reg.mutex);
+    reg.prune(0);
+    for(const std::shared_ptr<Ring> &r: reg.rings) r->cleared = r->head.load();
+}
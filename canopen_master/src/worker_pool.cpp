@@ -0,0 +1,68 @@
+#include <canopen_master/parallel_layer.h>
+
+using namespace canopen;
+
+WorkerPool::WorkerPool(size_t threads)
+: generation_(0), running_(true), func_(0), data_(0), count_(0), next_(0), busy_(0) {
+    if(threads == 0){
+        unsigned int cores = boost::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for(size_t i = 0; i < threads; ++i){
+        threads_.emplace_back(new boost::thread(&WorkerPool::loop, this));
+    }
+}
+
+WorkerPool::~WorkerPool(){
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        running_ = false;
+    }
+    start_cond_.notify_all();
+    for(size_t i = 0; i < threads_.size(); ++i) threads_[i]->join();
+}
+
+void WorkerPool::process(){
+    for(size_t i = next_.fetch_add(1); i < count_; i = next_.fetch_add(1)){
+        func_(data_, i);
+    }
+}
+
+void WorkerPool::run(size_t count, JobFunc func, void *data){
+    if(count == 0) return;
+    if(count == 1 || threads_.empty()){ // not worth a wake-up
+        for(size_t i = 0; i < count; ++i) func(data, i);
+        return;
+    }
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        func_ = func;
+        data_ = data;
+        count_ = count;
+        next_ = 0;
+        busy_ = threads_.size();
+        ++generation_;
+    }
+    start_cond_.notify_all();
+
+    process();
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while(busy_ > 0) done_cond_.wait(lock);
+}
+
+void WorkerPool::loop(){
+    uint64_t generation = 0;
+    boost::mutex::scoped_lock lock(mutex_);
+    while(true){
+        while(running_ && generation == generation_) start_cond_.wait(lock);
+        if(!running_) return;
+        generation = generation_;
+
+        lock.unlock();
+        process();
+        lock.lock();
+
+        if(--busy_ == 0) done_cond_.notify_one();
+    }
+}
@@ -0,0 +1,32 @@
+#include <canopen_master/emcy_history.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+TEST(TestEMCYHistory, checkRing){
+    canopen::EMCYHistory history(4);
+    EXPECT_EQ(0u, history.count());
+    EXPECT_TRUE(history.get().empty());
+
+    const uint8_t vendor[5] = {1, 2, 3, 4, 5};
+    for(uint16_t i = 1; i <= 6; ++i) history.push(0x1000 + i, 1, vendor);
+
+    EXPECT_EQ(6u, history.count());
+    std::vector<canopen::EMCYHistory::Entry> entries = history.get();
+    ASSERT_EQ(4u, entries.size()); // oldest two were overwritten
+    EXPECT_EQ(0x1003, entries.front().error_code);
+    EXPECT_EQ(2u, entries.front().index);
+    EXPECT_EQ(0x1006, entries.back().error_code);
+    EXPECT_EQ(5, entries.back().manufacturer_specific[4]);
+
+    entries = history.get(5);
+    ASSERT_EQ(1u, entries.size());
+    EXPECT_EQ(0x1006, entries.front().error_code);
+    EXPECT_TRUE(history.get(6).empty());
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
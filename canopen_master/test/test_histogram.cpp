@@ -0,0 +1,150 @@
+#include <canopen_master/histogram.h>
+#include <canopen_master/scheduler.h>
+#include <canopen_master/canopen.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+TEST(TestHistogram, checkBuckets){
+    canopen::Histogram h;
+    EXPECT_EQ(0u, h.count());
+    EXPECT_EQ(0, h.percentile(0.5));
+
+    for(int i = 1; i <= 1000; ++i) h.record(i * 1000);
+
+    EXPECT_EQ(1000u, h.count());
+    EXPECT_EQ(1000, h.min());
+    EXPECT_EQ(1000000, h.max());
+    EXPECT_EQ(500500, h.mean());
+
+    int64_t p50 = h.percentile(0.5);
+    EXPECT_GE(p50, 500000);
+    EXPECT_LE(p50, 500000 * 5 / 4); // at most one sub-bucket off
+    EXPECT_EQ(h.max(), h.percentile(1.0));
+
+    h.reset();
+    EXPECT_EQ(0u, h.count());
+    EXPECT_EQ(0, h.max());
+}
+
+TEST(TestHistogram, checkNegative){
+    canopen::Histogram h;
+    h.record(-5);
+    h.record(boost::chrono::microseconds(2));
+    EXPECT_EQ(0, h.min());
+    EXPECT_EQ(2000, h.max());
+}
+
+TEST(TestScheduler, checkDriftFree){
+    typedef boost::chrono::high_resolution_clock clock;
+    canopen::PeriodicScheduler scheduler(boost::chrono::milliseconds(2), boost::chrono::microseconds(50));
+
+    clock::time_point start = clock::now();
+    scheduler.start(start);
+    clock::time_point last;
+    for(int i = 0; i < 10; ++i){
+        last = scheduler.wait();
+    }
+    // deadlines stay on the grid, periods that were missed under load are skipped
+    EXPECT_TRUE(last == start + boost::chrono::milliseconds(20 + 2 * scheduler.getMissed()));
+    EXPECT_GE(clock::now(), last);
+    EXPECT_EQ(10u, scheduler.getLatency().count());
+    EXPECT_EQ(9u, scheduler.getJitter().count());
+}
+
+TEST(TestScheduler, checkOverrunPolicies){
+    typedef boost::chrono::high_resolution_clock clock;
+    const boost::chrono::milliseconds period(2);
+
+    canopen::PeriodicScheduler skip(period), catch_up(period, clock::duration::zero(), canopen::PeriodicScheduler::CatchUp),
+                               shift(period, clock::duration::zero(), canopen::PeriodicScheduler::ShiftPhase);
+    clock::time_point start = clock::now();
+    skip.start(start);
+    catch_up.start(start);
+    shift.start(start);
+    boost::this_thread::sleep_until(start + boost::chrono::milliseconds(9)); // overrun by more than three periods
+
+    EXPECT_EQ(start + period, skip.wait());
+    EXPECT_EQ(1u, skip.getOverruns());
+    EXPECT_GE(skip.getMissed(), 3u);
+    EXPECT_TRUE((skip.getDeadline() - start) % period == clock::duration::zero());
+
+    EXPECT_EQ(start + period, catch_up.wait());
+    EXPECT_EQ(start + 2 * period, catch_up.wait()); // no sleep, back to back
+    EXPECT_EQ(0u, catch_up.getMissed());
+
+    clock::time_point deadline = shift.wait();
+    EXPECT_EQ(start + period, deadline);
+    EXPECT_EQ(1u, shift.getOverruns());
+    EXPECT_GE(shift.getDeadline(), start + boost::chrono::milliseconds(11));
+
+    EXPECT_EQ(canopen::PeriodicScheduler::CatchUp, canopen::PeriodicScheduler::parsePolicy("catch_up"));
+    EXPECT_THROW(canopen::PeriodicScheduler::parsePolicy("foo"), std::invalid_argument);
+}
+
+TEST(TestAdaptiveOffset, checkHysteresis){
+    typedef boost::chrono::microseconds us;
+    canopen::AdaptiveOffset offset(us(5000), us(10000), us(200), us(100), 10);
+
+    offset.update(us(1000)); // raise is immediate, drop needs a full window
+    EXPECT_TRUE(offset.get() == us(5000));
+
+    for(int i = 0; i < 9; ++i) offset.update(us(1000));
+    EXPECT_TRUE(offset.get() == us(1200));
+
+    for(int i = 0; i < 10; ++i) offset.update(us(950)); // within hysteresis
+    EXPECT_TRUE(offset.get() == us(1200));
+
+    offset.update(us(3000));
+    EXPECT_TRUE(offset.get() == us(3200));
+    EXPECT_EQ(1u, offset.getLate());
+
+    offset.update(us(20000)); // clamped to the period minus the margin
+    EXPECT_TRUE(offset.get() == us(9800));
+    EXPECT_EQ(22u, offset.getLatency().count());
+}
+
+TEST(TestRPDOBarrier, checkLateArrivals){
+    canopen::RPDOBarrier barrier;
+    barrier.add(2);
+    uint32_t gen1 = 0, gen2 = 0;
+    canopen::time_duration latency;
+
+    barrier.reset();
+    barrier.arrive(gen1, canopen::get_abs_time());
+    barrier.arrive(gen1, canopen::get_abs_time()); // repeated frame, counted once
+    EXPECT_EQ(1u, barrier.getLate());
+    EXPECT_FALSE(barrier.waitUntil(canopen::get_abs_time()));
+    barrier.arrive(gen2, canopen::get_abs_time());
+    EXPECT_TRUE(barrier.waitUntil(canopen::get_abs_time()));
+
+    barrier.reset();
+    EXPECT_TRUE(barrier.getPreviousLatency(latency));
+    barrier.arrive(gen1, canopen::get_abs_time()); // the second RPDO is late
+    const canopen::time_point before_sync = canopen::get_abs_time();
+
+    barrier.reset();
+    EXPECT_FALSE(barrier.getPreviousLatency(latency)); // partial cycle
+    barrier.arrive(gen2, before_sync); // late frame of the previous cycle
+    barrier.arrive(gen1, canopen::get_abs_time());
+    EXPECT_FALSE(barrier.waitUntil(canopen::get_abs_time()));
+    EXPECT_EQ(2u, barrier.getLate());
+    barrier.arrive(gen2, canopen::get_abs_time());
+    EXPECT_TRUE(barrier.waitUntil(canopen::get_abs_time()));
+
+    barrier.reset();
+    EXPECT_TRUE(barrier.getPreviousLatency(latency));
+    barrier.arrive(gen1, canopen::get_abs_time()); // the second RPDO was dropped
+
+    barrier.reset();
+    barrier.arrive(gen1, canopen::get_abs_time());
+    barrier.arrive(gen2, canopen::get_abs_time()); // on time, a lost frame does not affect the next cycle
+    EXPECT_TRUE(barrier.waitUntil(canopen::get_abs_time()));
+    EXPECT_EQ(2u, barrier.getLate());
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+#include <canopen_master/layer.h>
+#include <canopen_master/sdo_monitor.h>
+#include <canopen_master/startup_profiler.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+static const StatusCode TIMEOUT("timeout");
+static const StatusCode LIMIT("limit %1% exceeded by %2%");
+
+TEST(TestLayerStatus, checkCodes){
+    LayerStatus status;
+    EXPECT_TRUE(status.bounded<LayerStatus::Ok>());
+    EXPECT_NE(TIMEOUT.id(), LIMIT.id());
+
+    status.warn(TIMEOUT);
+    status.warn(TIMEOUT); // stored once
+    EXPECT_TRUE(status.equals<LayerStatus::Warn>());
+    status.error(LIMIT, 3, -42);
+    EXPECT_TRUE(status.equals<LayerStatus::Error>());
+    status.warn("plain");
+
+    ASSERT_EQ(2u, status.codes().size());
+    EXPECT_EQ(&LIMIT, status.codes()[1].code);
+    EXPECT_EQ("plain; timeout; limit 3 exceeded by -42", status.reason());
+
+    for(int i = 0; i < 10; ++i) status.warn(LIMIT, i);
+    EXPECT_EQ(size_t(LayerStatus::MAX_CODES), status.codes().size());
+    EXPECT_NE(std::string::npos, status.reason().find("; 4 more"));
+}
+
+TEST(TestLayerTiming, checkRegistry){
+    size_t before = 0;
+    LayerTiming::visit([&](const LayerTiming &){ ++before; });
+    {
+        LayerTiming timing("test");
+        {
+            LayerTiming::Scope scope(timing.read);
+        }
+        EXPECT_EQ(1u, timing.read.count());
+        EXPECT_EQ(0u, timing.write.count());
+
+        std::vector<std::string> names;
+        LayerTiming::visit([&](const LayerTiming &t){ names.push_back(t.name); });
+        ASSERT_EQ(before + 1, names.size());
+        EXPECT_EQ("test", names.back());
+
+        LayerReport report;
+        timing.report(report);
+        ASSERT_EQ(2u, report.values().size());
+        EXPECT_EQ("test #" + std::to_string(timing.id) + " read [n/mean/p99/max us]", report.values()[0].first);
+
+        LayerTiming other("test");
+        EXPECT_NE(timing.id, other.id);
+        EXPECT_NE(timing.label(), other.label());
+        EXPECT_EQ(0u, report.values()[0].second.find("1/"));
+
+        LayerTiming::resetAll();
+        EXPECT_EQ(0u, timing.read.count());
+    }
+    size_t after = 0;
+    LayerTiming::visit([&](const LayerTiming &){ ++after; });
+    EXPECT_EQ(before, after);
+}
+
+class SDOLayer : public Layer{
+    SDOAccessMonitor &monitor_;
+    const ObjectDict::Entry entry_;
+public:
+    const Layer *seen;
+    SDOLayer(SDOAccessMonitor &monitor) : Layer("sdo layer"), monitor_(monitor), entry_(0x6061, 0, ObjectDict::DEFTYPE_INTEGER8, "mode"), seen(0) {}
+    void transfer(){ SDOAccessMonitor::Transfer t(5, entry_, false, monitor_); }
+    virtual void handleRead(LayerStatus &status, const LayerState &current_state) { seen = cyclicLayer(); transfer(); }
+    virtual void handleWrite(LayerStatus &status, const LayerState &current_state) {}
+    virtual void handleDiag(LayerReport &report) {}
+    virtual void handleInit(LayerStatus &status) { transfer(); }
+    virtual void handleShutdown(LayerStatus &status) {}
+    virtual void handleHalt(LayerStatus &status) {}
+    virtual void handleRecover(LayerStatus &status) {}
+};
+
+TEST(TestSDOAccessMonitor, checkAttribution){
+    SDOAccessMonitor monitor;
+    SDOLayer layer(monitor);
+    LayerStatus status;
+    layer.init(status);
+    EXPECT_EQ(0u, monitor.getCyclicCount());
+
+    layer.read(status);
+    layer.read(status);
+    EXPECT_EQ(&layer, layer.seen);
+    EXPECT_EQ(0, Layer::cyclicLayer());
+    EXPECT_EQ(2u, monitor.getCyclicCount());
+
+    std::vector<SDOAccessMonitor::Record> records = monitor.getRecords();
+    ASSERT_EQ(2u, records.size());
+    EXPECT_FALSE(records[0].cyclic());
+    EXPECT_EQ("sdo layer", records[1].layer);
+    EXPECT_EQ("read", records[1].phase);
+    EXPECT_EQ(2u, records[1].count);
+
+    LayerReport report;
+    monitor.report(report);
+    EXPECT_TRUE(report.equals<LayerStatus::Warn>());
+
+    LayerReport quiet; // no transfers since the previous report
+    monitor.report(quiet);
+    EXPECT_TRUE(quiet.equals<LayerStatus::Ok>());
+    EXPECT_EQ(2u, quiet.values().size());
+
+    monitor.setPolicy(SDOAccessMonitor::Refuse);
+    LayerStatus refused;
+    layer.read(refused);
+    EXPECT_TRUE(refused.equals<LayerStatus::Error>());
+    EXPECT_EQ(1u, monitor.getRecords()[1].refused);
+    EXPECT_EQ(2u, monitor.getRecords()[1].count);
+}
+
+TEST(TestStartupProfiler, checkPhases){
+    SDOAccessMonitor monitor;
+    SDOLayer layer(monitor);
+    StartupProfiler profiler;
+    {
+        StartupProfiler::Phase phase(5, "sdo_init", profiler);
+        layer.transfer();
+        layer.transfer();
+    }
+    { StartupProfiler::Phase phase(5, "nmt_start", profiler); }
+    { StartupProfiler::Phase phase(5, "sdo_init", profiler); layer.transfer(); } // replaces the first run
+
+    std::vector<StartupProfiler::Entry> entries = profiler.getEntries();
+    ASSERT_EQ(2u, entries.size());
+    EXPECT_EQ("sdo_init", entries[0].phase);
+    EXPECT_EQ(1u, entries[0].sdo_transfers);
+    EXPECT_EQ(0u, entries[1].sdo_transfers);
+
+    std::stringstream sstr;
+    profiler.write(sstr, [](uint8_t id){ return "drive" + std::to_string(id); });
+    EXPECT_EQ(0u, sstr.str().find("drive5:\n  id: 5\n  phases:\n    sdo_init: {ms: "));
+    EXPECT_NE(std::string::npos, sstr.str().find("  total: {ms: "));
+
+    LayerReport report;
+    profiler.report(report, [](uint8_t id){ return std::to_string(id); }, 1);
+    ASSERT_EQ(2u, report.values().size());
+    EXPECT_EQ("startup_slowest_1", report.values()[1].first);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -58,6 +58,40 @@ TEST(TestNode, testInitandShutdown){
     EXPECT_TRUE(replay.done());
 }
 
+TEST(TestSDO, testBlockFallback){
+
+    can::DummyBus bus("testBlockFallback");
+
+    can::ThreadedDummyInterfaceSharedPtr driver = std::make_shared<can::ThreadedDummyInterface>();
+
+    can::DummyReplay replay;
+
+    replay.add("605#c600200008000000", "585#8000200001000405"); // block download not supported
+    replay.add("605#2100200008000000", "585#6000200000000000");
+    replay.add("605#0030313233343536", "585#2000000000000000");
+    replay.add("605#1d37000000000000", "585#3000000000000000");
+    replay.add("605#2100200008000000", "585#6000200000000000"); // block mode is not tried again
+    replay.add("605#0030313233343536", "585#2000000000000000");
+    replay.add("605#1d37000000000000", "585#3000000000000000");
+    replay.init(bus);
+
+    driver->init(bus.name, false, can::NoSettings::create());
+
+    canopen::ObjectDictSharedPtr dict = make_dict();
+    dict->insert(false, std::make_shared<const canopen::ObjectDict::Entry>(canopen::ObjectDict::VAR,
+                                                                           0x2000,
+                                                                           canopen::ObjectDict::DEFTYPE_DOMAIN,
+                                                                           "domain",
+                                                                           true, true, false));
+    canopen::SDOClient client(driver, dict, 5);
+    client.init();
+    client.setBlockTransfer(1);
+
+    client.storage_->entry<canopen::String>(0x2000).set(canopen::String("01234567"));
+    client.storage_->entry<canopen::String>(0x2000).set(canopen::String("01234567"));
+    EXPECT_TRUE(replay.done());
+}
+
 // Run all the tests that were declared with TEST()
 int main(int argc, char **argv){
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,104 @@
+#include <canopen_master/parallel_layer.h>
+#include <boost/chrono/system_clocks.hpp>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+/// stands in for a node with some per-cycle work, e.g. state machine and unit conversion
+class SimulatedNode : public Layer{
+    const int id_;
+    const boost::chrono::microseconds work_;
+    void busy(){
+        boost::chrono::high_resolution_clock::time_point end = boost::chrono::high_resolution_clock::now() + work_;
+        while(boost::chrono::high_resolution_clock::now() < end) {}
+    }
+public:
+    std::atomic<int> reads, writes, halts;
+    std::atomic<bool> fail;
+    SimulatedNode(int id, const boost::chrono::microseconds &work) : Layer("node " + std::to_string(id)), id_(id), work_(work), reads(0), writes(0), halts(0), fail(false) {}
+
+    virtual void handleRead(LayerStatus &status, const LayerState &current_state) {
+        busy();
+        ++reads;
+        if(fail) status.error("failed " + std::to_string(id_));
+        else if(id_ % 2) status.warn("odd " + std::to_string(id_));
+    }
+    virtual void handleWrite(LayerStatus &status, const LayerState &current_state) { busy(); ++writes; }
+    virtual void handleDiag(LayerReport &report) {}
+    virtual void handleInit(LayerStatus &status) {}
+    virtual void handleShutdown(LayerStatus &status) {}
+    virtual void handleHalt(LayerStatus &status) { ++halts; }
+    virtual void handleRecover(LayerStatus &status) {}
+};
+
+template<typename Group> std::vector<std::shared_ptr<SimulatedNode> > populate(Group &group, size_t num, const boost::chrono::microseconds &work){
+    std::vector<std::shared_ptr<SimulatedNode> > nodes;
+    for(size_t i = 0; i < num; ++i){
+        nodes.push_back(std::make_shared<SimulatedNode>(i, work));
+        group.add(nodes.back());
+    }
+    LayerStatus status;
+    group.init(status);
+    return nodes;
+}
+
+TEST(TestParallelLayerGroup, checkMerge){
+    ParallelLayerGroup<SimulatedNode> group("parallel", 3);
+    std::vector<std::shared_ptr<SimulatedNode> > nodes = populate(group, 8, boost::chrono::microseconds(0));
+
+    for(int i = 0; i < 5; ++i){
+        LayerStatus status;
+        group.read(status);
+        group.write(status);
+        EXPECT_TRUE(status.equals<LayerStatus::Warn>());
+        EXPECT_EQ("odd 1; odd 3; odd 5; odd 7", status.reason()); // member order, independent of scheduling
+    }
+    for(size_t i = 0; i < nodes.size(); ++i){
+        EXPECT_EQ(5, nodes[i]->reads);
+        EXPECT_EQ(5, nodes[i]->writes);
+    }
+}
+
+template<typename Group> void cycle(Group &group, LayerStatus &status){
+    group.read(status);
+    group.write(status);
+}
+
+TEST(TestParallelLayerGroup, check64NodesLikeSequential){
+    const size_t num_nodes = 64;
+    const boost::chrono::microseconds work(20);
+
+    LayerGroupNoDiag<SimulatedNode> sequential("sequential");
+    ParallelLayerGroup<SimulatedNode> parallel("parallel", 3);
+    std::vector<std::shared_ptr<SimulatedNode> > seq_nodes = populate(sequential, num_nodes, work);
+    std::vector<std::shared_ptr<SimulatedNode> > par_nodes = populate(parallel, num_nodes, work);
+
+    for(int i = 0; i < 10; ++i){
+        if(i == 7){
+            seq_nodes[42]->fail = true;
+            par_nodes[42]->fail = true;
+        }
+        LayerStatus seq, par;
+        cycle(sequential, seq);
+        cycle(parallel, par);
+        EXPECT_EQ(seq.get(), par.get());
+        EXPECT_EQ(seq.reason(), par.reason());
+    }
+    EXPECT_EQ(Layer::Error, sequential.getLayerState());
+    EXPECT_EQ(Layer::Error, parallel.getLayerState());
+
+    for(size_t i = 0; i < num_nodes; ++i){
+        EXPECT_EQ(seq_nodes[i]->reads, par_nodes[i]->reads);
+        EXPECT_EQ(seq_nodes[i]->writes, par_nodes[i]->writes);
+        EXPECT_EQ(seq_nodes[i]->halts, par_nodes[i]->halts);
+        EXPECT_EQ(1, par_nodes[i]->halts); // every member is halted once after the failure
+    }
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
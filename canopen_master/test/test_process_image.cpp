@@ -0,0 +1,90 @@
+#include <canopen_master/process_image.h>
+#include <canopen_master/shared_image.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <sstream>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+TEST(TestProcessImage, checkSwap){
+    ProcessImage image;
+    size_t a = image.allocate(ObjectDict::Entry(0x6064, 0, ObjectDict::DEFTYPE_INTEGER32, "a"), 1, 4);
+    size_t b = image.allocate(ObjectDict::Entry(0x6041, 0, ObjectDict::DEFTYPE_UNSIGNED16, "b"), 2, 2);
+    EXPECT_EQ(0u, a);
+    EXPECT_EQ(4u, b);
+    EXPECT_EQ(6u, image.size());
+    ASSERT_EQ(2u, image.getRegions().size());
+    EXPECT_EQ(2, image.getRegions()[1].node_id);
+
+    uint8_t out[4] = {0};
+    EXPECT_FALSE(image.read(a, out, 4));
+
+    const uint8_t v1[4] = {1, 2, 3, 4};
+    image.write(a, v1, 4);
+    EXPECT_FALSE(image.read(a, out, 4)); // not visible before the swap
+
+    image.swap(7);
+    ProcessImage::Tag tag;
+    EXPECT_TRUE(image.read(a, out, 4, &tag));
+    EXPECT_EQ(0, memcmp(v1, out, 4));
+    EXPECT_EQ(1u, tag.cycle);
+    EXPECT_EQ(7, tag.sync_counter);
+    EXPECT_FALSE(image.read(b, out, 2));
+
+    const uint8_t v2[4] = {5, 6, 7, 8};
+    image.write(a, v2, 4);
+    EXPECT_TRUE(image.read(a, out, 4));
+    EXPECT_EQ(0, memcmp(v1, out, 4)); // still the old cycle
+
+    image.swap(8);
+    std::vector<uint8_t> data, valid;
+    image.snapshot(data, valid, tag);
+    ASSERT_EQ(6u, data.size());
+    EXPECT_EQ(0, memcmp(v2, &data[0], 4));
+    EXPECT_EQ(2u, tag.cycle);
+}
+
+TEST(TestProcessImage, checkSharedExport){
+    ProcessImageSharedPtr image = std::make_shared<ProcessImage>();
+    const std::string name = "/canopen_test_" + std::to_string(getpid());
+    SharedImageExport shm(image, name);
+
+    size_t a = image->allocate(ObjectDict::Entry(0x6064, 0, ObjectDict::DEFTYPE_INTEGER32, "a"), 3, 4);
+    EXPECT_EQ(a, image->allocate(ObjectDict::Entry(0x6064, 0, ObjectDict::DEFTYPE_INTEGER32, "a"), 3, 4)); // re-init keeps layout
+    const uint8_t v[4] = {1, 2, 3, 4};
+    image->write(a, v, 4);
+    image->swap(5);
+    EXPECT_TRUE(shm.update());
+    EXPECT_FALSE(shm.update());
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    ASSERT_GE(fd, 0);
+    size_t total = sizeof(SharedImageHeader) + 8;
+    void *mem = mmap(0, total, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NE(MAP_FAILED, mem);
+    const SharedImageHeader *header = static_cast<const SharedImageHeader*>(mem);
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(header + 1);
+    EXPECT_EQ(SharedImageHeader::MAGIC, header->magic);
+    EXPECT_EQ(0u, header->sequence.load() & 1);
+    EXPECT_EQ(4u, header->size);
+    EXPECT_EQ(1u, header->cycle);
+    EXPECT_EQ(5, header->sync_counter);
+    EXPECT_EQ(0, memcmp(v, data, 4));
+    EXPECT_EQ(1, data[4]); // valid flag
+    munmap(mem, total);
+    close(fd);
+
+    std::stringstream sstr;
+    shm.writeDescriptor(sstr, {{3, "arm"}});
+    EXPECT_NE(std::string::npos, sstr.str().find("{node: \"arm\", node_id: 3, object: \"6064sub0\", type: int32, data_type: 4, offset: 0, size: 4}"));
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,121 @@
+#include <socketcan_interface/dummy.h>
+#include <canopen_master/program_download.h>
+#include <canopen_master/sim_device.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+static ObjectDictSharedPtr make_dict(bool with_identification = true){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1F50, 1, ObjectDict::DEFTYPE_DOMAIN, "", true, true, false, HoldAny(String())));
+    dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1F51, 1, ObjectDict::DEFTYPE_UNSIGNED8, "", true, true, false, HoldAny(uint8_t(1))));
+    if(with_identification){
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1F56, 1, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0))));
+    }
+    return dict;
+}
+
+class ProgramDownloadTest : public ::testing::Test{
+protected:
+    can::DummyBus bus;
+    can::ThreadedDummyInterfaceSharedPtr master, sim;
+    ProgramDownloadTest() : bus(::testing::UnitTest::GetInstance()->current_test_info()->name()),
+        master(std::make_shared<can::ThreadedDummyInterface>()), sim(std::make_shared<can::ThreadedDummyInterface>()) {
+        master->init(bus.name, false, can::NoSettings::create());
+        sim->init(bus.name, false, can::NoSettings::create());
+    }
+    ~ProgramDownloadTest(){
+        master->shutdown();
+        sim->shutdown();
+    }
+};
+
+TEST_F(ProgramDownloadTest, checkDownload){
+    SimDevice device(sim, make_dict(), 3);
+    device.start();
+    device.getStorage()->entry<uint32_t>(ObjectDict::Key(0x1F56, 1)).set_cached(0xCAFE);
+    SDOClient client(master, make_dict(), 3);
+    client.init();
+
+    std::string image(50000, 0);
+    for(size_t i = 0; i < image.size(); ++i) image[i] = i * 3;
+    size_t pos = 0;
+    SDOClient::DomainSource source = [&](uint8_t *data, size_t size){
+        size_t n = std::min(size, image.size() - pos);
+        memcpy(data, image.data() + pos, n);
+        pos += n;
+        return n;
+    };
+
+    ProgramDownload::Options options;
+    options.identification = 0xCAFE;
+    size_t last = 0;
+    ProgramDownload::Result result = ProgramDownload(client, options).run(source, image.size(), [&](size_t done, size_t total, double rate){
+        EXPECT_EQ(image.size(), total);
+        EXPECT_GE(done, last);
+        EXPECT_LE(0, rate);
+        last = done;
+    });
+    EXPECT_EQ(image.size(), last);
+    EXPECT_EQ(image.size(), result.bytes);
+    EXPECT_EQ(0xCAFEu, result.identification);
+    EXPECT_LT(0, result.bytesPerSecond());
+    std::string received;
+    for(char c: device.getStorage()->entry<String>(ObjectDict::Key(0x1F50, 1)).get_cached()) received += c;
+    EXPECT_EQ(image, received);
+    EXPECT_EQ(ProgramDownload::Start, device.getStorage()->entry<uint8_t>(ObjectDict::Key(0x1F51, 1)).get_cached());
+    EXPECT_EQ(0u, client.getBlockThreshold()); // untouched
+
+    // wrong identification, the program is not started
+    pos = 0;
+    options.identification = 0xBEEF;
+    EXPECT_THROW(ProgramDownload(client, options).run(source, image.size()), ProgramDownloadException);
+    EXPECT_EQ(ProgramDownload::Clear, device.getStorage()->entry<uint8_t>(ObjectDict::Key(0x1F51, 1)).get_cached());
+}
+
+TEST_F(ProgramDownloadTest, checkMissingObjects){
+    SimDevice device(sim, make_dict(false), 4);
+    device.start();
+    SDOClient client(master, make_dict(false), 4);
+    client.init();
+
+    String image(std::string(100, 'x'));
+    size_t pos = 0;
+    SDOClient::DomainSource source = [&](uint8_t *data, size_t size){
+        size_t n = std::min(size, image.size() - pos);
+        memcpy(data, image.data() + pos, n);
+        pos += n;
+        return n;
+    };
+    ProgramDownload::Result result = ProgramDownload(client).run(source, image.size()); // without verification
+    EXPECT_EQ(0u, result.identification);
+
+    ProgramDownload::Options options;
+    options.identification = 1;
+    pos = 0;
+    EXPECT_THROW(ProgramDownload(client, options).run(source, image.size()), ProgramDownloadException);
+
+    EXPECT_THROW(ProgramDownload(client).runFile("/nonexistent/image.bin"), ProgramDownloadException);
+}
+
+TEST_F(ProgramDownloadTest, checkProgramNumber){
+    SDOClient client(master, make_dict(true), 5);
+    ProgramDownload::Options options;
+    options.program = 0;
+    EXPECT_THROW(ProgramDownload(client, options), std::invalid_argument);
+    options.program = 255;
+    EXPECT_THROW(ProgramDownload(client, options), std::invalid_argument);
+    options.program = 254;
+    EXPECT_NO_THROW(ProgramDownload(client, options));
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,110 @@
+#include <socketcan_interface/dummy.h>
+#include <canopen_master/node_list.h>
+#include <canopen_master/scanner.h>
+#include <canopen_master/sim_device.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+static ObjectDictSharedPtr make_dict(uint8_t node_id, bool identity, uint16_t heartbeat_ms = 0){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x1000, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x20192))));
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, 0x1017, ObjectDict::DEFTYPE_UNSIGNED16, "", true, true, false, HoldAny(heartbeat_ms)));
+    if(identity){
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1018, 1, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x9A))));
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1018, 2, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x30924))));
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1018, 3, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(0x10000))));
+        dict->insert(true, std::make_shared<const ObjectDict::Entry>(0x1018, 4, ObjectDict::DEFTYPE_UNSIGNED32, "", true, false, false, HoldAny(uint32_t(node_id))));
+    }
+    return dict;
+}
+
+class BusScannerTest : public ::testing::Test{
+protected:
+    can::DummyBus bus;
+    can::ThreadedDummyInterfaceSharedPtr master, sim;
+    BusScannerTest() : bus(::testing::UnitTest::GetInstance()->current_test_info()->name()),
+        master(std::make_shared<can::ThreadedDummyInterface>()), sim(std::make_shared<can::ThreadedDummyInterface>()) {
+        master->init(bus.name, false, can::NoSettings::create());
+        sim->init(bus.name, false, can::NoSettings::create());
+    }
+    ~BusScannerTest(){
+        master->shutdown();
+        sim->shutdown();
+    }
+};
+
+TEST_F(BusScannerTest, checkScan){
+    SimDevice d2(sim, make_dict(2, false), 2), d10(sim, make_dict(10, true), 10), d127(sim, make_dict(127, true), 127);
+    d2.start();
+    d10.start();
+    d127.start();
+
+    BusScanner scanner(master, boost::chrono::milliseconds(50));
+    time_point start = get_abs_time();
+    BusScanner::Devices devices = scanner.scan();
+    EXPECT_LT(get_abs_time() - start, boost::chrono::milliseconds(500));
+
+    ASSERT_EQ(3u, devices.size());
+    ASSERT_EQ(1u, devices.count(2));
+    EXPECT_TRUE(devices[2].sdo);
+    EXPECT_FALSE(devices[2].heartbeat);
+    EXPECT_EQ(0x20192u, devices[2].device_type);
+    EXPECT_EQ(0, devices[2].identity); // aborted
+
+    ASSERT_EQ(1u, devices.count(10));
+    EXPECT_EQ(4, devices[10].identity);
+    EXPECT_EQ(0x9Au, devices[10].vendor_id);
+    EXPECT_EQ(0x30924u, devices[10].product_code);
+    EXPECT_EQ(0x10000u, devices[10].revision);
+    EXPECT_EQ(10u, devices[10].serial);
+
+    ASSERT_EQ(1u, devices.count(127));
+    EXPECT_EQ(127u, devices[127].serial);
+
+    devices = scanner.scan(3, 126);
+    ASSERT_EQ(1u, devices.size());
+    EXPECT_EQ(1u, devices.count(10));
+}
+
+TEST_F(BusScannerTest, checkListen){
+    SimDevice d5(sim, make_dict(5, true, 20), 5);
+
+    // powered on during the scan, so the SDO request is missed
+    boost::thread power_on([&d5](){
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+        d5.start();
+    });
+    BusScanner scanner(master, boost::chrono::milliseconds(10));
+    BusScanner::Devices devices = scanner.scan(1, 127, true, boost::chrono::milliseconds(100));
+    power_on.join();
+
+    ASSERT_EQ(1u, devices.size());
+    EXPECT_FALSE(devices[5].sdo);
+    EXPECT_TRUE(devices[5].heartbeat);
+    EXPECT_TRUE(devices[5].boot_up);
+    EXPECT_EQ(Node::PreOperational, devices[5].state);
+    EXPECT_EQ(0, devices[5].identity);
+}
+
+TEST(TestNodeList, checkParse){
+    std::vector<unsigned int> nodes;
+    EXPECT_TRUE(parseNodeList("1,3-5,127", nodes));
+    EXPECT_EQ(std::vector<unsigned int>({1, 3, 4, 5, 127}), nodes);
+
+    for(const char *invalid: {"", "0", "128", "5-3", "1,x", "2-"}){
+        std::vector<unsigned int> n;
+        EXPECT_FALSE(parseNodeList(invalid, n)) << invalid;
+    }
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
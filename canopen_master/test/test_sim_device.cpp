@@ -0,0 +1,850 @@
+#include <socketcan_interface/dummy.h>
+#include <canopen_master/canopen.h>
+#include <canopen_master/sim_device.h>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+static void add(const ObjectDictSharedPtr &dict, uint16_t index, uint8_t sub_index, uint16_t type, const HoldAny &def, bool writable = true){
+    dict->insert(true, std::make_shared<const ObjectDict::Entry>(index, sub_index, type, "", true, writable, true, def));
+}
+static void addVar(const ObjectDictSharedPtr &dict, uint16_t index, uint16_t type, const HoldAny &def, bool writable = true, const HoldAny &init = HoldAny()){
+    dict->insert(false, std::make_shared<const ObjectDict::Entry>(ObjectDict::VAR, index, type, "", true, writable, true, def, init));
+}
+
+static std::string str(const String &s){
+    return std::string(s.begin(), s.end());
+}
+
+/// the master side is created without PDOs and with heartbeat 100 ms
+static ObjectDictSharedPtr make_dict(uint8_t node_id, bool master = false){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 0;
+    info.nr_of_tx_pdo = 0;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    addVar(dict, 0x1008, ObjectDict::DEFTYPE_VISIBLE_STRING, HoldAny(String("simulated device")), false);
+    addVar(dict, 0x1017, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)), true, master ? HoldAny(uint16_t(100)) : HoldAny());
+    addVar(dict, 0x2000, ObjectDict::DEFTYPE_DOMAIN, HoldAny(String()));
+    addVar(dict, 0x6040, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)));
+    addVar(dict, 0x6041, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)), false);
+    if(master) return dict;
+
+    add(dict, 0x1400, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x200 + node_id)));
+    add(dict, 0x1400, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    add(dict, 0x1600, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    add(dict, 0x1600, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x60400010)));
+
+    add(dict, 0x1800, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x180 + node_id)));
+    add(dict, 0x1800, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    add(dict, 0x1A00, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(2)));
+    add(dict, 0x1A00, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x60410010)));
+    add(dict, 0x1A00, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x00050008))); // dummy byte
+    return dict;
+}
+
+/// the DAM-MPDO 0x300 is shared by all nodes, SAM-MPDOs are sent on 0x280 + node id
+static ObjectDictSharedPtr make_mpdo_dict(uint8_t node_id){
+    DeviceInfo info;
+    info.nr_of_rx_pdo = 1;
+    info.nr_of_tx_pdo = 1;
+    ObjectDictSharedPtr dict = std::make_shared<ObjectDict>(info);
+    addVar(dict, 0x6040, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)));
+    addVar(dict, 0x6041, ObjectDict::DEFTYPE_UNSIGNED16, HoldAny(uint16_t(0)), false);
+    add(dict, 0x2100, 1, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(0)));
+    add(dict, 0x2100, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(0)));
+
+    add(dict, 0x1400, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x300)));
+    add(dict, 0x1400, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(255)));
+    add(dict, 0x1600, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(0xFF)));
+    add(dict, 0x1600, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x60400010))); // sent by the master
+
+    add(dict, 0x1800, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x280 + node_id)));
+    add(dict, 0x1800, 2, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(1)));
+    add(dict, 0x1A00, 0, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(0xFE)));
+    add(dict, 0x1FA0, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x00604100)));
+    add(dict, 0x1FA0, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x02210001))); // sub-index 1 and 2
+    return dict;
+}
+
+/// two mapping entries per PDO and some objects to switch between
+static ObjectDictSharedPtr make_remap_dict(uint8_t node_id){
+    ObjectDictSharedPtr dict = make_dict(node_id);
+    add(dict, 0x1600, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0)));
+    addVar(dict, 0x6064, ObjectDict::DEFTYPE_INTEGER32, HoldAny(int32_t(0)));
+    addVar(dict, 0x606C, ObjectDict::DEFTYPE_INTEGER32, HoldAny(int32_t(0)));
+    addVar(dict, 0x607A, ObjectDict::DEFTYPE_INTEGER32, HoldAny(int32_t(0)));
+    return dict;
+}
+
+/// polls cond every millisecond for up to one second
+static ::testing::AssertionResult waitFor(const std::function<bool()> &cond, const std::string &what){
+    for(int i = 0; i < 1000; ++i){
+        if(cond()) return ::testing::AssertionSuccess();
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    return ::testing::AssertionFailure() << "timed out waiting for " << what;
+}
+
+static ::testing::AssertionResult waitForState(SimDevice &device, Node::State state){
+    return waitFor([&device, state](){ return device.getState() == state; }, "state " + std::to_string(int(state)));
+}
+
+class SimDeviceTest : public ::testing::Test{
+protected:
+    can::DummyBus bus;
+    can::ThreadedDummyInterfaceSharedPtr master, sim;
+    can::BufferedReader reader;
+
+    /// simulated device with an SDO client and a PDO mapper on the master side
+    struct Remote{
+        SimDevice device;
+        SDOClient client;
+        PDOMapper mapper;
+        Remote(const can::CommInterfaceSharedPtr &sim, const can::CommInterfaceSharedPtr &master,
+               const ObjectDictSharedPtr &device_dict, const ObjectDictSharedPtr &client_dict, uint8_t node_id, const ProcessImageSharedPtr &image)
+        : device(sim, device_dict, node_id), client(master, client_dict, node_id), mapper(master, RPDOBarrierSharedPtr(), image) {
+            device.start();
+            client.init();
+        }
+    };
+    std::vector<std::unique_ptr<Remote> > remotes;
+
+    /// the device is started, but not switched to operational
+    Remote& addRemote(const ObjectDictSharedPtr &device_dict, const ObjectDictSharedPtr &client_dict, uint8_t node_id,
+                      const ProcessImageSharedPtr &image = ProcessImageSharedPtr()){
+        remotes.emplace_back(new Remote(sim, master, device_dict, client_dict, node_id, image));
+        return *remotes.back();
+    }
+
+    SimDeviceTest() : bus(::testing::UnitTest::GetInstance()->current_test_info()->name()),
+        master(std::make_shared<can::ThreadedDummyInterface>()), sim(std::make_shared<can::ThreadedDummyInterface>()), reader(true, 0) {
+        master->init(bus.name, false, can::NoSettings::create());
+        sim->init(bus.name, false, can::NoSettings::create());
+        reader.listen(master);
+    }
+    ~SimDeviceTest(){
+        remotes.clear();
+        master->shutdown();
+        sim->shutdown();
+    }
+    /// returns the next frame with the given id
+    bool expect(unsigned int id, can::Frame &msg){
+        while(reader.read(&msg, boost::chrono::seconds(1))){
+            if(msg.id == id) return true;
+        }
+        return false;
+    }
+    can::Frame sdo(uint8_t node_id, std::initializer_list<uint8_t> data){
+        can::Frame frame(can::MsgHeader(0x600 + node_id), 8);
+        frame.data.fill(0);
+        std::copy(data.begin(), data.end(), frame.data.begin());
+        return frame;
+    }
+};
+
+TEST_F(SimDeviceTest, checkNodeInit){
+    SimDevice device(sim, make_dict(1), 1);
+    device.start();
+
+    NodeSharedPtr node = std::make_shared<Node>(master, make_dict(1, true), 1);
+    {
+        LayerStatus status;
+        node->init(status);
+        ASSERT_TRUE(status.bounded<LayerStatus::Ok>());
+        ASSERT_EQ(Node::Operational, node->getState());
+    }
+    EXPECT_EQ(Node::Operational, device.getState());
+    EXPECT_EQ(100, device.getStorage()->entry<uint16_t>(0x1017).get_cached());
+
+    // segmented upload
+    EXPECT_EQ("simulated device", str(node->getStorage()->entry<String>(0x1008).get()));
+
+    // expedited and segmented download
+    node->getStorage()->entry<uint16_t>(0x1017).set(20);
+    EXPECT_EQ(20, device.getStorage()->entry<uint16_t>(0x1017).get_cached());
+    node->getStorage()->entry<String>(0x2000).set(String("0123456789abcdef"));
+    EXPECT_EQ("0123456789abcdef", str(device.getStorage()->entry<String>(0x2000).get_cached()));
+
+    EXPECT_GE(device.getSDORequests(), 5u);
+
+    can::Frame msg;
+    do{
+        ASSERT_TRUE(expect(0x701, msg));
+    }while(msg.data[0] != Node::Operational); // skip boot-up
+
+    {
+        LayerStatus status;
+        node->shutdown(status);
+        EXPECT_TRUE(status.bounded<LayerStatus::Ok>());
+    }
+    EXPECT_TRUE(waitForState(device, Node::Stopped));
+    EXPECT_EQ(0, device.getStorage()->entry<uint16_t>(0x1017).get_cached());
+}
+
+TEST_F(SimDeviceTest, checkPDO){
+    SimDevice device(sim, make_dict(2), 2);
+    device.start();
+    master->send(can::toframe("0#0102"));
+    can::Frame msg;
+    ASSERT_TRUE(expect(0x702, msg)); // boot-up
+    ASSERT_TRUE(waitForState(device, Node::Operational));
+
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x1237);
+    master->send(can::toframe("80#"));
+    ASSERT_TRUE(expect(0x182, msg));
+    EXPECT_EQ(3, msg.dlc);
+    EXPECT_EQ(0x37, msg.data[0]);
+    EXPECT_EQ(0x12, msg.data[1]);
+    EXPECT_EQ(0, msg.data[2]);
+    EXPECT_EQ(1u, device.getSentPDOs());
+
+    for(int i = 0; i < 1000 && device.getReceivedPDOs() == 0; ++i){ // listeners are registered asynchronously
+        master->send(can::toframe("202#0f00"));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(0x000f, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+
+    master->send(can::toframe("0#0202"));
+    ASSERT_TRUE(waitForState(device, Node::Stopped));
+    uint64_t sent = device.getSentPDOs();
+    master->send(can::toframe("80#"));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    EXPECT_EQ(sent, device.getSentPDOs());
+}
+
+TEST_F(SimDeviceTest, checkBlockDownload){
+    SimDevice device(sim, make_dict(3), 3);
+    device.start();
+    can::Frame msg;
+    ASSERT_TRUE(expect(0x703, msg));
+
+    const std::string data("block transfer with crc");
+    uint16_t crc = SimDevice::crc(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+
+    master->send(sdo(3, {0xC6, 0x00, 0x20, 0x00, uint8_t(data.size()), 0, 0, 0}));
+    ASSERT_TRUE(expect(0x583, msg));
+    EXPECT_EQ(0xA4, msg.data[0]);
+    uint8_t block_size = msg.data[4];
+    ASSERT_GE(block_size, 4);
+
+    for(size_t offset = 0, seq = 1; offset < data.size(); offset += 7, ++seq){
+        can::Frame frame = sdo(3, {});
+        bool last = offset + 7 >= data.size();
+        frame.data[0] = seq | (last ? 0x80 : 0);
+        data.copy(reinterpret_cast<char*>(&frame.data[1]), 7, offset);
+        master->send(frame);
+    }
+    ASSERT_TRUE(expect(0x583, msg));
+    EXPECT_EQ(0xA2, msg.data[0]);
+    EXPECT_EQ(4, msg.data[1]); // all four segments
+
+    uint8_t unused = 7 * 4 - data.size();
+    master->send(sdo(3, {uint8_t(0xC1 | (unused << 2)), uint8_t(crc & 0xFF), uint8_t(crc >> 8)}));
+    ASSERT_TRUE(expect(0x583, msg));
+    EXPECT_EQ(0xA1, msg.data[0]);
+    EXPECT_EQ(data, str(device.getStorage()->entry<String>(0x2000).get_cached()));
+
+    // wrong CRC
+    master->send(sdo(3, {0xC6, 0x00, 0x20, 0x00, 1, 0, 0, 0}));
+    ASSERT_TRUE(expect(0x583, msg));
+    master->send(sdo(3, {0x81, 'x'}));
+    ASSERT_TRUE(expect(0x583, msg));
+    master->send(sdo(3, {0xC1 | (6 << 2), 0x00, 0x00}));
+    ASSERT_TRUE(expect(0x583, msg));
+    EXPECT_EQ(0x80, msg.data[0]);
+    EXPECT_EQ(0x04, msg.data[4]);
+    EXPECT_EQ(0x00, msg.data[5]);
+    EXPECT_EQ(0x04, msg.data[6]);
+    EXPECT_EQ(0x05, msg.data[7]);
+}
+
+TEST_F(SimDeviceTest, checkBlockUpload){
+    SimDevice device(sim, make_dict(4), 4);
+    device.start();
+    can::Frame msg;
+    ASSERT_TRUE(expect(0x704, msg));
+
+    const std::string data("0123456789abcdefghijklmnopqrstuvwxyz");
+    device.getStorage()->entry<String>(0x2000).set_cached(String(data));
+
+    master->send(sdo(4, {0xA4, 0x00, 0x20, 0x00, 3, 0}));
+    ASSERT_TRUE(expect(0x584, msg));
+    EXPECT_EQ(0xC6, msg.data[0]);
+    EXPECT_EQ(data.size(), msg.data[4]);
+
+    std::string received;
+    master->send(sdo(4, {0xA3}));
+    for(int block = 0; block < 2; ++block){
+        uint8_t seq = 0;
+        do{
+            ASSERT_TRUE(expect(0x584, msg));
+            seq = msg.data[0] & 0x7F;
+            received.append(reinterpret_cast<const char*>(&msg.data[1]), 7);
+        }while(seq < 3 && !(msg.data[0] & 0x80));
+        master->send(sdo(4, {0xA2, seq, 3}));
+    }
+    ASSERT_TRUE(expect(0x584, msg));
+    EXPECT_EQ(0xC1, msg.data[0] & 0xE3);
+    size_t unused = (msg.data[0] >> 2) & 7;
+    received.resize(received.size() - unused);
+    EXPECT_EQ(data, received);
+    uint16_t crc = msg.data[1] | (msg.data[2] << 8);
+    EXPECT_EQ(SimDevice::crc(reinterpret_cast<const uint8_t*>(data.data()), data.size()), crc);
+    master->send(sdo(4, {0xA1}));
+}
+
+TEST_F(SimDeviceTest, checkClientTransfers){
+    SimDevice device(sim, make_dict(5), 5);
+    device.start();
+    SDOClient client(master, make_dict(5, true), 5);
+    client.init();
+
+    std::string data(1000, 0);
+    for(size_t i = 0; i < data.size(); ++i) data[i] = i * 7;
+
+    // segmented, size does not fit into 16 bits
+    std::string large(70000, 'x');
+    client.storage_->entry<String>(0x2000).set(String(large));
+    EXPECT_EQ(large, str(device.getStorage()->entry<String>(0x2000).get_cached()));
+    device.getStorage()->entry<String>(0x2000).set_cached(String(data));
+    EXPECT_EQ(data, str(client.storage_->entry<String>(0x2000).get()));
+
+    client.setBlockTransfer(8, 16);
+    uint64_t requests = device.getSDORequests();
+    client.storage_->entry<String>(0x2000).set(String(data.substr(0, 999)));
+    EXPECT_EQ(data.substr(0, 999), str(device.getStorage()->entry<String>(0x2000).get_cached()));
+    EXPECT_EQ(requests + 2, device.getSDORequests()); // initiate and end, segments are not counted
+
+    device.getStorage()->entry<String>(0x2000).set_cached(String(data));
+    EXPECT_EQ(data, str(client.storage_->entry<String>(0x2000).get()));
+
+    client.storage_->entry<uint16_t>(0x6040).set(0x1234); // below threshold
+    EXPECT_EQ(0x1234, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+
+    EXPECT_THROW(client.setBlockTransfer(8, 128), std::invalid_argument);
+}
+
+TEST_F(SimDeviceTest, checkEmptyUpload){
+    SimDevice device(sim, make_dict(5), 5);
+    device.start();
+    can::Frame msg;
+
+    master->send(sdo(5, {0x40, 0x00, 0x20, 0x00})); // 0x2000 is empty
+    ASSERT_TRUE(expect(0x585, msg));
+    EXPECT_EQ(0x41, msg.data[0]); // segmented with size 0
+    EXPECT_EQ(0u, msg.data[4] | msg.data[5] | msg.data[6] | msg.data[7]);
+
+    master->send(sdo(5, {0x60}));
+    ASSERT_TRUE(expect(0x585, msg));
+    EXPECT_EQ(0x0F, msg.data[0]); // no data, last segment
+}
+
+TEST_F(SimDeviceTest, checkStreamingTransfers){
+    SimDevice device(sim, make_dict(5), 5);
+    device.start();
+    SDOClient client(master, make_dict(5, true), 5);
+    client.init();
+
+    std::string data(100000, 0);
+    for(size_t i = 0; i < data.size(); ++i) data[i] = i * 13;
+
+    for(int block = 0; block < 2; ++block){
+        client.setBlockTransfer(block ? 1 : 0, 32);
+
+        size_t pos = 0, last_progress = 0, progress_calls = 0;
+        auto progress = [&](size_t done, size_t total){
+            EXPECT_EQ(data.size(), total);
+            EXPECT_GE(done, last_progress);
+            last_progress = done;
+            ++progress_calls;
+        };
+        client.download(0x2000, [&](uint8_t *buf, size_t size){
+            size_t n = std::min(size, data.size() - pos);
+            memcpy(buf, data.data() + pos, n);
+            pos += n;
+            return n;
+        }, data.size(), progress);
+        EXPECT_EQ(data.size(), pos);
+        EXPECT_EQ(data.size(), last_progress);
+        EXPECT_LT(10u, progress_calls);
+        EXPECT_EQ(data, str(device.getStorage()->entry<String>(0x2000).get_cached()));
+
+        std::string received;
+        size_t max_chunk = 0;
+        client.upload(0x2000, [&](const uint8_t *buf, size_t size){
+            received.append(reinterpret_cast<const char*>(buf), size);
+            max_chunk = std::max(max_chunk, size);
+            return true;
+        });
+        EXPECT_EQ(data, received);
+        EXPECT_GT(data.size(), max_chunk);
+
+        // sink aborts, source ends early
+        EXPECT_THROW(client.upload(0x2000, [](const uint8_t *, size_t){ return false; }), TimeoutException);
+        pos = data.size() - 100;
+        EXPECT_ANY_THROW(client.download(0x2000, [&](uint8_t *buf, size_t size){
+            size_t n = std::min(size, data.size() - pos);
+            memcpy(buf, data.data() + pos, n);
+            pos += n;
+            return n;
+        }, data.size()));
+    }
+
+    // small objects are expedited
+    uint8_t value[2] = {0x34, 0x12};
+    client.download(0x6040, [&](uint8_t *buf, size_t size){ memcpy(buf, value, 2); return size_t(2); }, 2);
+    EXPECT_EQ(0x1234, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+    EXPECT_THROW(client.download(0x6041, [](uint8_t *, size_t){ return size_t(0); }, 2), AccessException);
+}
+
+TEST_F(SimDeviceTest, checkBlockOptions){
+    // raw server that rejects block transfers and accepts segmented downloads
+    std::atomic<int> block_requests(0), segments(0);
+    can::FrameListenerConstSharedPtr server = sim->createMsgListener(can::MsgHeader(0x606), [&](const can::Frame &msg){
+        can::Frame res(can::MsgHeader(0x586), 8);
+        res.data.fill(0);
+        switch(msg.data[0] >> 5){
+        case 6: // block download
+            ++block_requests;
+            res.data[0] = 0x80;
+            std::copy(msg.data.begin() + 1, msg.data.begin() + 4, res.data.begin() + 1);
+            res.data[4] = 0x01; res.data[5] = 0x00; res.data[6] = 0x04; res.data[7] = 0x05; // 0x05040001
+            break;
+        case 1: // initiate download
+            res.data[0] = 0x60;
+            std::copy(msg.data.begin() + 1, msg.data.begin() + 4, res.data.begin() + 1);
+            break;
+        case 0: // download segment
+            ++segments;
+            res.data[0] = 0x20 | (msg.data[0] & 0x10);
+            break;
+        default:
+            return;
+        }
+        sim->send(res);
+    });
+    SDOClient client(master, make_dict(6, true), 6);
+    client.init();
+
+    std::string data(100, 'x');
+    size_t pos = 0;
+    SDOClient::DomainSource source = [&](uint8_t *buf, size_t size){
+        size_t n = std::min(size, data.size() - pos);
+        memcpy(buf, data.data() + pos, n);
+        pos += n;
+        return n;
+    };
+    client.download(0x2000, source, data.size(), SDOClient::ProgressFunc(), SDOClient::BlockOptions(1, 16));
+    EXPECT_EQ(data.size(), pos);
+    EXPECT_EQ(1, block_requests);
+    EXPECT_EQ(15, segments); // 100 bytes in 7 byte segments
+    EXPECT_EQ(0u, client.getBlockThreshold());
+
+    // the rejection did not disable block transfers of the client
+    client.setBlockTransfer(1);
+    pos = 0;
+    client.download(0x2000, source, data.size());
+    EXPECT_EQ(2, block_requests);
+    pos = 0;
+    client.download(0x2000, source, data.size()); // now known to be unsupported
+    EXPECT_EQ(data.size(), pos);
+    EXPECT_EQ(2, block_requests);
+
+    EXPECT_THROW(SDOClient::BlockOptions(1, 0), std::invalid_argument);
+}
+
+TEST_F(SimDeviceTest, checkSDOChannels){
+    ObjectDictSharedPtr device_dict = make_dict(5), client_dict = make_dict(5, true);
+    for(const ObjectDictSharedPtr &dict: {device_dict, client_dict}){
+        addVar(dict, 0x2001, ObjectDict::DEFTYPE_DOMAIN, HoldAny(String()));
+        add(dict, 0x1201, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x640 + 5)));
+        add(dict, 0x1201, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x5C0 + 5)));
+    }
+    add(device_dict, 0x1202, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x650 + 5)));
+    add(device_dict, 0x1202, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x5D0 + 5)));
+    add(client_dict, 0x1203, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x80000660))); // invalid
+    add(client_dict, 0x1203, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x5E0)));
+    add(client_dict, 0x1280, 1, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x670))); // other node
+    add(client_dict, 0x1280, 2, ObjectDict::DEFTYPE_UNSIGNED32, HoldAny(uint32_t(0x5F0)));
+    add(client_dict, 0x1280, 3, ObjectDict::DEFTYPE_UNSIGNED8, HoldAny(uint8_t(6)));
+
+    SimDevice device(sim, device_dict, 5);
+    device.start();
+    SDOClient client(master, client_dict, 5);
+    client.addChannel(0x650 + 5, 0x5D0 + 5);
+    client.init();
+    EXPECT_EQ(3u, client.getChannelCount());
+
+    std::string large(20000, 'x');
+    std::atomic<int> long_done(0);
+    uint64_t requests = device.getSDORequests();
+    boost::thread_group transfers;
+    for(uint16_t index: {0x2000, 0x2001}){
+        transfers.create_thread([&, index](){
+            client.storage_->entry<String>(index).set(String(large));
+            ++long_done;
+        });
+    }
+    ASSERT_TRUE(waitFor([&](){ return device.getSDORequests() >= requests + 10; }, "long transfers"));
+
+    // both long transfers are running, short ones are served on the first channel
+    for(uint16_t i = 0; i < 20; ++i){
+        client.storage_->entry<uint16_t>(0x6040).set(i);
+        EXPECT_EQ(i, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+    }
+    EXPECT_EQ(0, long_done);
+    transfers.join_all();
+    EXPECT_EQ(large, str(device.getStorage()->entry<String>(0x2000).get_cached()));
+    EXPECT_EQ(large, str(device.getStorage()->entry<String>(0x2001).get_cached()));
+
+    // without additional channels everything runs on the default one
+    SDOClient single(master, make_dict(5, true), 5);
+    single.init();
+    EXPECT_EQ(1u, single.getChannelCount());
+    single.storage_->entry<uint16_t>(0x6040).set(0x4321);
+    EXPECT_EQ(0x4321, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+}
+
+TEST_F(SimDeviceTest, checkMPDO){
+    Remote &r3 = addRemote(make_mpdo_dict(3), make_mpdo_dict(3), 3), &r4 = addRemote(make_mpdo_dict(4), make_mpdo_dict(4), 4);
+    SimDevice &d3 = r3.device, &d4 = r4.device;
+    SDOClient &c3 = r3.client, &c4 = r4.client;
+    PDOMapper &m3 = r3.mapper, &m4 = r4.mapper;
+    {
+        LayerStatus status;
+        ASSERT_TRUE(m3.init(c3.storage_, status));
+        ASSERT_TRUE(m4.init(c4.storage_, status));
+    }
+    master->send(can::toframe("0#0100"));
+    ASSERT_TRUE(waitForState(d3, Node::Operational));
+    ASSERT_TRUE(waitForState(d4, Node::Operational));
+
+    // destination address mode, both nodes listen to 0x300
+    for(int i = 0; i < 1000 && (d3.getReceivedPDOs() == 0 || d4.getReceivedPDOs() == 0); ++i){ // listeners are registered asynchronously
+        c3.storage_->entry<uint16_t>(0x6040).set(0x1111);
+        c4.storage_->entry<uint16_t>(0x6040).set(0x2222);
+        m3.write();
+        m4.write();
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(0x1111, d3.getStorage()->entry<uint16_t>(0x6040).get_cached());
+    EXPECT_EQ(0x2222, d4.getStorage()->entry<uint16_t>(0x6040).get_cached());
+    uint64_t received = d3.getReceivedPDOs();
+    m3.write(); // unchanged
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(received, d3.getReceivedPDOs());
+
+    // source address mode, one frame per object of the scanner list
+    d3.getStorage()->entry<uint16_t>(0x6041).set_cached(0x5678);
+    d3.getStorage()->entry<uint8_t>(0x2100, 2).set_cached(0x9A);
+    master->send(can::toframe("80#"));
+    can::Frame msg;
+    ASSERT_TRUE(expect(0x283, msg));
+    EXPECT_EQ(8, msg.dlc);
+    EXPECT_EQ(3, msg.data[0]);
+    EXPECT_EQ(0x41, msg.data[1]);
+    EXPECT_EQ(0x60, msg.data[2]);
+    EXPECT_EQ(0, msg.data[3]);
+    EXPECT_EQ(0x78, msg.data[4]);
+    EXPECT_EQ(0x56, msg.data[5]);
+    ASSERT_TRUE(expect(0x283, msg));
+    ASSERT_TRUE(expect(0x283, msg));
+    EXPECT_EQ(2, msg.data[3]);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(0x5678, c3.storage_->entry<uint16_t>(0x6041).get());
+    EXPECT_EQ(0, c3.storage_->entry<uint8_t>(0x2100, 1).get());
+    EXPECT_EQ(0x9A, c3.storage_->entry<uint8_t>(0x2100, 2).get());
+
+    sim->send(can::toframe("283#0441600021430000")); // other node
+    sim->send(can::toframe("283#8341600021430000")); // destination address mode
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(0x5678, c3.storage_->entry<uint16_t>(0x6041).get());
+
+    // the frames of one cycle are not taken as separate arrivals of a cyclic PDO
+    std::vector<PDOMapper::RPDOStatistics> stats = m3.getRPDOStatistics();
+    ASSERT_EQ(1u, stats.size());
+    EXPECT_EQ(3u, stats[0].received);
+    EXPECT_EQ(0, stats[0].period.count());
+    LayerStatus status;
+    for(int i = 0; i < 10; ++i) m3.read(status);
+    EXPECT_TRUE(status.bounded<LayerStatus::Ok>());
+    EXPECT_EQ(0u, m3.getRPDOStatistics()[0].missed_syncs);
+
+    RPDOBarrierSharedPtr barrier = std::make_shared<RPDOBarrier>();
+    PDOMapper with_barrier(master, barrier);
+    ASSERT_TRUE(with_barrier.init(c3.storage_, status));
+    with_barrier.joinBarrier(true);
+    EXPECT_EQ(0u, barrier->getExpected());
+}
+
+TEST_F(SimDeviceTest, checkPDORemap){
+    Remote &r = addRemote(make_remap_dict(7), make_remap_dict(7), 7);
+    SimDevice &device = r.device;
+    SDOClient &client = r.client;
+    PDOMapper &mapper = r.mapper;
+    master->send(can::toframe("0#0107"));
+    ASSERT_TRUE(waitForState(device, Node::Operational));
+
+    PDOMapper::MappingSet position, velocity;
+    position[0x1A00] = {0x60410010, 0x60640020};
+    position[0x1600] = {0x60400010, 0x607A0020};
+    velocity[0x1A00] = {0x606C0020};
+    velocity[0x1600] = {}; // disabled
+
+    LayerStatus status;
+    ASSERT_TRUE(mapper.remap(client.storage_, position, status));
+
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0237);
+    device.getStorage()->entry<int32_t>(0x6064).set_cached(-2);
+    // the simulated device rebuilds its PDOs asynchronously
+    auto sync_until = [this](uint8_t dlc){
+        can::Frame msg;
+        for(int i = 0; i < 100; ++i){
+            master->send(can::toframe("80#"));
+            while(reader.read(&msg, boost::chrono::milliseconds(10))){
+                if(msg.id == 0x187 && msg.dlc == dlc) return true;
+            }
+        }
+        return false;
+    };
+    ASSERT_TRUE(sync_until(6));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(0x0237, client.storage_->entry<uint16_t>(0x6041).get());
+    EXPECT_EQ(-2, client.storage_->entry<int32_t>(0x6064).get());
+
+    uint64_t received = device.getReceivedPDOs();
+    client.storage_->entry<uint16_t>(0x6040).set(0x000f);
+    client.storage_->entry<int32_t>(0x607A).set(1000);
+    for(int i = 0; i < 1000 && device.getReceivedPDOs() == received; ++i){
+        mapper.write();
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(0x000f, device.getStorage()->entry<uint16_t>(0x6040).get_cached());
+    EXPECT_EQ(1000, device.getStorage()->entry<int32_t>(0x607A).get_cached());
+
+    // disable, changed entry, count and enable for the TPDO, disable and count for the RPDO
+    uint64_t requests = device.getSDORequests();
+    ASSERT_TRUE(mapper.remap(client.storage_, velocity, status));
+    EXPECT_EQ(requests + 7, device.getSDORequests());
+    requests = device.getSDORequests();
+    ASSERT_TRUE(mapper.remap(client.storage_, velocity, status));
+    EXPECT_EQ(requests, device.getSDORequests());
+
+    device.getStorage()->entry<int32_t>(0x606C).set_cached(300);
+    ASSERT_TRUE(sync_until(4));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(300, client.storage_->entry<int32_t>(0x606C).get());
+
+    // unmapped objects are accessed via SDO again
+    device.getStorage()->entry<int32_t>(0x6064).set_cached(42);
+    EXPECT_EQ(42, client.storage_->entry<int32_t>(0x6064).get());
+    client.storage_->entry<int32_t>(0x607A).set(2000);
+    EXPECT_EQ(2000, device.getStorage()->entry<int32_t>(0x607A).get_cached());
+
+    PDOMapper::MappingSet invalid;
+    invalid[0x1A00] = {0x60640020, 0x606C0020, 0x607A0020};
+    requests = device.getSDORequests();
+    EXPECT_FALSE(mapper.remap(client.storage_, invalid, status));
+    EXPECT_EQ(requests, device.getSDORequests()); // rejected before any transfer
+
+    // 0x1A00 sub 3 does not exist, the device gets the previous mapping back
+    PDOMapper::MappingSet failing;
+    failing[0x1A00] = {0x60410010, 0x606C0020, 0x00050008};
+    LayerStatus failed;
+    EXPECT_FALSE(mapper.remap(client.storage_, failing, failed));
+    EXPECT_FALSE(failed.bounded<LayerStatus::Warn>());
+    EXPECT_EQ(uint8_t(1), device.getStorage()->entry<uint8_t>(0x1A00, 0).get_cached());
+    EXPECT_EQ(0x606C0020u, device.getStorage()->entry<uint32_t>(0x1A00, 1).get_cached());
+    device.getStorage()->entry<int32_t>(0x606C).set_cached(400);
+    ASSERT_TRUE(sync_until(4));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(400, client.storage_->entry<int32_t>(0x606C).get());
+    ASSERT_EQ(1u, mapper.getRPDOStatistics().size());
+}
+
+TEST_F(SimDeviceTest, checkRPDOStatistics){
+    Remote &r = addRemote(make_dict(7), make_dict(7), 7);
+    SimDevice &device = r.device;
+    SDOClient &client = r.client;
+    PDOMapper &mapper = r.mapper;
+    master->send(can::toframe("0#0107"));
+    ASSERT_TRUE(waitForState(device, Node::Operational));
+    PDOMapper::MappingSet mappings;
+    mappings[0x1A00] = {0x60410010, 0x00050008};
+    LayerStatus status;
+    ASSERT_TRUE(mapper.remap(client.storage_, mappings, status));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10)); // the device rebuilds its PDOs asynchronously
+
+    std::vector<PDOMapper::RPDOStatistics> stats = mapper.getRPDOStatistics();
+    ASSERT_EQ(1u, stats.size());
+    EXPECT_EQ(0x1A00, stats[0].map_index);
+    EXPECT_EQ(0x187u, stats[0].header.id);
+    EXPECT_EQ(0u, stats[0].received);
+    EXPECT_EQ(time_duration::max(), mapper.getRPDOAge());
+
+    for(int i = 0; i < 5; ++i){
+        master->send(can::toframe("80#"));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+        mapper.read(status);
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    stats = mapper.getRPDOStatistics();
+    EXPECT_EQ(5u, stats[0].received);
+    EXPECT_LT(time_duration(boost::chrono::milliseconds(3)), stats[0].period);
+    EXPECT_EQ(0u, stats[0].missed_syncs);
+    EXPECT_EQ(0u, stats[0].dlc_mismatches);
+    EXPECT_GT(time_duration(boost::chrono::seconds(1)), mapper.getRPDOAge());
+    EXPECT_TRUE(status.bounded<LayerStatus::Ok>());
+
+    sim->send(can::toframe("187#01"));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(1u, mapper.getRPDOStatistics()[0].dlc_mismatches);
+
+    EXPECT_EQ(5u, mapper.getRPDOStatistics()[0].received); // dropped
+
+    sim->send(can::toframe("187#2300FF0000000000")); // longer than the mapping, the first bytes are used
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    stats = mapper.getRPDOStatistics();
+    EXPECT_EQ(2u, stats[0].dlc_mismatches);
+    EXPECT_EQ(6u, stats[0].received);
+    EXPECT_EQ(0x0023, client.storage_->entry<uint16_t>(0x6041).get());
+    mapper.read(status); // the cycle of this frame
+
+    // every SYNC without the PDO is a miss, the timeout warning allows two extra cycles
+    master->send(can::toframe("0#0207"));
+    ASSERT_TRUE(waitForState(device, Node::Stopped));
+    for(int i = 0; i < 2; ++i) mapper.read(status);
+    EXPECT_EQ(2u, mapper.getRPDOStatistics()[0].missed_syncs);
+    EXPECT_TRUE(status.bounded<LayerStatus::Ok>());
+    for(int i = 0; i < 4; ++i) mapper.read(status);
+    EXPECT_EQ(6u, mapper.getRPDOStatistics()[0].missed_syncs);
+    EXPECT_TRUE(status.bounded<LayerStatus::Warn>() && !status.bounded<LayerStatus::Ok>());
+    EXPECT_EQ("RPDO 1 of node 7 timed out", status.reason());
+}
+
+TEST_F(SimDeviceTest, checkChangeNotifications){
+    Remote &r = addRemote(make_dict(7), make_dict(7), 7);
+    SimDevice &device = r.device;
+    SDOClient &client = r.client;
+    PDOMapper &mapper = r.mapper;
+    master->send(can::toframe("0#0107"));
+    ASSERT_TRUE(waitForState(device, Node::Operational));
+    PDOMapper::MappingSet mappings;
+    mappings[0x1A00] = {0x60410010, 0x00050008};
+    LayerStatus status;
+    ASSERT_TRUE(mapper.remap(client.storage_, mappings, status));
+
+    ObjectStorage::Entry<uint16_t> entry = client.storage_->entry<uint16_t>(0x6041);
+    std::atomic<int> immediate(0), coalesced(0);
+    uint16_t value = 0;
+    ObjectStorage::ChangeListenerConstSharedPtr listener = entry.subscribe([&](const ObjectDict::Key &key){
+        EXPECT_EQ(ObjectDict::Key(0x6041), key);
+        ++immediate;
+    });
+    ObjectStorage::ChangeListenerConstSharedPtr coalesced_listener = entry.subscribe([&](const ObjectDict::Key &){
+        value = entry.get();
+        ++coalesced;
+    }, true);
+
+    auto sync_until = [this, &immediate](int n){
+        for(int i = 0; i < 100 && immediate < n; ++i){
+            master->send(can::toframe("80#"));
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+        }
+        return immediate == n;
+    };
+
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0010);
+    ASSERT_TRUE(sync_until(1)); // the device rebuilds its PDOs asynchronously
+    for(int i = 0; i < 3; ++i){ // same value
+        master->send(can::toframe("80#"));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(1, immediate);
+    EXPECT_EQ(0, coalesced);
+    mapper.read(status);
+    EXPECT_EQ(1, coalesced);
+    EXPECT_EQ(0x0010, value);
+    mapper.read(status);
+    EXPECT_EQ(1, coalesced);
+
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0011);
+    ASSERT_TRUE(sync_until(2));
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0012);
+    ASSERT_TRUE(sync_until(3));
+    mapper.read(status);
+    EXPECT_EQ(2, coalesced);
+    EXPECT_EQ(0x0012, value);
+
+    listener.reset();
+    coalesced_listener.reset();
+    device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0013);
+    for(int i = 0; i < 1000 && entry.get() != 0x0013; ++i){
+        master->send(can::toframe("80#"));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    mapper.read(status);
+    EXPECT_EQ(3, immediate);
+    EXPECT_EQ(2, coalesced);
+}
+
+TEST_F(SimDeviceTest, checkChangeNotificationsAfterSwap){
+    ProcessImageSharedPtr image = std::make_shared<ProcessImage>();
+    Remote &r = addRemote(make_dict(7), make_dict(7), 7, image);
+    master->send(can::toframe("0#0107"));
+    ASSERT_TRUE(waitForState(r.device, Node::Operational));
+    PDOMapper::MappingSet mappings;
+    mappings[0x1A00] = {0x60410010, 0x00050008};
+    LayerStatus status;
+    ASSERT_TRUE(r.mapper.remap(r.client.storage_, mappings, status)) << status.reason();
+
+    ObjectStorage::Entry<uint16_t> entry = r.client.storage_->entry<uint16_t>(0x6041);
+    std::atomic<int> immediate(0);
+    std::atomic<uint16_t> seen(0);
+    ObjectStorage::ChangeListenerConstSharedPtr listener = entry.subscribe([&](const ObjectDict::Key &){
+        seen = entry.get();
+        ++immediate;
+    });
+
+    r.device.getStorage()->entry<uint16_t>(0x6041).set_cached(0x0021);
+    ASSERT_TRUE(waitFor([&](){
+        master->send(can::toframe("80#"));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+        return r.mapper.getRPDOStatistics()[0].received > 0;
+    }, "RPDO"));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    EXPECT_EQ(0, immediate); // not visible yet
+
+    image->swap(0);
+    EXPECT_EQ(1, immediate);
+    EXPECT_EQ(0x0021, seen);
+    image->swap(0);
+    EXPECT_EQ(1, immediate);
+}
+
+TEST_F(SimDeviceTest, checkManyDevices){
+    std::vector<SimDeviceSharedPtr> devices;
+    for(uint8_t id = 1; id <= 127; ++id){
+        devices.push_back(std::make_shared<SimDevice>(sim, make_dict(id), id));
+        devices.back()->start();
+    }
+    master->send(can::toframe("0#0100"));
+    for(const SimDeviceSharedPtr &d: devices){
+        ASSERT_TRUE(waitForState(*d, Node::Operational));
+    }
+    master->send(can::toframe("80#"));
+    size_t tpdos = 0;
+    can::Frame msg;
+    while(tpdos < devices.size() && reader.read(&msg, boost::chrono::seconds(1))){
+        if(msg.id > 0x180 && msg.id < 0x200) ++tpdos;
+    }
+    EXPECT_EQ(devices.size(), tpdos);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
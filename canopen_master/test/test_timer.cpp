@@ -0,0 +1,62 @@
+#include <canopen_master/timer.h>
+#include <atomic>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using namespace canopen;
+
+TEST(TestTimer, checkShared){
+    std::atomic<int> a(0), b(0);
+    boost::thread::id ta, tb;
+    {
+        Timer timer_a, timer_b;
+        timer_a.start([&](){ ta = boost::this_thread::get_id(); return ++a < 5; }, boost::chrono::milliseconds(2));
+        timer_b.start([&](){ tb = boost::this_thread::get_id(); return ++b < 3; }, boost::chrono::milliseconds(3));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+        EXPECT_EQ(5, a);
+        EXPECT_EQ(3, b);
+        EXPECT_EQ(ta, tb); // both handled by the same thread
+        EXPECT_EQ(5u, timer_a.getLateness().count());
+        EXPECT_GE(TimerService::instance()->getLateness().count(), 8u);
+    }
+}
+
+TEST(TestTimer, checkDestroyPending){
+    std::atomic<int> a(0);
+    {
+        Timer timer;
+        timer.start([&](){ ++a; return true; }, boost::chrono::milliseconds(20));
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    EXPECT_EQ(0, a);
+
+    Timer timer;
+    timer.start([&](){ ++a; return false; }, boost::chrono::milliseconds(1), false);
+    timer.restart();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+    EXPECT_EQ(1, a);
+}
+
+TEST(TestTimer, checkDestroyFromDelegate){
+    std::atomic<int> a(0), b(0);
+    std::atomic<bool> done(false);
+
+    Timer *timer = new Timer(TimerService::create()); // the only owner of its service
+    timer->start([&](){ ++a; delete timer; done = true; return true; }, boost::chrono::milliseconds(1));
+    for(int i = 0; i < 1000 && !done; ++i) boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    ASSERT_TRUE(done);
+
+    Timer stopped;
+    stopped.start([&](){ ++b; stopped.stop(); return true; }, boost::chrono::milliseconds(1));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+    EXPECT_EQ(1, a);
+    EXPECT_EQ(1, b);
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+#include <canopen_master/layer.h>
+#include <canopen_master/trace.h>
+#include <boost/thread/thread.hpp>
+#include <sstream>
+
+// Bring in gtest
+#include <gtest/gtest.h>
+
+using canopen::TraceRecorder;
+
+static size_t count(const std::string &str, const std::string &pattern){
+    size_t n = 0;
+    for(size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + 1)) ++n;
+    return n;
+}
+
+static std::string dump(){
+    std::stringstream sstr;
+    TraceRecorder::dump(sstr);
+    return sstr.str();
+}
+
+TEST(TestTrace, checkDisabled){
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(false);
+    CANOPEN_TRACE_INSTANT("disabled", 1);
+    EXPECT_EQ(0u, count(dump(), "\"name\""));
+}
+
+TEST(TestTrace, checkDump){
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(true);
+    uint16_t id = TraceRecorder::intern("scope \"quoted\"");
+    EXPECT_EQ(id, TraceRecorder::intern("scope \"quoted\""));
+    {
+        TraceRecorder::Scope scope(id);
+        CANOPEN_TRACE_INSTANT("RX", 0x181);
+    }
+    boost::thread([]{ CANOPEN_TRACE_INSTANT("TX", 0x201); }).join();
+    TraceRecorder::setEnabled(false);
+
+    std::string json = dump();
+    EXPECT_EQ(0u, json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    EXPECT_EQ(2u, count(json, "\"name\":\"scope \\\"quoted\\\"\""));
+    EXPECT_EQ(1u, count(json, "\"ph\":\"B\""));
+    EXPECT_EQ(1u, count(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1u, count(json, "\"name\":\"RX\",\"ph\":\"i\",\"pid\":1,\"tid\":1,"));
+    EXPECT_EQ(1u, count(json, "\"args\":{\"v\":385}"));
+    EXPECT_EQ(1u, count(json, "\"name\":\"TX\",\"ph\":\"i\",\"pid\":1,\"tid\":2,"));
+}
+
+TEST(TestTrace, checkWrapAround){
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(true);
+    for(uint32_t i = 0; i < TraceRecorder::RING_SIZE + 10; ++i) CANOPEN_TRACE_INSTANT("wrap", i);
+    TraceRecorder::setEnabled(false);
+
+    std::string json = dump();
+    EXPECT_EQ(size_t(TraceRecorder::RING_SIZE), count(json, "\"name\":\"wrap\""));
+    EXPECT_EQ(0u, count(json, "\"args\":{\"v\":9}"));
+    EXPECT_EQ(1u, count(json, "\"args\":{\"v\":10}"));
+}
+
+TEST(TestTrace, checkConcurrentDump){
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(true);
+    std::atomic<bool> running(true);
+    boost::thread writer([&running]{
+        uint32_t i = 0;
+        while(running) CANOPEN_TRACE_INSTANT("spin", ++i);
+    });
+    for(int i = 0; i < 50; ++i){
+        std::string json = dump();
+        EXPECT_EQ(count(json, "{\"name\":"), count(json, "{\"name\":\"spin\",\"ph\":\"i\","));
+        EXPECT_GE(size_t(TraceRecorder::RING_SIZE), count(json, "{\"name\":"));
+        if(i % 10 == 0) TraceRecorder::clear();
+    }
+    running = false;
+    writer.join();
+    TraceRecorder::setEnabled(false);
+
+    TraceRecorder::clear();
+    EXPECT_EQ(0u, count(dump(), "\"name\""));
+}
+
+TEST(TestTrace, checkExitedThreads){
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(true);
+    boost::thread([]{ CANOPEN_TRACE_INSTANT("exited", 0); }).join();
+    EXPECT_EQ(1u, count(dump(), "\"name\":\"exited\""));
+    EXPECT_EQ(0u, count(dump(), "\"name\":\"exited\"")); // released by the first dump
+
+    for(size_t i = 0; i < TraceRecorder::MAX_EXITED_RINGS + 4; ++i){
+        boost::thread([]{ CANOPEN_TRACE_INSTANT("exited", 0); }).join();
+    }
+    TraceRecorder::setEnabled(false);
+    EXPECT_EQ(size_t(TraceRecorder::MAX_EXITED_RINGS), count(dump(), "\"name\":\"exited\"")); // the oldest are dropped
+}
+
+class NamedLayer : public canopen::Layer{
+public:
+    NamedLayer() : Layer("same name") {}
+    virtual void handleRead(canopen::LayerStatus &status, const LayerState &current_state) {}
+    virtual void handleWrite(canopen::LayerStatus &status, const LayerState &current_state) {}
+    virtual void handleDiag(canopen::LayerReport &report) {}
+    virtual void handleInit(canopen::LayerStatus &status) {}
+    virtual void handleShutdown(canopen::LayerStatus &status) {}
+    virtual void handleHalt(canopen::LayerStatus &status) {}
+    virtual void handleRecover(canopen::LayerStatus &status) {}
+};
+
+TEST(TestTrace, checkLayerNames){
+    NamedLayer a, b;
+    EXPECT_NE(a.label(), b.label());
+
+    TraceRecorder::clear();
+    TraceRecorder::setEnabled(true);
+    canopen::LayerStatus status;
+    a.init(status);
+    b.init(status);
+    a.read(status);
+    b.read(status);
+    TraceRecorder::setEnabled(false);
+
+    std::string json = dump();
+    EXPECT_EQ(2u, count(json, "\"name\":\"" + a.label() + " read\""));
+    EXPECT_EQ(2u, count(json, "\"name\":\"" + b.label() + " read\""));
+}
+
+// Run all the tests that were declared with TEST()
+int main(int argc, char **argv){
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
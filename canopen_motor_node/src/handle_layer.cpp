@@ -4,6 +4,8 @@
 
 using namespace canopen;
 
+static const StatusCode UNSUPPORTED_MODE("unsupported mode active");
+
 
 template<typename T > class LimitsHandle : public LimitsHandleBase {
     T limits_handle_;
@@ -164,7 +166,7 @@ void HandleLayer::handleWrite(LayerStatus &status, const LayerState &current_sta
             cmd_pos_ = pos_;
             cmd_vel_ = vel_;
             cmd_eff_ = eff_;
-            if(jh) status.warn("unsupported mode active");
+            if(jh) status.warn(UNSUPPORTED_MODE);
         }
     }
 }
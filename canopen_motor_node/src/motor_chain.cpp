@@ -59,7 +59,12 @@ bool MotorChain::nodeAdded(XmlRpc::XmlRpcValue &params, const canopen::NodeShare
 }
 
 bool MotorChain::setup_chain() {
-    motors_.reset(new LayerGroupNoDiag<MotorBase>("402 Layer"));
+    int parallel_threads = nh_priv_.param("parallel_threads", -1);
+    if(parallel_threads >= 0){
+        motors_.reset(new ParallelLayerGroup<MotorBase>("402 Layer", parallel_threads));
+    }else{
+        motors_.reset(new LayerGroupNoDiag<MotorBase>("402 Layer"));
+    }
     robot_layer_.reset(new RobotLayer(nh_));
 
     ros::Duration dur(0.0) ;
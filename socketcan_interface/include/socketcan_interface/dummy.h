@@ -59,6 +59,7 @@ class DummyInterface : public DriverInterface{
     DummyBus::ConnectionSharedPtr bus_;
     State state_;
     std::deque<can::Frame> in_;
+    size_t in_flight_; ///< frames that were popped, but are still dispatched
     bool loopback_;
     bool trace_;
     boost::mutex mutex_;
@@ -84,8 +85,8 @@ class DummyInterface : public DriverInterface{
         bus_.reset();
     };
 public:
-    DummyInterface() : loopback_(false), trace_(false) {}
-    DummyInterface(bool loopback) : loopback_(loopback), trace_(false) {}
+    DummyInterface() : in_flight_(0), loopback_(false), trace_(false) {}
+    DummyInterface(bool loopback) : in_flight_(0), loopback_(loopback), trace_(false) {}
     virtual ~DummyInterface() { shutdown_internal(); }
 
 
@@ -132,15 +133,11 @@ public:
         return loopback_;
     };
 
+    /// waits until all received frames have been dispatched
     void flush(){
-        while (true) {
-            {
-                boost::mutex::scoped_lock cond_lock(mutex_);
-                if (in_.empty() || state_.driver_state == State::closed) {
-                    return;
-                }            
-            }
-            boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+        boost::mutex::scoped_lock cond_lock(mutex_);
+        while (!(in_.empty() && in_flight_ == 0) && state_.driver_state != State::closed) {
+            cond_.wait_for(cond_lock, boost::chrono::milliseconds(100));
         }
     }
 
@@ -158,8 +155,13 @@ public:
                 if (trace_) {
                     ROSCANOPEN_DEBUG("socketcan_interface", "receive: " << msg);
                 }
+                ++in_flight_;
+                cond_lock.unlock(); // listeners may send, which locks the receiving interfaces
                 frame_dispatcher_.dispatch(msg.key(), msg);
+                cond_lock.lock();
+                --in_flight_;
             }
+            cond_.notify_all(); // wakes flush()
             if (state_.driver_state == State::closed) {
                 return;
             }
@@ -215,12 +217,15 @@ private:
 class DummyReplay : public DummyResponder {
 private:
     virtual void respond(const Frame & msg) {
-        const auto &front = replay_.front();
+        if (replay_.empty()) {
+            return;
+        }
+        const auto front = replay_.front();
         if (tostring(msg, true) == front.first) {
+            replay_.pop_front(); // before sending, the receiver might check done() right away
             for(auto &f: front.second) {
                 send(f);
             }
-            replay_.pop_front();
         }
     }
     std::list<std::pair<std::string, std::vector<Frame> > > replay_;